@@ -0,0 +1,330 @@
+#ifndef BINCHECKPOINT_H
+#define BINCHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include "readwritebin.h"
+
+/*! \brief Helpers of checkpoint() and restore() */
+namespace bin_checkpoint {
+
+//! \brief The alignment of the spans in the data file and of the direct I/O
+const std::size_t alignment = 4096;
+
+//! \brief The magic string at the beginning of a manifest
+const char magic[8] = {'R', 'W', 'B', 'C', 'K', 'P', 'T', '1'};
+
+//! \brief Round up to a multiple of the alignment
+inline std::size_t align_up(std::size_t n) { return (n + alignment - 1) / alignment * alignment; }
+
+//! \brief A chunk of a span, written and checked by a single thread
+struct Chunk {
+  std::size_t span;  //!< \brief The index of the span
+  std::size_t first;  //!< \brief The position of the chunk inside the span
+  std::size_t len;  //!< \brief The size of the chunk
+};
+
+//! \brief Split the spans in chunks, span by span
+inline std::vector<Chunk> make_chunks(const std::vector<std::size_t> &sizes, std::size_t chunk_bytes) {
+  std::vector<Chunk> chunks;
+  for (std::size_t s = 0; s != sizes.size(); ++s)
+    for (std::size_t first = 0; first < sizes[s]; first += chunk_bytes)
+      chunks.push_back(Chunk{s, first, std::min(chunk_bytes, sizes[s] - first)});
+  return chunks;
+}
+
+//! \brief A buffer aligned for direct I/O
+class AlignedBuffer {
+ public:
+  explicit AlignedBuffer(std::size_t n) {
+    if (n > 0 && posix_memalign(&ptr, alignment, n) != 0)
+      throw std::bad_alloc();
+  }
+  ~AlignedBuffer() { std::free(ptr); }
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer&) = delete;
+  char *data() const { return static_cast<char*>(ptr); }
+
+ private:
+  void *ptr = nullptr;
+};
+
+/*! \brief Open a file, with direct I/O if requested and supported
+ *
+ * If the filesystem doesn't support direct I/O the file is opened without it.
+ * \param direct If true it tries direct I/O, and it is set to false if it isn't used
+ */
+inline int open_file(const std::string &fname, int flags, bool &direct) {
+#ifdef O_DIRECT
+  if (direct) {
+    int fd = ::open(fname.c_str(), flags | O_DIRECT | O_CLOEXEC, 0644);
+    if (fd >= 0 || errno != EINVAL)
+      return fd;
+  }
+#endif
+  direct = false;
+  return ::open(fname.c_str(), flags | O_CLOEXEC, 0644);
+}
+
+//! \brief Write all the bytes at a position
+inline bool pwrite_all(int fd, const char *src, std::size_t n, off_t p) {
+  while (n > 0) {
+    ssize_t w = ::pwrite(fd, src, n, p);
+    if (w <= 0)
+      return false;
+    src += w;
+    n -= w;
+    p += w;
+  }
+  return true;
+}
+
+//! \brief Read all the bytes at a position
+inline bool pread_all(int fd, char *dst, std::size_t n, off_t p) {
+  while (n > 0) {
+    ssize_t r = ::pread(fd, dst, n, p);
+    if (r <= 0)
+      return false;
+    dst += r;
+    n -= r;
+    p += r;
+  }
+  return true;
+}
+
+/*! \brief Process the chunks with many threads
+ *
+ * If a chunk fails the remaining ones are skipped and the first exception is rethrown.
+ */
+template <typename F>
+void for_each_chunk(std::size_t n_chunks, unsigned threads, F fn) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min<std::size_t>(threads, std::max<std::size_t>(1, n_chunks));
+  std::atomic<std::size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto worker = [&](unsigned t) {
+    try {
+      for (std::size_t i = next++; i < n_chunks; i = next++)
+        fn(t, i);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error)
+        error = std::current_exception();
+      next = n_chunks;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(worker, t);
+  worker(0);
+  for (auto &t : pool)
+    t.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+}  // namespace bin_checkpoint
+
+/*! \brief Save regions of memory to a file, with many threads
+ *
+ * The old manifest, if any, is removed and the removal is synced before
+ * the data file is touched, so after a crash an old manifest never
+ * describes new data. The spans are stored one after the other in the
+ * file path, each one at a position aligned to 4096 bytes. They are
+ * split in chunks, and each chunk is written with positional writes by
+ * one of the threads, which also computes its CRC32C. When the data is
+ * on disk the manifest
+ * (the positions and the sizes of the spans and the checksums of the
+ * chunks) is written to path.manifest, atomically, so a checkpoint
+ * interrupted halfway can't be restored. The directory is synced last,
+ * so when it returns the checkpoint survives a crash. The manifest is
+ * written in the byte order of the machine.
+ * \param spans The regions of memory (address and size)
+ * \param path The data file. If it already exists it is replaced
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ * \param direct
+ * \parblock
+ * If true the file is written with O_DIRECT, bypassing the page cache,
+ * through an aligned buffer per thread. If the filesystem doesn't
+ * support it the normal I/O is used. The default value is false.
+ * \endparblock
+ * \param chunk_bytes The size of the chunks, rounded up to a multiple of 4096. The default value is 8 MiB
+ */
+inline void checkpoint(const std::vector<std::pair<const void*, std::size_t>> &spans, const std::string &path,
+                       unsigned threads = 0, bool direct = false, std::size_t chunk_bytes = 8 << 20) {
+  using namespace bin_checkpoint;
+  chunk_bytes = align_up(std::max<std::size_t>(chunk_bytes, 1));
+  const std::string manifest = path + ".manifest";
+  if (std::remove(manifest.c_str()) != 0 && errno != ENOENT)
+    throw std::runtime_error("Couldn't remove file " + manifest + "!");
+  if (!fsync_parent_dir(manifest))
+    throw std::runtime_error("Couldn't remove file " + manifest + "!");
+
+  std::vector<std::size_t> sizes, offsets;
+  std::size_t total = 0;
+  for (const auto &s : spans) {
+    offsets.push_back(total);
+    sizes.push_back(s.second);
+    total += align_up(s.second);
+  }
+  const std::vector<Chunk> chunks = make_chunks(sizes, chunk_bytes);
+  std::vector<std::uint32_t> crcs(chunks.size());
+
+  int fd = open_file(path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+  if (fd < 0)
+    throw std::domain_error("Couldn't open file " + path + "!");
+  try {
+    if (ftruncate(fd, total) != 0)
+      throw std::runtime_error("Couldn't write file " + path + "!");
+    std::vector<std::unique_ptr<AlignedBuffer>> bounce(std::max(1u, threads == 0 ? std::thread::hardware_concurrency() : threads));
+    for_each_chunk(chunks.size(), static_cast<unsigned>(bounce.size()), [&](unsigned t, std::size_t i) {
+      const Chunk &c = chunks[i];
+      const char *src = static_cast<const char*>(spans[c.span].first) + c.first;
+      crcs[i] = crc32c(0, src, c.len);
+      std::size_t n = c.len;
+      if (direct) {
+        if (!bounce[t])
+          bounce[t].reset(new AlignedBuffer(chunk_bytes));
+        n = align_up(c.len);
+        std::memcpy(bounce[t]->data(), src, c.len);
+        std::memset(bounce[t]->data() + c.len, 0, n - c.len);
+        src = bounce[t]->data();
+      }
+      if (!pwrite_all(fd, src, n, offsets[c.span] + c.first))
+        throw std::runtime_error("Couldn't write file " + path + "!");
+    });
+    if (fdatasync(fd) != 0)
+      throw std::runtime_error("Couldn't write file " + path + "!");
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  if (::close(fd) != 0)
+    throw std::runtime_error("Couldn't write file " + path + "!");
+
+  std::vector<char> m(magic, magic + sizeof(magic));
+  auto put = [&m](std::uint64_t v) { m.insert(m.end(), reinterpret_cast<const char*>(&v), reinterpret_cast<const char*>(&v) + 8); };
+  put(chunk_bytes);
+  put(spans.size());
+  for (std::size_t s = 0; s != spans.size(); ++s) {
+    put(offsets[s]);
+    put(sizes[s]);
+  }
+  m.insert(m.end(), reinterpret_cast<const char*>(crcs.data()), reinterpret_cast<const char*>(crcs.data() + crcs.size()));
+  std::uint32_t crc = crc32c(0, m.data(), m.size());
+  m.insert(m.end(), reinterpret_cast<const char*>(&crc), reinterpret_cast<const char*>(&crc) + 4);
+
+  const std::string tmp = manifest + ".tmp";
+  fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    throw std::domain_error("Couldn't open file " + tmp + "!");
+  bool ok = pwrite_all(fd, m.data(), m.size(), 0) && fdatasync(fd) == 0;
+  if (::close(fd) != 0 || !ok || std::rename(tmp.c_str(), manifest.c_str()) != 0)
+    throw std::runtime_error("Couldn't write file " + manifest + "!");
+  // The manifest and the data file are in the same directory: this makes both entries durable
+  if (!fsync_parent_dir(manifest))
+    throw std::runtime_error("Couldn't write file " + manifest + "!");
+}
+
+/*! \brief Load regions of memory saved by checkpoint(), with many threads
+ *
+ * The chunks are read with positional reads and their checksums are
+ * verified by the threads which read them.
+ * \param path The data file given to checkpoint()
+ * \param spans The regions of memory (address and size), with the same sizes as the saved ones
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ * \param direct
+ * \parblock
+ * If true the file is read with O_DIRECT, bypassing the page cache,
+ * through an aligned buffer per thread. If the filesystem doesn't
+ * support it the normal I/O is used. The default value is false.
+ * \endparblock
+ * \exception std::domain_error If the manifest is missing or the spans don't match it
+ * \exception std::runtime_error If the data can't be read or a checksum is wrong
+ */
+inline void restore(const std::string &path, const std::vector<std::pair<void*, std::size_t>> &spans,
+                    unsigned threads = 0, bool direct = false) {
+  using namespace bin_checkpoint;
+  const std::string manifest = path + ".manifest";
+  std::vector<char> m;
+  {
+    Bin mb(manifest, Bin::Mode::read_only);
+    m.resize(mb.size());
+    if (!m.empty() && mb.try_get_values_at(m.data(), m.size(), 0) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't read file " + manifest + "!");
+  }
+  if (m.size() < sizeof(magic) + 20 || std::memcmp(m.data(), magic, sizeof(magic)) != 0)
+    throw std::runtime_error("Corrupted manifest " + manifest + "!");
+  std::uint32_t crc;
+  std::memcpy(&crc, m.data() + m.size() - 4, 4);
+  if (crc != crc32c(0, m.data(), m.size() - 4))
+    throw std::runtime_error("Corrupted manifest " + manifest + "!");
+  std::size_t pos = sizeof(magic);
+  auto get = [&m, &pos]() {
+    std::uint64_t v = 0;
+    if (pos + 8 <= m.size() - 4)
+      std::memcpy(&v, m.data() + pos, 8);
+    pos += 8;
+    return static_cast<std::size_t>(v);
+  };
+  const std::size_t chunk_bytes = get();
+  if (get() != spans.size() || chunk_bytes == 0 || chunk_bytes % alignment != 0)
+    throw std::domain_error("The spans don't match the checkpoint!");
+  std::vector<std::size_t> sizes, offsets;
+  for (std::size_t s = 0; s != spans.size(); ++s) {
+    offsets.push_back(get());
+    sizes.push_back(get());
+    if (sizes.back() != spans[s].second)
+      throw std::domain_error("The spans don't match the checkpoint!");
+  }
+  const std::vector<Chunk> chunks = make_chunks(sizes, chunk_bytes);
+  if (pos + 4 * chunks.size() + 4 != m.size())
+    throw std::runtime_error("Corrupted manifest " + manifest + "!");
+  std::vector<std::uint32_t> crcs(chunks.size());
+  std::memcpy(crcs.data(), m.data() + pos, 4 * chunks.size());
+
+  int fd = open_file(path, O_RDONLY, direct);
+  if (fd < 0)
+    throw std::domain_error("Couldn't open file " + path + "!");
+  try {
+    std::vector<std::unique_ptr<AlignedBuffer>> bounce(std::max(1u, threads == 0 ? std::thread::hardware_concurrency() : threads));
+    for_each_chunk(chunks.size(), static_cast<unsigned>(bounce.size()), [&](unsigned t, std::size_t i) {
+      const Chunk &c = chunks[i];
+      char *dst = static_cast<char*>(spans[c.span].first) + c.first;
+      if (direct) {
+        if (!bounce[t])
+          bounce[t].reset(new AlignedBuffer(chunk_bytes));
+        if (!pread_all(fd, bounce[t]->data(), align_up(c.len), offsets[c.span] + c.first))
+          throw std::runtime_error("Couldn't read file " + path + "!");
+        std::memcpy(dst, bounce[t]->data(), c.len);
+      } else if (!pread_all(fd, dst, c.len, offsets[c.span] + c.first)) {
+        throw std::runtime_error("Couldn't read file " + path + "!");
+      }
+      if (crc32c(0, dst, c.len) != crcs[i])
+        throw std::runtime_error("Checksum mismatch in file " + path + "!");
+    });
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);
+}
+
+#endif // BINCHECKPOINT_H
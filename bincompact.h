@@ -0,0 +1,229 @@
+#ifndef BINCOMPACT_H
+#define BINCOMPACT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include "readwritebin.h"
+
+/*! \brief It compacts a file of fixed-size records, dropping the dead ones
+ *
+ * The live records are copied in order to a new file in large sequential
+ * batches, then the new file replaces the old one with an atomic rename.
+ * The copy is incremental: each step() copies a limited number of bytes
+ * (paced by the limiter of the file, if any), so it can be interleaved
+ * with the normal traffic on the file. The records written after being
+ * copied must be reported with note_write(), and they are copied again
+ * by finish().
+ *
+ * The positions of the records change, so the old indices are translated
+ * with remap() or rewrite_index(). The object must be used by a single thread.
+ */
+class BinCompactor {
+ public:
+  //! The type used to indicate positions inside the file
+  using size_type = Bin::size_type;
+
+  /*! \brief The constructor
+   *
+   * \param src The file to compact
+   * \param tmp_name The new file, which replaces the old one at the end. If it already exists it is replaced
+   * \param record_bytes The size of a record
+   * \param is_live A function telling if a record (given its bytes) is live
+   * \param header_bytes The size of the header of the file, copied as it is. The default value is 0
+   */
+  BinCompactor(Bin &src, const std::string &tmp_name, size_type record_bytes,
+               std::function<bool(const char*)> is_live, size_type header_bytes = 0) :
+      bin(src), tmp_file(tmp_name), record(record_bytes), live(std::move(is_live)), header(header_bytes) {
+    if (record <= 0 || header < 0)
+      throw std::domain_error("The record size must be positive!");
+    if (bin.size() < header)
+      throw std::runtime_error("Trying to read past EOF!");
+    dst.reset(new Bin(tmp_file, true));
+    if (header > 0)
+      bin.copy_to(*dst, 0, header, 0);
+    end = header;
+    refresh();
+  }
+
+  /*! \brief Copy some of the remaining records
+   *
+   * \param budget_bytes The number of bytes of the old file to process, at least a record
+   * \return It returns true if all the records have been copied
+   */
+  bool step(size_type budget_bytes) {
+    if (finished)
+      throw std::domain_error("The compaction is finished!");
+    const size_type per_batch = std::max<size_type>(1, std::min<size_type>(budget_bytes, 1 << 20) / record);
+    for (size_type done = 0; next < n_records && done < budget_bytes;) {
+      size_type k = std::min(per_batch, n_records - next);
+      if (bin.rate_limiter())
+        bin.rate_limiter()->acquire(k * record);
+      batch.resize(k * record);
+      if (bin.try_get_values_at(batch.data(), k * record, header + next * record) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't read file!");
+      stage.clear();
+      for (size_type j = 0; j != k; ++j) {
+        const char *rec = batch.data() + j * record;
+        if (!live(rec))
+          continue;
+        add_run(next + j, (end - header) / record);
+        stage.insert(stage.end(), rec, rec + record);
+        end += record;
+      }
+      if (!stage.empty() && dst->try_write_many(stage.data(), stage.size(), end - stage.size()) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+      next += k;
+      done += k * record;
+    }
+    return next >= n_records;
+  }
+
+  /*! \brief Tells if all the records have been copied */
+  bool done() const { return next >= n_records; }
+
+  /*! \brief Report a record written in the old file after the compaction started
+   *
+   * \param index The index of the record
+   */
+  void note_write(size_type index) {
+    if (index < next)
+      written.push_back(index);
+  }
+
+  /*! \brief Take into account the records appended to the old file */
+  void refresh() { n_records = (bin.size() - header) / record; }
+
+  /*! \brief Complete the compaction and replace the old file with the new one
+   *
+   * It copies the remaining records and the ones reported by note_write()
+   * (a record which became live after being skipped is appended at the
+   * end). Then the new file is synced to the disk and renamed over the
+   * old one, and the directory is synced too, so that after a crash the
+   * file is either the old one or the complete new one. The Bin of the
+   * old file must be opened again to see it.
+   */
+  void finish() {
+    refresh();
+    while (!step(size_type(1) << 30)) { }
+    std::sort(written.begin(), written.end());
+    written.erase(std::unique(written.begin(), written.end()), written.end());
+    std::vector<char> rec(record);
+    for (size_type i : written) {
+      if (bin.try_get_values_at(rec.data(), record, header + i * record) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't read file!");
+      size_type m = remap(i);
+      if (m < 0) {
+        if (!live(rec.data()))
+          continue;
+        m = (end - header) / record;
+        auto it = std::upper_bound(runs.begin(), runs.end(), i, [](size_type x, const Run &r) { return x < r.old_first; });
+        runs.insert(it, Run{i, m, 1});
+        end += record;
+      }
+      if (dst->try_write_many(rec.data(), record, header + m * record) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+    }
+    // The new file must be on disk before the rename, and the rename before returning
+    dst->close();
+    if (!fsync_file(tmp_file))
+      throw std::runtime_error("Couldn't write file!");
+    if (std::rename(tmp_file.c_str(), bin.get_filename().c_str()) != 0)
+      throw std::runtime_error("Couldn't replace file!");
+    finished = true;
+    if (!fsync_parent_dir(bin.get_filename()))
+      throw std::runtime_error("Couldn't write file!");
+  }
+
+  /*! \brief Translate the index of a record of the old file
+   *
+   * \param old_index The index in the old file
+   * \return It returns the index in the new file, or -1 if the record was dead (or not copied yet)
+   */
+  size_type remap(size_type old_index) const {
+    auto it = std::upper_bound(runs.begin(), runs.end(), old_index, [](size_type x, const Run &r) { return x < r.old_first; });
+    if (it == runs.begin())
+      return -1;
+    --it;
+    return old_index < it->old_first + it->count ? it->new_first + (old_index - it->old_first) : -1;
+  }
+
+  /*! \brief Translate the positions stored in an index file
+   *
+   * The index is read and written in batches. The positions inside the
+   * header are kept, and the ones inside a record are moved with it.
+   * \tparam T The type of the positions stored in the index
+   * \param index The index file, holding positions in the old file
+   * \param dead The value written for the positions of the dead records. The default value is T(-1)
+   */
+  template <typename T> void rewrite_index(Bin &index, T dead = T(-1)) const {
+    const size_type per_batch = (1 << 20) / sizeof(T);
+    const size_type n = index.size() / static_cast<size_type>(sizeof(T));
+    std::vector<T> vals;
+    for (size_type first = 0; first < n; first += per_batch) {
+      size_type k = std::min(per_batch, n - first);
+      vals.resize(k);
+      if (index.try_get_values_at(vals.data(), k, Bin::bytes<T>(first)) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't read file!");
+      for (T &v : vals) {
+        size_type p = static_cast<size_type>(v);
+        if (v == dead || p < header)
+          continue;
+        size_type m = remap((p - header) / record);
+        v = m < 0 ? dead : static_cast<T>(header + m * record + (p - header) % record);
+      }
+      if (index.try_write_many(vals.data(), k, Bin::bytes<T>(first)) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+    }
+  }
+
+  /*! \brief Get the number of records of the old file */
+  size_type records() const { return n_records; }
+
+  /*! \brief Get the number of records copied so far */
+  size_type scanned() const { return next; }
+
+  /*! \brief Get the size of the new file */
+  size_type new_size() const { return end; }
+
+ private:
+  //! \brief A run of live records, contiguous both in the old and in the new file
+  struct Run {
+    size_type old_first;  //!< \brief The index of the first record in the old file
+    size_type new_first;  //!< \brief The index of the first record in the new file
+    size_type count;  //!< \brief The number of records
+  };
+
+  Bin &bin;  //!< \brief The old file
+  const std::string tmp_file;  //!< \brief The name of the new file
+  const size_type record;  //!< \brief The size of a record
+  const std::function<bool(const char*)> live;  //!< \brief Tells if a record is live
+  const size_type header;  //!< \brief The size of the header
+  std::unique_ptr<Bin> dst;  //!< \brief The new file
+  size_type n_records = 0;  //!< \brief The number of records of the old file
+  size_type next = 0;  //!< \brief The index of the next record to copy
+  size_type end = 0;  //!< \brief The size of the new file
+  std::vector<Run> runs;  //!< \brief The runs of live records, by index in the old file
+  std::vector<size_type> written;  //!< \brief The records written after being copied
+  std::vector<char> batch;  //!< \brief The records read
+  std::vector<char> stage;  //!< \brief The live records to write
+  bool finished = false;  //!< \brief Tells if the new file replaced the old one
+
+  //! \brief Record that a record was copied
+  void add_run(size_type old_index, size_type new_index) {
+    if (!runs.empty()) {
+      Run &r = runs.back();
+      if (r.old_first + r.count == old_index && r.new_first + r.count == new_index) {
+        ++r.count;
+        return;
+      }
+    }
+    runs.push_back(Run{old_index, new_index, 1});
+  }
+};
+
+#endif // BINCOMPACT_H
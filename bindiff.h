@@ -0,0 +1,90 @@
+#ifndef BINDIFF_H
+#define BINDIFF_H
+
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include "readwritebin.h"
+
+/*! \brief Find the ranges where two files differ
+ *
+ * The files are compared in large blocks with memcmp (which uses the
+ * SIMD instructions of the machine), and only the blocks which differ
+ * are scanned element by element. If a file is longer than the other,
+ * its tail is a differing range. The positions in the files are preserved.
+ * \tparam T
+ * \parblock
+ * The type of the elements: the ranges are made of whole elements,
+ * so each range starts and ends at a multiple of sizeof(T).
+ * The default value is char
+ * \endparblock
+ * \param a,b The files to compare
+ * \param max_ranges
+ * \parblock
+ * Stop as soon as this number of ranges is found. If 0 (the default)
+ * all the ranges are returned. With 1, it tells quickly if the files
+ * are equal and where they start to differ.
+ * \endparblock
+ * \return It returns the differing ranges, in order and never adjacent
+ */
+template <typename T = char>
+std::vector<BinRange> diff(Bin &a, Bin &b, std::size_t max_ranges = 0) {
+  using size_type = Bin::size_type;
+  const size_type g = sizeof(T);
+  const size_type block = std::max<size_type>(1, (1 << 20) / g) * g;
+  size_type size_a = a.size(), size_b = b.size();
+  size_type common = std::min(size_a, size_b);
+  std::vector<BinRange> ret;
+  auto full = [&]() { return max_ranges != 0 && ret.size() >= max_ranges; };
+  // Add a range, merging it with the previous one if they touch
+  auto add = [&](size_type first, size_type last) {
+    if (!ret.empty() && ret.back().offset + ret.back().length == first)
+      ret.back().length = last - ret.back().offset;
+    else
+      ret.push_back(BinRange{first, last - first});
+  };
+
+  std::vector<char> ba(std::min(block, common)), bb(ba.size());
+  for (size_type p = 0; p < common; p += block) {
+    size_type k = std::min(block, common - p);
+    if (a.try_get_values_at(ba.data(), k, p) != Bin::Status::ok ||
+        b.try_get_values_at(bb.data(), k, p) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't read file!");
+    // Once the ranges are full, the first equal element ends the last one
+    if (std::memcmp(ba.data(), bb.data(), k) == 0) {
+      if (full())
+        return ret;
+      continue;
+    }
+    for (size_type i = 0; i < k;) {
+      // Skip the equal stretches 64 bytes at a time
+      size_type stride = std::max<size_type>(64 / g, 1) * g;
+      if (i + stride <= k && std::memcmp(&ba[i], &bb[i], stride) == 0) {
+        if (full())
+          return ret;
+        i += stride;
+        continue;
+      }
+      size_type e = std::min(g, k - i);
+      if (std::memcmp(&ba[i], &bb[i], e) != 0)
+        add(p + i, p + i + e);
+      else if (full())
+        return ret;
+      i += e;
+    }
+  }
+  if (size_a != size_b) {
+    // A partial element before the tail belongs to the tail
+    size_type first = common / g * g;
+    bool merges = !ret.empty() && ret.back().offset + ret.back().length >= first;
+    if (!full() || merges) {
+      if (merges)
+        first = ret.back().offset + ret.back().length;
+      add(first, std::max(size_a, size_b));
+    }
+  }
+  return ret;
+}
+
+#endif // BINDIFF_H
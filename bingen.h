@@ -0,0 +1,447 @@
+#ifndef BINGEN_H
+#define BINGEN_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include "readwritebin.h"
+#include "bintext.h"
+
+/*! \brief The distributions of the values of a synthetic column
+ *
+ * uniform: Uniform in [min, max]\n
+ * zipf: min + k - 1, where the rank k in [1, max - min + 1] has a probability proportional to 1 / k^param\n
+ * sorted: Non-decreasing from min to max\n
+ * runs: Uniform values repeated in runs whose mean length is param\n
+ * sparse: 0, or with probability param a uniform value in [min, max]
+ */
+enum class Distribution { uniform, zipf, sorted, runs, sparse };
+
+/*! \brief The description of a synthetic column
+ *
+ * The bounds of an integer column are rounded to the nearest integer,
+ * and both must be representable in the type of the column.
+ */
+struct ColumnSpec {
+  NumType type;  //!< \brief The type of the values
+  Distribution dist;  //!< \brief The distribution of the values
+  double min;  //!< \brief The smallest value
+  double max;  //!< \brief The largest value
+  double param;  //!< \brief The parameter of the distribution, see Distribution
+
+  /*! \brief The constructor
+   *
+   * \param t The type of the values
+   * \param d The distribution of the values. The default value is Distribution::uniform
+   * \param lo The smallest value. The default value is 0
+   * \param hi The largest value. The default value is 100
+   * \param p The parameter of the distribution. The default value is 1
+   */
+  ColumnSpec(NumType t, Distribution d = Distribution::uniform, double lo = 0, double hi = 100, double p = 1) :
+      type(t), dist(d), min(lo), max(hi), param(p) { }
+};
+
+/*! \brief Helpers of the dataset generator */
+namespace bin_gen {
+
+//! \brief The number of rows generated with the same random sequence
+const std::size_t chunk_rows = 1 << 16;
+
+//! \brief The finalizer of splitmix64
+inline std::uint64_t mix(std::uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+//! \brief The splitmix64 generator
+struct SplitMix64 {
+  std::uint64_t state;  //!< \brief The state
+  std::uint64_t next() { return mix(state += 0x9e3779b97f4a7c15ULL); }
+  double unit() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+/*! \brief Zipf ranks by rejection-inversion (Hörmann and Derflinger)
+ *
+ * It takes constant time and memory, whatever the number of ranks.
+ */
+class Zipf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param ranks The number of ranks
+   * \param exponent The exponent, positive
+   */
+  Zipf(double ranks, double exponent) : n(ranks), s(exponent) {
+    if (!(s > 0) || n < 1)
+      throw std::domain_error("Zipf needs a positive exponent and at least a rank!");
+    h_x1 = h_integral(1.5) - 1;
+    h_n = h_integral(n + 0.5);
+    threshold = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+  }
+
+  /*! \brief Get a rank in [1, n], as an integral double */
+  double operator()(SplitMix64 &rng) const {
+    for (;;) {
+      double u = h_n + rng.unit() * (h_x1 - h_n);
+      double x = h_integral_inverse(u);
+      double k = std::min(std::max(std::floor(x + 0.5), 1.0), n);
+      if (k - x <= threshold || u >= h_integral(k + 0.5) - h(k))
+        return k;
+    }
+  }
+
+ private:
+  double n, s, h_x1 = 0, h_n = 0, threshold = 0;
+
+  static double helper1(double x) { return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x)); }
+  static double helper2(double x) { return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x)); }
+  double h(double x) const { return std::exp(-s * std::log(x)); }
+  double h_integral(double x) const {
+    double lx = std::log(x);
+    return helper2((1 - s) * lx) * lx;
+  }
+  double h_integral_inverse(double x) const {
+    double t = std::max(x * (1 - s), -1.0);
+    return std::exp(helper1(t) * x);
+  }
+};
+
+//! \brief Tells if a finite value is in the range of an integer type
+template <typename T> bool fits(double v, std::true_type) {
+  // 2^bits (or 2^(bits-1) if signed) is exact in a double, unlike the largest value
+  return v >= static_cast<double>(std::numeric_limits<T>::min()) &&
+         v < 2.0 * static_cast<double>(std::numeric_limits<T>::max() / 2 + 1);
+}
+
+//! \brief Tells if a finite value is in the range of a floating point type
+template <typename T> bool fits(double v, std::false_type) {
+  return std::fabs(v) <= static_cast<double>(std::numeric_limits<T>::max());
+}
+
+//! \brief Tells if a value is in the range of a numeric type
+template <typename T> bool fits(double v) { return std::isfinite(v) && fits<T>(v, std::is_integral<T>()); }
+
+//! \brief Tells if a value is in the range of a numeric type
+inline bool fits(NumType t, double v) {
+  switch (t) {
+    case NumType::i8: return fits<std::int8_t>(v);
+    case NumType::i16: return fits<std::int16_t>(v);
+    case NumType::i32: return fits<std::int32_t>(v);
+    case NumType::i64: return fits<std::int64_t>(v);
+    case NumType::u8: return fits<std::uint8_t>(v);
+    case NumType::u16: return fits<std::uint16_t>(v);
+    case NumType::u32: return fits<std::uint32_t>(v);
+    case NumType::u64: return fits<std::uint64_t>(v);
+    case NumType::f32: return fits<float>(v);
+    default: return fits<double>(v);
+  }
+}
+
+/*! \brief Convert an integral value in the range of a numeric type to 64 bits
+ *
+ * The negative values wrap around, so that the distance between two
+ * values, in any integer type, is their difference in unsigned 64 bits.
+ */
+inline std::uint64_t to_bits(NumType t, double v) {
+  if (t == NumType::u64 && v >= 9223372036854775808.0)
+    return static_cast<std::uint64_t>(v);
+  return static_cast<std::uint64_t>(static_cast<std::int64_t>(v));
+}
+
+//! \brief It generates the values of a column
+class ColumnGen {
+ public:
+  /*! \brief The constructor
+   *
+   * \param c The description of the column
+   * \param n_rows The total number of rows, used by the sorted distribution
+   */
+  ColumnGen(const ColumnSpec &c, std::size_t n_rows) :
+      spec(c), rows(n_rows), is_int(c.type != NumType::f32 && c.type != NumType::f64),
+      lo(check(c) && is_int ? to_bits(c.type, std::round(c.min)) : 0),
+      span(is_int ? to_bits(c.type, std::round(c.max)) - lo : 0),
+      zipf(c.dist == Distribution::zipf ? ranks() : 1, c.dist == Distribution::zipf ? c.param : 1) { }
+
+  /*! \brief Generate the values of some rows of a chunk
+   *
+   * \param dst Where the value of the first row is written
+   * \param stride The distance between the values of two rows
+   * \param first The index of the first row, the first one of a chunk
+   * \param n The number of rows
+   * \param seed The seed of the chunk
+   */
+  void fill(char *dst, std::size_t stride, std::size_t first, std::size_t n, std::uint64_t seed) const {
+    switch (spec.type) {
+      case NumType::i8: fill_as<std::int8_t>(dst, stride, first, n, seed); break;
+      case NumType::i16: fill_as<std::int16_t>(dst, stride, first, n, seed); break;
+      case NumType::i32: fill_as<std::int32_t>(dst, stride, first, n, seed); break;
+      case NumType::i64: fill_as<std::int64_t>(dst, stride, first, n, seed); break;
+      case NumType::u8: fill_as<std::uint8_t>(dst, stride, first, n, seed); break;
+      case NumType::u16: fill_as<std::uint16_t>(dst, stride, first, n, seed); break;
+      case NumType::u32: fill_as<std::uint32_t>(dst, stride, first, n, seed); break;
+      case NumType::u64: fill_as<std::uint64_t>(dst, stride, first, n, seed); break;
+      case NumType::f32: fill_as<float>(dst, stride, first, n, seed); break;
+      default: fill_as<double>(dst, stride, first, n, seed); break;
+    }
+  }
+
+ private:
+  const ColumnSpec spec;  //!< \brief The description of the column
+  const std::size_t rows;  //!< \brief The total number of rows
+  const bool is_int;  //!< \brief Tells if the values are integers
+  const std::uint64_t lo;  //!< \brief The smallest integer value, see to_bits()
+  const std::uint64_t span;  //!< \brief The largest integer value minus the smallest one
+  const Zipf zipf;  //!< \brief The ranks of the zipf distribution
+
+  //! \brief Validate a description, see the constructor
+  static bool check(const ColumnSpec &c) {
+    bool integer = c.type != NumType::f32 && c.type != NumType::f64;
+    if (!fits(c.type, integer ? std::round(c.min) : c.min) || !fits(c.type, integer ? std::round(c.max) : c.max))
+      throw std::domain_error("The range doesn't fit in the type of the column!");
+    if (c.max < c.min)
+      throw std::domain_error("The largest value is smaller than the smallest one!");
+    if ((c.dist == Distribution::runs && c.param < 1) || (c.dist == Distribution::sparse && (c.param < 0 || c.param > 1)))
+      throw std::domain_error("Invalid parameter of the distribution!");
+    return true;
+  }
+
+  //! \brief The number of ranks of the zipf distribution: the values min, min + 1...
+  double ranks() const {
+    return is_int ? static_cast<double>(span) + 1 : std::min(std::floor(spec.max - spec.min), 1.8e19) + 1;
+  }
+
+  //! \brief An offset in [0, span] from a value in [0, span + 1), rounded down
+  std::uint64_t offset_of(double x) const {
+    return x >= static_cast<double>(span) ? span : static_cast<std::uint64_t>(x);
+  }
+
+  //! \brief A uniform integer, as an offset from lo
+  std::uint64_t uniform_offset(SplitMix64 &rng) const {
+    std::uint64_t r = rng.next();
+    return span == std::numeric_limits<std::uint64_t>::max() ? r : r % (span + 1);
+  }
+
+  //! \brief The floating point value at a fraction of the range, without overflowing
+  double real_at(double f) const {
+    return std::min(std::max(spec.min * (1 - f) + spec.max * f, spec.min), spec.max);
+  }
+
+  //! \brief Store the integer at an offset from lo
+  template <typename T> void store(char *dst, std::uint64_t off, std::true_type) const {
+    // The sum wraps around like to_bits(), and is in the range of T
+    T t = static_cast<T>(lo + off);
+    std::memcpy(dst, &t, sizeof(T));
+  }
+
+  //! \brief Store a floating point value
+  template <typename T> void store(char *dst, double v, std::false_type) const {
+    T t = static_cast<T>(v);
+    std::memcpy(dst, &t, sizeof(T));
+  }
+
+  template <typename T> void fill_as(char *dst, std::size_t stride, std::size_t first, std::size_t n, std::uint64_t seed) const {
+    fill_as<T>(dst, stride, first, n, seed, std::is_integral<T>());
+  }
+
+  //! \brief Generate integers, as offsets from lo, in unsigned 64-bit arithmetic
+  template <typename T> void fill_as(char *dst, std::size_t stride, std::size_t first, std::size_t n, std::uint64_t seed,
+                                     std::true_type is_integral) const {
+    SplitMix64 rng{seed};
+    std::uint64_t run_value = 0, run_left = 0;
+    for (std::size_t i = 0; i != n; ++i, dst += stride) {
+      std::uint64_t off;
+      switch (spec.dist) {
+        case Distribution::zipf:
+          off = offset_of(zipf(rng) - 1);
+          break;
+        case Distribution::sorted: {
+          double f = (static_cast<double>(first + i) + rng.unit()) / static_cast<double>(rows);
+          off = offset_of(std::floor(f * (static_cast<double>(span) + 1)));
+          break;
+        }
+        case Distribution::runs:
+          if (run_left == 0) {
+            run_value = uniform_offset(rng);
+            run_left = 1 + rng.next() % static_cast<std::uint64_t>(2 * spec.param - 1);
+          }
+          --run_left;
+          off = run_value;
+          break;
+        case Distribution::sparse:
+          if (rng.unit() >= spec.param) {
+            T zero = 0;
+            std::memcpy(dst, &zero, sizeof(T));
+            continue;
+          }
+          off = uniform_offset(rng);
+          break;
+        default:
+          off = uniform_offset(rng);
+          break;
+      }
+      store<T>(dst, off, is_integral);
+    }
+  }
+
+  //! \brief Generate floating point values
+  template <typename T> void fill_as(char *dst, std::size_t stride, std::size_t first, std::size_t n, std::uint64_t seed,
+                                     std::false_type is_integral) const {
+    SplitMix64 rng{seed};
+    double run_value = 0;
+    std::uint64_t run_left = 0;
+    for (std::size_t i = 0; i != n; ++i, dst += stride) {
+      double v;
+      switch (spec.dist) {
+        case Distribution::zipf:
+          v = spec.min + zipf(rng) - 1;
+          break;
+        case Distribution::sorted:
+          v = real_at((static_cast<double>(first + i) + rng.unit()) / static_cast<double>(rows));
+          break;
+        case Distribution::runs:
+          if (run_left == 0) {
+            run_value = real_at(rng.unit());
+            run_left = 1 + rng.next() % static_cast<std::uint64_t>(2 * spec.param - 1);
+          }
+          --run_left;
+          v = run_value;
+          break;
+        case Distribution::sparse:
+          v = rng.unit() < spec.param ? real_at(rng.unit()) : 0;
+          break;
+        default:
+          v = real_at(rng.unit());
+          break;
+      }
+      store<T>(dst, v, is_integral);
+    }
+  }
+};
+
+/*! \brief Generate rows, in chunks, with many threads
+ *
+ * \param cols The descriptions of the columns
+ * \param rows The number of rows
+ * \param seed The seed of the dataset
+ * \param threads The number of threads, 0 for the number of cores
+ * \param swap Tells, for each column, if the bytes of its values must be reversed
+ * \param records If true the rows are packed in records, otherwise each column is separate
+ * \param write A function writing the bytes of a column (or of the records, as column 0) of a chunk
+ */
+template <typename W>
+void generate_rows(const std::vector<ColumnSpec> &cols, std::size_t rows, std::uint64_t seed, unsigned threads,
+                   const std::vector<bool> &swap, bool records, W write) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<ColumnGen> gens;
+  std::vector<std::size_t> sizes, offsets;
+  std::size_t record = 0;
+  for (const auto &c : cols) {
+    gens.emplace_back(c, rows);
+    sizes.push_back(num_type_size(c.type));
+    offsets.push_back(records ? record : 0);
+    record += sizes.back();
+  }
+  const std::size_t n_bufs = records ? 1 : cols.size();
+  std::vector<std::vector<std::vector<char>>> bufs(threads, std::vector<std::vector<char>>(n_bufs));
+  const std::size_t n_chunks = (rows + chunk_rows - 1) / chunk_rows;
+  for (std::size_t c0 = 0; c0 < n_chunks; c0 += threads) {
+    std::vector<std::exception_ptr> errors(threads);
+    auto worker = [&](unsigned t) {
+      try {
+        std::size_t chunk = c0 + t;
+        if (chunk >= n_chunks)
+          return;
+        std::size_t first = chunk * chunk_rows, n = std::min(chunk_rows, rows - first);
+        for (std::size_t b = 0; b != n_bufs; ++b)
+          bufs[t][b].resize(n * (records ? record : sizes[b]));
+        for (std::size_t c = 0; c != cols.size(); ++c) {
+          std::vector<char> &buf = bufs[t][records ? 0 : c];
+          std::size_t stride = records ? record : sizes[c];
+          std::uint64_t chunk_seed = mix(seed ^ mix(c + 1) ^ mix((std::uint64_t(chunk) << 20) + 0x5bd1e995));
+          gens[c].fill(&buf[offsets[c]], stride, first, n, chunk_seed);
+          if (swap[c] && sizes[c] > 1)
+            for (std::size_t i = 0; i != n; ++i)
+              std::reverse(&buf[i * stride + offsets[c]], &buf[i * stride + offsets[c] + sizes[c]]);
+        }
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &t : pool)
+      t.join();
+    for (unsigned t = 0; t != threads && c0 + t < n_chunks; ++t) {
+      if (errors[t])
+        std::rethrow_exception(errors[t]);
+      for (std::size_t b = 0; b != n_bufs; ++b)
+        write(b, bufs[t][b]);
+    }
+  }
+}
+
+//! \brief Write bytes with a single write
+inline void write_bytes(Bin &b, const std::vector<char> &bytes) {
+  if (b.try_write_many(bytes.data(), bytes.size()) != Bin::Status::ok)
+    throw std::runtime_error("Couldn't write file!");
+}
+
+}  // namespace bin_gen
+
+/*! \brief Write a synthetic dataset as typed columns
+ *
+ * The rows are generated in chunks of 65536, each one by a single
+ * thread with its own splitmix64 sequence, seeded by the seed of the
+ * dataset, the column and the chunk. So the dataset depends only on the
+ * seed, not on the number of threads. Each column of a chunk is written
+ * with a single write, in the endianness of its file.
+ * \param cols The descriptions of the columns
+ * \param rows The number of rows
+ * \param out The files where the columns are written, from their current position
+ * \param seed The seed of the dataset. The default value is 0
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ */
+inline void generate_columns(const std::vector<ColumnSpec> &cols, std::size_t rows, const std::vector<Bin*> &out,
+                             std::uint64_t seed = 0, unsigned threads = 0) {
+  if (cols.empty() || cols.size() != out.size())
+    throw std::domain_error("There must be a file for each column!");
+  std::vector<bool> swap;
+  for (Bin *b : out)
+    swap.push_back(b->is_little_endian() != Bin::is_default_little_endian());
+  bin_gen::generate_rows(cols, rows, seed, threads, swap, false,
+                         [&out](std::size_t c, const std::vector<char> &bytes) { bin_gen::write_bytes(*out[c], bytes); });
+}
+
+/*! \brief Write a synthetic dataset as records
+ *
+ * The fields of a record are packed, in the order of the columns, and
+ * have the same values as the ones written by generate_columns() with
+ * the same seed. Each chunk of records is written with a single write.
+ * \param layout The descriptions of the fields of a record
+ * \param rows The number of records
+ * \param out The file where the records are written, from its current position, in its endianness
+ * \param seed The seed of the dataset. The default value is 0
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ */
+inline void generate_records(const std::vector<ColumnSpec> &layout, std::size_t rows, Bin &out,
+                             std::uint64_t seed = 0, unsigned threads = 0) {
+  if (layout.empty())
+    throw std::domain_error("The layout must have at least a field!");
+  std::vector<bool> swap(layout.size(), out.is_little_endian() != Bin::is_default_little_endian());
+  bin_gen::generate_rows(layout, rows, seed, threads, swap, true,
+                         [&out](std::size_t, const std::vector<char> &bytes) { bin_gen::write_bytes(out, bytes); });
+}
+
+#endif // BINGEN_H
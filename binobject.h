@@ -0,0 +1,518 @@
+#ifndef BINOBJECT_H
+#define BINOBJECT_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <tuple>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include "readwritebin.h"
+
+/*! \brief Tells if a type is a leaf of an object, which is written as it is in memory
+ *
+ * The leaves are the arithmetic types and the enums.
+ */
+template <typename T>
+struct is_object_leaf : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value> { };
+
+/*! \brief It writes the body of an object in large writes
+ *
+ * The small leaves are gathered in a staging buffer, while the
+ * large arrays of leaves are written directly with a single write.
+ */
+class ObjectWriter {
+ public:
+  /*! \brief The constructor
+   *
+   * \param b The Bin instance, written from its current position
+   */
+  explicit ObjectWriter(Bin &b) : bin(b), swap(b.is_little_endian() != Bin::is_default_little_endian()) { }
+
+  /*! \brief Write an array of leaves
+   *
+   * \param v The leaves
+   * \param n The number of leaves
+   */
+  template <typename T> void put(const T *v, std::size_t n) {
+    const char *p = reinterpret_cast<const char*>(v);
+    std::size_t len = n * sizeof(T);
+    if (!swap || sizeof(T) == 1) {
+      if (len >= direct_bytes) {
+        flush();
+        raw(p, len);
+      } else {
+        if (stage.size() + len > stage_bytes)
+          flush();
+        stage.insert(stage.end(), p, p + len);
+      }
+      return;
+    }
+    for (std::size_t i = 0; i != n; ++i) {
+      if (stage.size() + sizeof(T) > stage_bytes)
+        flush();
+      stage.insert(stage.end(), p + i * sizeof(T), p + (i + 1) * sizeof(T));
+      std::reverse(stage.end() - sizeof(T), stage.end());
+    }
+  }
+
+  /*! \brief Write the leaves still in the staging buffer */
+  void flush() {
+    raw(stage.data(), stage.size());
+    stage.clear();
+  }
+
+ private:
+  static const std::size_t stage_bytes = 1 << 20;  //!< \brief The size of the staging buffer
+  static const std::size_t direct_bytes = 1 << 16;  //!< \brief The size of the arrays written directly
+  Bin &bin;  //!< \brief The Bin instance
+  const bool swap;  //!< \brief Tells if the bytes of the leaves must be reversed
+  std::vector<char> stage;  //!< \brief The staging buffer
+
+  //! \brief Write bytes to the file
+  void raw(const char *p, std::size_t len) {
+    if (len != 0 && bin.try_write_many(p, len) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't write file!");
+  }
+};
+
+/*! \brief It reads the body of an object in large reads
+ *
+ * The file is read ahead in a staging buffer, and the large arrays of
+ * leaves are read directly. When it is destroyed the position in the
+ * file is moved back to the end of the object.
+ */
+class ObjectReader {
+ public:
+  /*! \brief The constructor
+   *
+   * \param b The Bin instance, read from its current position
+   */
+  explicit ObjectReader(Bin &b) :
+      bin(b), swap(b.is_little_endian() != Bin::is_default_little_endian()), file_pos(b.rpos()), end(b.size()) { }
+
+  ~ObjectReader() {
+    try {
+      bin.rjump_to(file_pos - (stage.size() - pos));
+    } catch (...) { }
+  }
+
+  /*! \brief Read an array of leaves
+   *
+   * \param v The destination
+   * \param n The number of leaves
+   */
+  template <typename T> void get(T *v, std::size_t n) {
+    char *p = reinterpret_cast<char*>(v);
+    std::size_t len = n * sizeof(T);
+    std::size_t k = std::min(len, stage.size() - pos);
+    if (k != 0)
+      std::memcpy(p, &stage[pos], k);
+    pos += k;
+    if (k < len && len - k >= direct_bytes) {
+      if (static_cast<Bin::size_type>(len - k) > end - file_pos ||
+          bin.try_get_values_into(p + k, len - k) != Bin::Status::ok)
+        throw std::runtime_error("Trying to read past EOF!");
+      file_pos += len - k;
+    } else if (k < len) {
+      refill();
+      if (stage.size() < len - k)
+        throw std::runtime_error("Trying to read past EOF!");
+      std::memcpy(p + k, stage.data(), len - k);
+      pos = len - k;
+    }
+    if (swap && sizeof(T) > 1)
+      for (std::size_t i = 0; i != n; ++i)
+        std::reverse(p + i * sizeof(T), p + (i + 1) * sizeof(T));
+  }
+
+  /*! \brief Get the number of bytes of the file not read yet */
+  std::uint64_t remaining() const { return (stage.size() - pos) + static_cast<std::uint64_t>(end - file_pos); }
+
+ private:
+  static const std::size_t stage_bytes = 1 << 20;  //!< \brief The size of the staging buffer
+  static const std::size_t direct_bytes = 1 << 16;  //!< \brief The size of the arrays read directly
+  Bin &bin;  //!< \brief The Bin instance
+  const bool swap;  //!< \brief Tells if the bytes of the leaves must be reversed
+  Bin::size_type file_pos;  //!< \brief The position in the file after the staging buffer
+  const Bin::size_type end;  //!< \brief The size of the file
+  std::vector<char> stage;  //!< \brief The staging buffer
+  std::size_t pos = 0;  //!< \brief The position in the staging buffer
+
+  //! \brief Read the next bytes of the file in the staging buffer
+  void refill() {
+    std::size_t k = std::min<Bin::size_type>(stage_bytes, end - file_pos);
+    stage.resize(k);
+    pos = 0;
+    if (k != 0 && bin.try_get_values_into(stage.data(), k) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't read file!");
+    file_pos += k;
+  }
+};
+
+/*! \brief The table of the lengths of the containers of an object, consumed in order */
+class ObjectLengths {
+ public:
+  /*! \brief The constructor
+   *
+   * \param first,last The lengths
+   */
+  ObjectLengths(const std::uint64_t *first, const std::uint64_t *last) : cur(first), end(last) { }
+
+  /*! \brief Get the next length */
+  std::uint64_t next() {
+    if (cur == end)
+      throw std::runtime_error("The object doesn't match its type!");
+    return *cur++;
+  }
+
+  /*! \brief Tells if every length has been consumed */
+  bool done() const { return cur == end; }
+
+  /*! \brief Get the number of lengths not consumed yet */
+  std::uint64_t remaining() const { return end - cur; }
+
+ private:
+  const std::uint64_t *cur;  //!< \brief The next length
+  const std::uint64_t *end;  //!< \brief The end of the table
+};
+
+/*! \brief The least an element of a type takes in a written object
+ *
+ * The bytes of its leaves in the body and the number of its lengths in
+ * the table. The lengths read from a file are checked against them
+ * before a container is sized, so a corrupted length is reported
+ * instead of allocating a huge container. The types without a
+ * specialization take nothing, so their containers are not checked.
+ * \tparam T The type of the element
+ */
+template <typename T, typename Enable = void> struct ObjectFootprint {
+  static const std::uint64_t bytes = 0;  //!< \brief The bytes of the leaves
+  static const std::uint64_t lengths = 0;  //!< \brief The number of lengths
+};
+
+/*! \brief How an object is written and read
+ *
+ * An object is written in two parts: first the table of the lengths of
+ * all its containers, then its body, made of the leaves only. So the
+ * containers can be sized before reading their elements. Specialize it
+ * to support other types.
+ * \tparam T The type of the object
+ */
+template <typename T, typename Enable = void> struct ObjectIO;
+
+/*! \brief How a leaf is written and read */
+template <typename T>
+struct ObjectIO<T, typename std::enable_if<is_object_leaf<T>::value>::type> {
+  static void lengths(const T &, std::vector<std::uint64_t> &) { }
+  static void write(ObjectWriter &w, const T &v) { w.put(&v, 1); }
+  static void read(ObjectReader &r, ObjectLengths &, T &v) { r.get(&v, 1); }
+};
+
+/*! \brief Helpers of the specializations of ObjectIO */
+namespace object_io {
+
+//! \brief A footprint with the given bytes and lengths
+template <std::uint64_t B, std::uint64_t L> struct Footprint {
+  static const std::uint64_t bytes = B;
+  static const std::uint64_t lengths = L;
+};
+
+//! \brief The footprint of a type followed by the footprints of other types
+template <typename... Ts> struct SumFootprint : Footprint<0, 0> { };
+
+template <typename T, typename... Ts>
+struct SumFootprint<T, Ts...> : Footprint<ObjectFootprint<T>::bytes + SumFootprint<Ts...>::bytes,
+                                          ObjectFootprint<T>::lengths + SumFootprint<Ts...>::lengths> { };
+
+/*! \brief Get the length of the next container, checking that the rest of the object can hold it
+ *
+ * \tparam E The type of the elements of the container
+ */
+template <typename E> std::uint64_t next_length(ObjectReader &r, ObjectLengths &len) {
+  std::uint64_t n = len.next();
+  if ((ObjectFootprint<E>::bytes != 0 && n > r.remaining() / ObjectFootprint<E>::bytes) ||
+      (ObjectFootprint<E>::lengths != 0 && n > len.remaining() / ObjectFootprint<E>::lengths))
+    throw std::runtime_error("Corrupted object!");
+  return n;
+}
+
+//! \brief Write the elements of a range, in a single write if they are contiguous leaves
+template <typename T>
+void write_range(ObjectWriter &w, const T *v, std::size_t n, std::true_type) { w.put(v, n); }
+
+template <typename T>
+void write_range(ObjectWriter &w, const T *v, std::size_t n, std::false_type) {
+  for (std::size_t i = 0; i != n; ++i)
+    ObjectIO<T>::write(w, v[i]);
+}
+
+//! \brief Read the elements of a range, in a single read if they are contiguous leaves
+template <typename T>
+void read_range(ObjectReader &r, ObjectLengths &, T *v, std::size_t n, std::true_type) { r.get(v, n); }
+
+template <typename T>
+void read_range(ObjectReader &r, ObjectLengths &len, T *v, std::size_t n, std::false_type) {
+  for (std::size_t i = 0; i != n; ++i)
+    ObjectIO<T>::read(r, len, v[i]);
+}
+
+//! \brief Add the lengths of the elements of a range
+template <typename It>
+void range_lengths(It first, It last, std::vector<std::uint64_t> &out) {
+  using T = typename std::iterator_traits<It>::value_type;
+  if (!is_object_leaf<T>::value)
+    for (; first != last; ++first)
+      ObjectIO<T>::lengths(*first, out);
+}
+
+//! \brief The elements of a tuple, from the I-th
+template <std::size_t I, typename Tuple, bool = (I < std::tuple_size<Tuple>::value)>
+struct TupleIO {
+  static void lengths(const Tuple &t, std::vector<std::uint64_t> &out) {
+    using E = typename std::tuple_element<I, Tuple>::type;
+    ObjectIO<E>::lengths(std::get<I>(t), out);
+    TupleIO<I + 1, Tuple>::lengths(t, out);
+  }
+  static void write(ObjectWriter &w, const Tuple &t) {
+    using E = typename std::tuple_element<I, Tuple>::type;
+    ObjectIO<E>::write(w, std::get<I>(t));
+    TupleIO<I + 1, Tuple>::write(w, t);
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, Tuple &t) {
+    using E = typename std::tuple_element<I, Tuple>::type;
+    ObjectIO<E>::read(r, len, std::get<I>(t));
+    TupleIO<I + 1, Tuple>::read(r, len, t);
+  }
+};
+
+template <std::size_t I, typename Tuple>
+struct TupleIO<I, Tuple, false> {
+  static void lengths(const Tuple &, std::vector<std::uint64_t> &) { }
+  static void write(ObjectWriter &, const Tuple &) { }
+  static void read(ObjectReader &, ObjectLengths &, Tuple &) { }
+};
+
+//! \brief How a map-like container is written and read
+template <typename M>
+struct MapIO {
+  using K = typename M::key_type;
+  using V = typename M::mapped_type;
+  static void lengths(const M &m, std::vector<std::uint64_t> &out) {
+    out.push_back(m.size());
+    for (const auto &kv : m) {
+      ObjectIO<K>::lengths(kv.first, out);
+      ObjectIO<V>::lengths(kv.second, out);
+    }
+  }
+  static void write(ObjectWriter &w, const M &m) {
+    for (const auto &kv : m) {
+      ObjectIO<K>::write(w, kv.first);
+      ObjectIO<V>::write(w, kv.second);
+    }
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, M &m) {
+    std::uint64_t n = next_length<std::pair<K, V>>(r, len);
+    m.clear();
+    for (std::uint64_t i = 0; i != n; ++i) {
+      K k;
+      V v;
+      ObjectIO<K>::read(r, len, k);
+      ObjectIO<V>::read(r, len, v);
+      m.emplace_hint(m.end(), std::move(k), std::move(v));
+    }
+  }
+};
+
+}  // namespace object_io
+
+/*! \brief The footprints of the leaves and of the standard containers: a container takes its length */
+template <typename T>
+struct ObjectFootprint<T, typename std::enable_if<is_object_leaf<T>::value>::type> : object_io::Footprint<sizeof(T), 0> { };
+
+template <typename T, typename A>
+struct ObjectFootprint<std::vector<T, A>> : object_io::Footprint<0, 1> { };
+
+template <typename C, typename Tr, typename A>
+struct ObjectFootprint<std::basic_string<C, Tr, A>> : object_io::Footprint<0, 1> { };
+
+template <typename K, typename V, typename C, typename A>
+struct ObjectFootprint<std::map<K, V, C, A>> : object_io::Footprint<0, 1> { };
+
+template <typename K, typename V, typename H, typename E, typename A>
+struct ObjectFootprint<std::unordered_map<K, V, H, E, A>> : object_io::Footprint<0, 1> { };
+
+template <typename T, std::size_t N>
+struct ObjectFootprint<std::array<T, N>> :
+    object_io::Footprint<N * ObjectFootprint<T>::bytes, N * ObjectFootprint<T>::lengths> { };
+
+template <typename T1, typename T2>
+struct ObjectFootprint<std::pair<T1, T2>> : object_io::SumFootprint<T1, T2> { };
+
+template <typename... Ts>
+struct ObjectFootprint<std::tuple<Ts...>> : object_io::SumFootprint<Ts...> { };
+
+/*! \brief How a std::vector is written and read */
+template <typename T, typename A>
+struct ObjectIO<std::vector<T, A>> {
+  static void lengths(const std::vector<T, A> &v, std::vector<std::uint64_t> &out) {
+    out.push_back(v.size());
+    object_io::range_lengths(v.begin(), v.end(), out);
+  }
+  static void write(ObjectWriter &w, const std::vector<T, A> &v) {
+    object_io::write_range(w, v.data(), v.size(), is_object_leaf<T>());
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, std::vector<T, A> &v) {
+    v.resize(object_io::next_length<T>(r, len));
+    object_io::read_range(r, len, v.data(), v.size(), is_object_leaf<T>());
+  }
+};
+
+/*! \brief How a std::vector<bool> is written and read, a byte per element */
+template <typename A>
+struct ObjectIO<std::vector<bool, A>> {
+  static void lengths(const std::vector<bool, A> &v, std::vector<std::uint64_t> &out) { out.push_back(v.size()); }
+  static void write(ObjectWriter &w, const std::vector<bool, A> &v) {
+    std::vector<char> bytes(v.begin(), v.end());
+    w.put(bytes.data(), bytes.size());
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, std::vector<bool, A> &v) {
+    std::vector<char> bytes(object_io::next_length<char>(r, len));
+    r.get(bytes.data(), bytes.size());
+    v.assign(bytes.begin(), bytes.end());
+  }
+};
+
+/*! \brief How a std::basic_string is written and read */
+template <typename C, typename Tr, typename A>
+struct ObjectIO<std::basic_string<C, Tr, A>> {
+  static void lengths(const std::basic_string<C, Tr, A> &s, std::vector<std::uint64_t> &out) { out.push_back(s.size()); }
+  static void write(ObjectWriter &w, const std::basic_string<C, Tr, A> &s) { w.put(s.data(), s.size()); }
+  static void read(ObjectReader &r, ObjectLengths &len, std::basic_string<C, Tr, A> &s) {
+    s.resize(object_io::next_length<C>(r, len));
+    if (!s.empty())
+      r.get(&s[0], s.size());
+  }
+};
+
+/*! \brief How a std::array is written and read: its length is not written */
+template <typename T, std::size_t N>
+struct ObjectIO<std::array<T, N>> {
+  static void lengths(const std::array<T, N> &a, std::vector<std::uint64_t> &out) {
+    object_io::range_lengths(a.begin(), a.end(), out);
+  }
+  static void write(ObjectWriter &w, const std::array<T, N> &a) {
+    object_io::write_range(w, a.data(), N, is_object_leaf<T>());
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, std::array<T, N> &a) {
+    object_io::read_range(r, len, a.data(), N, is_object_leaf<T>());
+  }
+};
+
+/*! \brief How a std::pair is written and read */
+template <typename T1, typename T2>
+struct ObjectIO<std::pair<T1, T2>> {
+  static void lengths(const std::pair<T1, T2> &p, std::vector<std::uint64_t> &out) {
+    ObjectIO<T1>::lengths(p.first, out);
+    ObjectIO<T2>::lengths(p.second, out);
+  }
+  static void write(ObjectWriter &w, const std::pair<T1, T2> &p) {
+    ObjectIO<T1>::write(w, p.first);
+    ObjectIO<T2>::write(w, p.second);
+  }
+  static void read(ObjectReader &r, ObjectLengths &len, std::pair<T1, T2> &p) {
+    ObjectIO<T1>::read(r, len, p.first);
+    ObjectIO<T2>::read(r, len, p.second);
+  }
+};
+
+/*! \brief How a std::tuple is written and read */
+template <typename... Ts>
+struct ObjectIO<std::tuple<Ts...>> : object_io::TupleIO<0, std::tuple<Ts...>> { };
+
+/*! \brief How a std::map is written and read */
+template <typename K, typename V, typename C, typename A>
+struct ObjectIO<std::map<K, V, C, A>> : object_io::MapIO<std::map<K, V, C, A>> { };
+
+/*! \brief How a std::unordered_map is written and read */
+template <typename K, typename V, typename H, typename E, typename A>
+struct ObjectIO<std::unordered_map<K, V, H, E, A>> : object_io::MapIO<std::unordered_map<K, V, H, E, A>> { };
+
+/*! \brief Write an object made of nested standard containers from the current position
+ *
+ * It writes the number of lengths, the table of the lengths of all the
+ * containers, then the leaves. The contiguous arrays of leaves are
+ * written with a single write, and the small ones are gathered, so an
+ * object needs a few large writes whatever its shape.
+ * \tparam T
+ * \parblock
+ * The type of the object: std::vector, std::basic_string, std::array,
+ * std::pair, std::tuple, std::map and std::unordered_map of each other,
+ * with arithmetic or enum leaves. It is deduced from the object assigned
+ * \endparblock
+ * \param b The Bin instance
+ * \param obj The object
+ */
+template <typename T> void write_object(Bin &b, const T &obj) {
+  std::vector<std::uint64_t> lens;
+  ObjectIO<T>::lengths(obj, lens);
+  ObjectWriter w(b);
+  std::uint64_t n = lens.size();
+  w.put(&n, 1);
+  w.put(lens.data(), lens.size());
+  ObjectIO<T>::write(w, obj);
+  w.flush();
+}
+
+/*! \brief Write an object made of nested standard containers in the specified position
+ *
+ * \param b The Bin instance
+ * \param obj The object
+ * \param p The position where you want to write
+ */
+template <typename T> void write_object(Bin &b, const T &obj, Bin::size_type p) {
+  b.wjump_to(p);
+  write_object(b, obj);
+}
+
+/*! \brief Read an object written by write_object() from the current position
+ *
+ * The table of the lengths is read first, so every container is sized
+ * before its elements are read, and the contiguous arrays of leaves
+ * are read with a single read.
+ * \tparam T The type of the object, the same used to write it
+ * \param b The Bin instance
+ * \param obj The destination
+ */
+template <typename T> void read_object(Bin &b, T &obj) {
+  ObjectReader r(b);
+  std::uint64_t n;
+  r.get(&n, 1);
+  if (n > static_cast<std::uint64_t>(b.size()) / sizeof(std::uint64_t))
+    throw std::runtime_error("Corrupted object!");
+  std::vector<std::uint64_t> lens(n);
+  r.get(lens.data(), lens.size());
+  ObjectLengths len(lens.data(), lens.data() + lens.size());
+  ObjectIO<T>::read(r, len, obj);
+  if (!len.done())
+    throw std::runtime_error("The object doesn't match its type!");
+}
+
+/*! \brief Read an object written by write_object() from the specified position
+ *
+ * \param b The Bin instance
+ * \param obj The destination
+ * \param p The position from where you want to read
+ */
+template <typename T> void read_object(Bin &b, T &obj, Bin::size_type p) {
+  b.rjump_to(p);
+  read_object(b, obj);
+}
+
+#endif // BINOBJECT_H
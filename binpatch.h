@@ -0,0 +1,244 @@
+#ifndef BINPATCH_H
+#define BINPATCH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+#include "readwritebin.h"
+
+/*! \brief Write a patch which turns a file into a newer version of it
+ *
+ * The old file is indexed by blocks: a weak rolling checksum (the one
+ * of rsync) to find the candidates and xxhash64() to confirm them.
+ * Then the checksum is rolled byte by byte over the new file, and each
+ * block found in the old file becomes a copy instruction, while the
+ * bytes in between become insert instructions. The memory used is the
+ * index (about 24 bytes per block of the old file) plus a few MiB of
+ * buffers, whatever the size of the files.
+ *
+ * The patch holds the hashes of both files, so that apply_patch()
+ * refuses a different old file and verifies its output. Its numbers
+ * are written with the endianness of patch_bin, which must be used
+ * to read it back too.
+ * \param old_bin The old version of the file
+ * \param new_bin The new version of the file
+ * \param patch_bin The file where the patch is written, from its current position
+ * \param block_bytes
+ * \parblock
+ * The size of the blocks. Smaller blocks find more copies,
+ * but make a larger index. The default value is 4 KiB
+ * \endparblock
+ */
+inline void make_patch(Bin &old_bin, Bin &new_bin, Bin &patch_bin, Bin::size_type block_bytes = 1 << 12) {
+  using size_type = Bin::size_type;
+  const size_type B = block_bytes;
+  if (B <= 0)
+    throw std::domain_error("The block size must be positive!");
+
+  struct Entry {
+    std::uint32_t weak;
+    std::uint64_t strong;
+    size_type offset;
+    bool operator<(const Entry &e) const { return weak != e.weak ? weak < e.weak : offset < e.offset; }
+  };
+  // The weak checksum of a whole block
+  auto weak_of = [B](const char *w, std::uint32_t &a, std::uint32_t &b) {
+    a = b = 0;
+    for (size_type j = 0; j != B; ++j) {
+      std::uint32_t x = static_cast<unsigned char>(w[j]);
+      a += x;
+      b += static_cast<std::uint32_t>(B - j) * x;
+    }
+  };
+  auto combine = [](std::uint32_t a, std::uint32_t b) { return (a & 0xffff) | (b << 16); };
+
+  // Index the old file
+  const size_type old_size = old_bin.size(), new_size = new_bin.size();
+  const size_type chunk = std::max<size_type>(1 << 22, 2 * B) / B * B;
+  std::vector<Entry> index;
+  index.reserve(old_size / B);
+  {
+    std::vector<char> stage(std::min(chunk, old_size / B * B));
+    for (size_type p = 0; p + B <= old_size; p += chunk) {
+      size_type k = std::min(chunk, (old_size - p) / B * B);
+      if (old_bin.try_get_values_at(stage.data(), k, p) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't read file!");
+      for (size_type i = 0; i != k; i += B) {
+        std::uint32_t a, b;
+        weak_of(&stage[i], a, b);
+        index.push_back(Entry{combine(a, b), xxhash64(&stage[i], B), p + i});
+      }
+    }
+  }
+  std::sort(index.begin(), index.end());
+
+  patch_bin.write_string("RWBPATCH");
+  patch_bin.write<std::int64_t>(new_size);
+  patch_bin.write<std::uint64_t>(old_bin.hash());
+  patch_bin.write<std::uint64_t>(new_bin.hash());
+
+  // The pending instructions: at most one of them is non-empty
+  size_type copy_offset = 0, copy_len = 0;
+  std::string literal;
+  const size_type max_literal = 1 << 20;
+  auto flush_copy = [&]() {
+    if (copy_len == 0)
+      return;
+    patch_bin.write<std::uint8_t>(1);
+    patch_bin.write<std::int64_t>(copy_offset);
+    patch_bin.write<std::int64_t>(copy_len);
+    copy_len = 0;
+  };
+  auto flush_literal = [&]() {
+    if (literal.empty())
+      return;
+    patch_bin.write<std::uint8_t>(2);
+    patch_bin.write<std::int64_t>(literal.size());
+    if (patch_bin.try_write_many(literal.data(), literal.size()) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't write file!");
+    literal.clear();
+  };
+
+  // Roll over the new file, keeping in memory the bytes from the current position
+  std::vector<char> win;
+  size_type win_pos = 0;
+  auto refill = [&](size_type i) {
+    size_type want = std::min(new_size, i + B + 1);
+    if (win_pos + static_cast<size_type>(win.size()) >= want)
+      return;
+    win.erase(win.begin(), win.begin() + (i - win_pos));
+    win_pos = i;
+    size_type from = win_pos + win.size(), k = std::min(chunk, new_size - from);
+    win.resize(win.size() + k);
+    if (new_bin.try_get_values_at(&win[win.size() - k], k, from) != Bin::Status::ok)
+      throw std::runtime_error("Couldn't read file!");
+  };
+
+  std::uint32_t a = 0, b = 0;
+  bool rolled = false;
+  for (size_type i = 0; i < new_size;) {
+    refill(i);
+    const char *w = &win[i - win_pos];
+    if (new_size - i < B || index.empty()) {
+      // No more copies: the rest is literal, emitted a window at a time
+      size_type k = std::min(new_size, win_pos + static_cast<size_type>(win.size())) - i;
+      flush_copy();
+      literal.append(w, w + k);
+      if (static_cast<size_type>(literal.size()) >= max_literal)
+        flush_literal();
+      i += k;
+      continue;
+    }
+    if (!rolled)
+      weak_of(w, a, b);
+    Entry key{combine(a, b), 0, 0};
+    auto range = std::equal_range(index.begin(), index.end(), key,
+                                  [](const Entry &x, const Entry &y) { return x.weak < y.weak; });
+    size_type match = -1;
+    if (range.first != range.second) {
+      std::uint64_t strong = xxhash64(w, B);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (it->strong != strong)
+          continue;
+        // Prefer the block which continues the pending copy
+        if (match < 0 || (copy_len != 0 && it->offset == copy_offset + copy_len))
+          match = it->offset;
+      }
+    }
+    if (match >= 0) {
+      flush_literal();
+      if (copy_len != 0 && copy_offset + copy_len == match) {
+        copy_len += B;
+      } else {
+        flush_copy();
+        copy_offset = match;
+        copy_len = B;
+      }
+      i += B;
+      rolled = false;
+      continue;
+    }
+    flush_copy();
+    literal.push_back(w[0]);
+    if (static_cast<size_type>(literal.size()) >= max_literal)
+      flush_literal();
+    if (new_size - i > B) {
+      std::uint32_t out = static_cast<unsigned char>(w[0]), in = static_cast<unsigned char>(w[B]);
+      a = a - out + in;
+      b = b - static_cast<std::uint32_t>(B) * out + a;
+      rolled = true;
+    } else {
+      rolled = false;
+    }
+    ++i;
+  }
+  flush_copy();
+  flush_literal();
+  patch_bin.write<std::uint8_t>(0);
+}
+
+/*! \brief Apply a patch written by make_patch()
+ *
+ * The instructions are streamed from the patch: the copies are
+ * read from the old file with Bin::copy_to() (paced by the limiters
+ * of the files, if any) and the inserts are read in chunks.
+ * \param old_bin The old version of the file, the same used to make the patch
+ * \param patch_bin The patch, read from its current position
+ * \param out_bin The file where the new version is written. It must be empty
+ */
+inline void apply_patch(Bin &old_bin, Bin &patch_bin, Bin &out_bin) {
+  using size_type = Bin::size_type;
+  if (patch_bin.get_string(8) != "RWBPATCH")
+    throw std::runtime_error("Not a patch!");
+  if (out_bin.size() != 0)
+    throw std::domain_error("The output file must be empty!");
+  size_type new_size = patch_bin.get_value<std::int64_t>();
+  std::uint64_t old_hash = patch_bin.get_value<std::uint64_t>();
+  std::uint64_t new_hash = patch_bin.get_value<std::uint64_t>();
+  if (old_bin.hash() != old_hash)
+    throw std::runtime_error("The patch was made for a different file!");
+
+  size_type p = 0;
+  std::vector<char> stage;
+  auto get_len = [&]() {
+    size_type len = patch_bin.get_value<std::int64_t>();
+    if (len < 0 || new_size - p < len)
+      throw std::runtime_error("Corrupted patch!");
+    return len;
+  };
+  for (std::uint8_t op; (op = patch_bin.get_value<std::uint8_t>()) != 0;) {
+    size_type len;
+    switch (op) {
+      case 1: {
+        size_type offset = patch_bin.get_value<std::int64_t>();
+        len = get_len();
+        old_bin.copy_to(out_bin, offset, len, p);
+        break;
+      }
+      case 2: {
+        len = get_len();
+        const size_type chunk = 1 << 20;
+        stage.resize(std::min(chunk, len));
+        out_bin.wjump_to(p);
+        for (size_type done = 0; done < len; done += chunk) {
+          size_type k = std::min(chunk, len - done);
+          if (patch_bin.try_get_values_into(stage.data(), k) != Bin::Status::ok)
+            throw std::runtime_error("Trying to read past EOF!");
+          if (out_bin.try_write_many(stage.data(), k) != Bin::Status::ok)
+            throw std::runtime_error("Couldn't write file!");
+        }
+        break;
+      }
+      default:
+        throw std::runtime_error("Corrupted patch!");
+    }
+    p += len;
+  }
+  out_bin.flush();
+  if (p != new_size || out_bin.size() != new_size || out_bin.hash() != new_hash)
+    throw std::runtime_error("The patched file doesn't match the new version!");
+}
+
+#endif // BINPATCH_H
@@ -0,0 +1,588 @@
+#ifndef BINPMR_H
+#define BINPMR_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "readwritebin.h"
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define BINPMR_MEMORY_RESOURCE
+#endif
+#endif
+
+// ThreadSanitizer keeps its shadow memory where the usual base address
+// is, and aborts on a mapping there: only its high application range works
+#ifndef BINPMR_DEFAULT_BASE
+#if defined(__SANITIZE_THREAD__)
+#define BINPMR_DEFAULT_BASE 0x7e8000000000
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define BINPMR_DEFAULT_BASE 0x7e8000000000
+#endif
+#endif
+#endif
+#ifndef BINPMR_DEFAULT_BASE
+#define BINPMR_DEFAULT_BASE 0x200000000000
+#endif
+
+/*! \brief A heap kept in a file, where containers can live across runs
+ *
+ * The file is mapped with a shared mapping, always at the base address
+ * recorded when it was created, so the pointers stored in it (like the
+ * ones inside the standard containers) stay valid when it is opened
+ * again, and the containers are used without any deserialization. If
+ * that address is taken (by another heap or by any other mapping),
+ * opening the file fails: the mapping never replaces what is there.
+ * Several heaps can be open at once if their base addresses differ.
+ *
+ * The default base address is BINPMR_DEFAULT_BASE, which can be defined
+ * before including the header. The sanitizers reserve large ranges of
+ * the address space: under ThreadSanitizer only its high application
+ * range (from 0x7e8000000000) can be mapped, and it is the default
+ * there, while AddressSanitizer accepts the usual default. A heap
+ * created with one base address can't be opened where it is taken.
+ *
+ * The bookkeeping is stored in the file by offsets: a header with the
+ * top of the heap, the root object and the free lists. Each block
+ * records its size and the size of the block before it, so a freed
+ * block is merged with the free blocks around it, or given back to the
+ * top. The free blocks are kept in lists by size class (powers of two),
+ * so a block is found without scanning the heap. The file grows as
+ * needed, up to the size reserved when it was created.
+ *
+ * With C++17 it is a std::pmr::memory_resource. The containers stored
+ * in the file must use BinAllocator, which stores in them the base
+ * address of the heap instead of a pointer to the resource (unlike
+ * std::pmr::polymorphic_allocator), so it is still valid in another run.
+ */
+class BinMemoryResource
+#ifdef BINPMR_MEMORY_RESOURCE
+    : public std::pmr::memory_resource
+#endif
+{
+ public:
+  //! The type used to indicate sizes and positions inside the file
+  using size_type = Bin::size_type;
+
+  //! The default base address of the mapping
+  static const std::uintptr_t default_base = BINPMR_DEFAULT_BASE;
+
+  //! The maximum number of heaps open at once
+  static const int max_open = 64;
+
+  /*! \brief The constructor
+   *
+   * It opens the heap, or creates it if the file doesn't exist or is empty,
+   * and makes it the current one (see current()).
+   * \param fname The filename
+   * \param reserve_bytes The maximum size of the heap, used only when it is created. The default value is 4 GiB
+   * \param base_address The address of the mapping, aligned to a page. It is used only when the heap is created
+   */
+  explicit BinMemoryResource(const std::string &fname, size_type reserve_bytes = size_type(1) << 32,
+                             std::uintptr_t base_address = default_base) {
+    fd = ::open(fname.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      throw std::domain_error("Couldn't open file!");
+    struct stat st;
+    Header h;
+    bool create = fstat(fd, &st) == 0 && st.st_size == 0;
+    if (create) {
+      if (reserve_bytes < static_cast<size_type>(sizeof(Header)))
+        fail("The heap is too small!");
+      if (base_address == 0 || base_address % sysconf(_SC_PAGESIZE) != 0)
+        fail("The base address must be a non-null multiple of the page size!");
+      std::memset(&h, 0, sizeof(h));
+      std::memcpy(h.magic, magic(), sizeof(h.magic));
+      h.base = base_address;
+      h.reserved = reserve_bytes;
+      h.top = sizeof(Header);
+      file_size = 0;
+    } else {
+      if (pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) || std::memcmp(h.magic, magic(), sizeof(h.magic)) != 0)
+        fail("Not a heap file!");
+      file_size = st.st_size;
+    }
+    reserved = h.reserved;
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    if (find(h.base))
+      fail("A heap with the same base address is already open!");
+    Slot *slot = nullptr;
+    for (int i = 0; i != max_open && !slot; ++i)
+      if (!slots()[i].heap.load(std::memory_order_relaxed))
+        slot = &slots()[i];
+    if (!slot)
+      fail("Too many heaps are open!");
+    void *want = reinterpret_cast<void*>(static_cast<std::uintptr_t>(h.base));
+    int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+    // The kernels which don't know the flag take the address as a hint, checked below
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    void *got = mmap(want, h.reserved, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (got == MAP_FAILED)
+      fail(errno == EEXIST ? "The base address of the heap is taken by another mapping!" : "Couldn't map file!");
+    if (got != want) {
+      munmap(got, h.reserved);
+      fail("The base address of the heap is taken by another mapping!");
+    }
+    base = static_cast<char*>(got);
+    if (create) {
+      try {
+        grow(std::min<size_type>(reserved, 1 << 20));
+      } catch (...) {
+        munmap(base, reserved);
+        fail("Couldn't write file!");
+      }
+      std::memcpy(base, &h, sizeof(h));
+    }
+    slot->heap.store(this, std::memory_order_relaxed);
+    slot->base.store(base_address_of(base), std::memory_order_release);
+    make_current();
+  }
+
+  BinMemoryResource(const BinMemoryResource &) = delete;
+  BinMemoryResource &operator=(const BinMemoryResource &) = delete;
+
+  /*! \brief The destructor
+   *
+   * The heap is written to the file. The objects in it are not destroyed.
+   */
+  ~BinMemoryResource() {
+    {
+      std::lock_guard<std::mutex> lock(registry_mutex());
+      for (int i = 0; i != max_open; ++i)
+        if (slots()[i].heap.load(std::memory_order_relaxed) == this) {
+          slots()[i].base.store(0, std::memory_order_release);
+          slots()[i].heap.store(nullptr, std::memory_order_release);
+        }
+    }
+    BinMemoryResource *self = this;
+    global_current().compare_exchange_strong(self, nullptr);
+    msync(base, file_size, MS_SYNC);
+    munmap(base, reserved);
+    ::close(fd);
+  }
+
+  /*! \brief Get the heap the BinAllocator instances constructed by default are bound to
+   *
+   * While find_or_construct() constructs a root object, it is the heap
+   * of the root in the thread constructing it. Otherwise it is the last
+   * heap opened (or made current) and not destroyed yet.
+   * \return It returns the heap, or nullptr
+   */
+  static BinMemoryResource *current() {
+    BinMemoryResource *r = bound_here();
+    return r ? r : global_current().load(std::memory_order_acquire);
+  }
+
+  /*! \brief Make this the heap the BinAllocator instances constructed by default are bound to */
+  void make_current() { global_current().store(this, std::memory_order_release); }
+
+  /*! \brief Get an open heap
+   *
+   * It doesn't take any lock, so the allocators can call it for each
+   * allocation.
+   * \param base_address The base address of the heap
+   * \return It returns the heap mapped at base_address, or nullptr if it isn't open
+   */
+  static BinMemoryResource *find(std::uintptr_t base_address) {
+    for (int i = 0; i != max_open; ++i)
+      if (slots()[i].base.load(std::memory_order_acquire) == base_address)
+        return slots()[i].heap.load(std::memory_order_acquire);
+    return nullptr;
+  }
+
+  /*! \brief Get the base address of the heap, which identifies it */
+  std::uintptr_t base_address() const { return base_address_of(base); }
+
+  /*! \brief Get the root object
+   *
+   * \return It returns the object set with set_root(), or nullptr
+   */
+  void *root() const {
+    std::uint64_t off = header().root;
+    return off ? base + off : nullptr;
+  }
+
+  /*! \brief Set the root object, to find it when the heap is opened again
+   *
+   * \param p An object allocated in the heap, or nullptr
+   */
+  void set_root(void *p) { header().root = p ? static_cast<char*>(p) - base : 0; }
+
+  /*! \brief Get the root object, constructing it in the heap the first time
+   *
+   * \tparam T The type of the root object
+   * \param args The arguments of the constructor of T, used only if it is constructed
+   * \return It returns the root object
+   */
+  template <typename T, typename... Args> T &find_or_construct(Args&&... args) {
+    if (void *r = root())
+      return *static_cast<T*>(r);
+    void *mem = allocate_block(sizeof(T), alignof(T));
+    // The allocators constructed by default inside T are bound to this heap, in this thread only
+    BinMemoryResource *prev = bound_here();
+    bound_here() = this;
+    T *ret;
+    try {
+      ret = new (mem) T(std::forward<Args>(args)...);
+    } catch (...) {
+      bound_here() = prev;
+      deallocate_block(mem, sizeof(T), alignof(T));
+      throw;
+    }
+    bound_here() = prev;
+    set_root(ret);
+    return *ret;
+  }
+
+  /*! \brief Get the number of bytes used by the heap, free blocks included */
+  size_type used() const { return header().top; }
+
+  /*! \brief Get the maximum size of the heap */
+  size_type capacity() const { return reserved; }
+
+  /*! \brief Write the heap to the file */
+  void flush() {
+    if (msync(base, file_size, MS_SYNC) != 0)
+      throw std::runtime_error("Couldn't write file!");
+  }
+
+#ifndef BINPMR_MEMORY_RESOURCE
+  /*! \brief Allocate a block
+   *
+   * \param bytes The size of the block
+   * \param alignment The alignment of the block, at most alignof(std::max_align_t)
+   * \return It returns the block
+   */
+  void *allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) {
+    return allocate_block(bytes, alignment);
+  }
+
+  /*! \brief Give back a block
+   *
+   * \param p The block
+   * \param bytes The size of the block
+   * \param alignment The alignment of the block
+   */
+  void deallocate(void *p, std::size_t bytes, std::size_t alignment = alignof(std::max_align_t)) {
+    deallocate_block(p, bytes, alignment);
+  }
+#endif
+
+ protected:
+#ifdef BINPMR_MEMORY_RESOURCE
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override { return allocate_block(bytes, alignment); }
+  void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override { deallocate_block(p, bytes, alignment); }
+  bool do_is_equal(const std::pmr::memory_resource &o) const noexcept override { return this == &o; }
+#endif
+
+ private:
+  //! \brief The number of size classes of the free blocks
+  static const int bin_count = 48;
+
+  //! \brief The header at the beginning of the file
+  struct Header {
+    char magic[8];  //!< \brief It identifies a heap file
+    std::uint64_t base;  //!< \brief The address of the mapping
+    std::uint64_t reserved;  //!< \brief The maximum size of the heap
+    std::uint64_t top;  //!< \brief The end of the blocks allocated so far
+    std::uint64_t last;  //!< \brief The size of the block ending at the top, 0 if none
+    std::uint64_t root;  //!< \brief The offset of the root object, 0 if none
+    std::uint64_t nonempty;  //!< \brief Bit k is set if the free list k isn't empty
+    std::uint64_t bins[bin_count];  //!< \brief The offsets of the first free blocks of each size class, 0 if none
+    std::uint64_t padding;  //!< \brief Keep the blocks aligned
+  };
+
+  //! \brief The header of a block, before the bytes given to the user
+  struct Block {
+    std::uint64_t size;  //!< \brief The size of the block, header included, plus 1 if the block is free
+    std::uint64_t prev_size;  //!< \brief The size of the block before, 0 for the first one
+  };
+
+  //! \brief The links of a free block, in place of the bytes given to the user
+  struct Links {
+    std::uint64_t next;  //!< \brief The offset of the next free block of the same class, 0 if none
+    std::uint64_t prev;  //!< \brief The offset of the previous free block of the same class, 0 if none
+  };
+
+  //! \brief An entry of the heaps open
+  struct Slot {
+    std::atomic<std::uintptr_t> base;  //!< \brief The base address of the heap, 0 if the entry is free
+    std::atomic<BinMemoryResource*> heap;  //!< \brief The heap
+  };
+
+  static const std::size_t align = sizeof(Block);  //!< \brief The alignment of the blocks
+  static const std::uint64_t min_block = sizeof(Block) + sizeof(Links);  //!< \brief The smallest block, which can hold the links
+  static_assert(sizeof(Header) % sizeof(Block) == 0, "The blocks must stay aligned");
+
+  int fd = -1;  //!< \brief The file descriptor
+  char *base = nullptr;  //!< \brief The beginning of the mapping
+  size_type file_size = 0;  //!< \brief The size of the file
+  size_type reserved = 0;  //!< \brief The maximum size of the heap, which is the size of the mapping
+  std::mutex m;  //!< \brief Serializes the allocations
+
+  static const char *magic() { return "RWBHEAP2"; }
+
+  static std::uintptr_t base_address_of(const char *p) { return reinterpret_cast<std::uintptr_t>(p); }
+
+  //! \brief The heaps open, looked up by base address without locks
+  static Slot *slots() {
+    static Slot s[max_open];
+    return s;
+  }
+
+  //! \brief Serializes the opening and the closing of the heaps
+  static std::mutex &registry_mutex() {
+    static std::mutex rm;
+    return rm;
+  }
+
+  //! \brief The heap made current, see current()
+  static std::atomic<BinMemoryResource*> &global_current() {
+    static std::atomic<BinMemoryResource*> cur(nullptr);
+    return cur;
+  }
+
+  //! \brief The heap bound in this thread by find_or_construct(), if any
+  static BinMemoryResource *&bound_here() {
+    static thread_local BinMemoryResource *r = nullptr;
+    return r;
+  }
+
+  Header &header() const { return *reinterpret_cast<Header*>(base); }
+  Block *block_at(std::uint64_t off) const { return reinterpret_cast<Block*>(base + off); }
+  Links *links_at(std::uint64_t off) const { return reinterpret_cast<Links*>(block_at(off) + 1); }
+
+  //! \brief The size of a block, header included
+  std::uint64_t size_at(std::uint64_t off) const { return block_at(off)->size & ~std::uint64_t(1); }
+
+  //! \brief Tells if a block is free
+  bool is_free(std::uint64_t off) const { return block_at(off)->size & 1; }
+
+  //! \brief The size class of a free block: k for the sizes from 32 << k to (64 << k) - 1
+  static int bin_of(std::uint64_t size) {
+    return std::min(63 - __builtin_clzll(size) - 5, bin_count - 1);
+  }
+
+  //! \brief Close the file and throw
+  [[noreturn]] void fail(const char *what) {
+    ::close(fd);
+    throw std::runtime_error(what);
+  }
+
+  //! \brief Make the file hold at least the given number of bytes
+  void grow(size_type bytes) {
+    if (bytes <= file_size)
+      return;
+    size_type target = std::min<size_type>(std::max(bytes, 2 * file_size), reserved);
+    if (ftruncate(fd, target) != 0)
+      throw std::bad_alloc();
+    file_size = target;
+  }
+
+  //! \brief Record the size of a block in the block after it, or in the header if it is the last one
+  void set_size(std::uint64_t off, std::uint64_t size) {
+    block_at(off)->size = size | (block_at(off)->size & 1);
+    if (off + size < header().top)
+      block_at(off + size)->prev_size = size;
+    else
+      header().last = size;
+  }
+
+  //! \brief Mark a block as free and put it at the head of the list of its class
+  void push_free(std::uint64_t off) {
+    Header &h = header();
+    int k = bin_of(size_at(off));
+    block_at(off)->size |= 1;
+    Links *l = links_at(off);
+    l->next = h.bins[k];
+    l->prev = 0;
+    if (h.bins[k])
+      links_at(h.bins[k])->prev = off;
+    h.bins[k] = off;
+    h.nonempty |= std::uint64_t(1) << k;
+  }
+
+  //! \brief Take a free block out of its list and mark it as used
+  void unlink_free(std::uint64_t off) {
+    Header &h = header();
+    int k = bin_of(size_at(off));
+    Links *l = links_at(off);
+    if (l->prev)
+      links_at(l->prev)->next = l->next;
+    else
+      h.bins[k] = l->next;
+    if (l->next)
+      links_at(l->next)->prev = l->prev;
+    if (!h.bins[k])
+      h.nonempty &= ~(std::uint64_t(1) << k);
+    block_at(off)->size &= ~std::uint64_t(1);
+  }
+
+  //! \brief Find a free block of at least need bytes, 0 if none
+  std::uint64_t find_free(std::uint64_t need) const {
+    const Header &h = header();
+    int k = bin_of(need);
+    // The blocks of the same class may be too small: look at a few of them
+    int tries = 0;
+    for (std::uint64_t off = h.bins[k]; off && tries != 8; off = links_at(off)->next, ++tries)
+      if (size_at(off) >= need)
+        return off;
+    // Any block of a larger class is large enough
+    std::uint64_t larger = k + 1 < 64 ? h.nonempty & (~std::uint64_t(0) << (k + 1)) : 0;
+    return larger ? h.bins[__builtin_ctzll(larger)] : 0;
+  }
+
+  //! \brief Take a block from the free lists or from the top
+  void *allocate_block(std::size_t bytes, std::size_t alignment) {
+    if (alignment > align || bytes > static_cast<std::size_t>(reserved))
+      throw std::bad_alloc();
+    std::uint64_t need = (bytes + align - 1) / align * align + sizeof(Block);
+    if (need < min_block)
+      need = min_block;
+    std::lock_guard<std::mutex> lock(m);
+    Header &h = header();
+    if (std::uint64_t off = find_free(need)) {
+      unlink_free(off);
+      std::uint64_t size = size_at(off);
+      if (size - need >= min_block) {
+        // Split: the rest goes back to the free lists
+        std::uint64_t rest = off + need;
+        block_at(rest)->size = 0;
+        set_size(rest, size - need);
+        set_size(off, need);
+        push_free(rest);
+      }
+      return block_at(off) + 1;
+    }
+    if (need > h.reserved - h.top)
+      throw std::bad_alloc();
+    grow(h.top + need);
+    std::uint64_t off = h.top;
+    block_at(off)->size = need;
+    block_at(off)->prev_size = h.last;
+    h.top += need;
+    h.last = need;
+    return block_at(off) + 1;
+  }
+
+  //! \brief Give back a block, merging it with the free blocks around it
+  void deallocate_block(void *p, std::size_t, std::size_t) {
+    if (!p)
+      return;
+    std::lock_guard<std::mutex> lock(m);
+    Header &h = header();
+    std::uint64_t off = reinterpret_cast<char*>(static_cast<Block*>(p) - 1) - base;
+    std::uint64_t size = size_at(off);
+    if (off + size < h.top && is_free(off + size)) {
+      unlink_free(off + size);
+      size += size_at(off + size);
+    }
+    if (std::uint64_t before = block_at(off)->prev_size) {
+      if (is_free(off - before)) {
+        unlink_free(off - before);
+        off -= before;
+        size += before;
+      }
+    }
+    if (off + size == h.top) {
+      h.top = off;
+      h.last = block_at(off)->prev_size;
+      return;
+    }
+    set_size(off, size);
+    push_free(off);
+  }
+};
+
+/*! \brief An allocator taking memory from a BinMemoryResource
+ *
+ * It stores only the base address of its heap, which doesn't change
+ * across runs, so the containers allocated in a heap can be used again
+ * when the heap is opened in another run, and the memory is always
+ * given back to the heap it was taken from, whichever heap is current.
+ * An allocator constructed by default is bound to the current heap (see
+ * BinMemoryResource::current()), so the containers constructed while a
+ * heap is current, or by BinMemoryResource::find_or_construct(), live in
+ * that heap. For example:
+ * \code
+ * using Map = std::map<int, double, std::less<int>, BinAllocator<std::pair<const int, double>>>;
+ * BinMemoryResource heap("table.heap");
+ * Map &m = heap.find_or_construct<Map>();
+ * \endcode
+ * \tparam T The type of the values allocated
+ */
+template <typename T>
+class BinAllocator {
+ public:
+  using value_type = T;
+
+  /*! \brief The constructor binding the allocator to the current heap */
+  BinAllocator() {
+    BinMemoryResource *r = BinMemoryResource::current();
+    if (!r)
+      throw std::domain_error("There isn't any BinMemoryResource!");
+    heap = r->base_address();
+  }
+
+  /*! \brief The constructor binding the allocator to a heap
+   *
+   * \param r The heap
+   */
+  BinAllocator(const BinMemoryResource &r) : heap(r.base_address()) { }
+
+  template <typename U> BinAllocator(const BinAllocator<U> &o) : heap(o.base_address()) { }
+
+  /*! \brief Allocate memory for n values
+   *
+   * \param n The number of values
+   * \return It returns the memory
+   */
+  T *allocate(std::size_t n) {
+    return static_cast<T*>(resource()->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  /*! \brief Give back the memory of n values
+   *
+   * \param p The memory
+   * \param n The number of values
+   */
+  void deallocate(T *p, std::size_t n) {
+    resource()->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  /*! \brief Get the base address of the heap the allocator is bound to */
+  std::uintptr_t base_address() const { return heap; }
+
+  template <typename U> bool operator==(const BinAllocator<U> &o) const { return heap == o.base_address(); }
+  template <typename U> bool operator!=(const BinAllocator<U> &o) const { return heap != o.base_address(); }
+
+ private:
+  std::uintptr_t heap;  //!< \brief The base address of the heap
+
+  //! \brief Get the heap, which must be open
+  BinMemoryResource *resource() const {
+    BinMemoryResource *r = BinMemoryResource::find(heap);
+    if (!r)
+      throw std::domain_error("The heap of the allocator isn't open!");
+    return r;
+  }
+};
+
+#endif // BINPMR_H
@@ -0,0 +1,263 @@
+#ifndef BINSCHEDULER_H
+#define BINSCHEDULER_H
+
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "readwritebin.h"
+
+/*! \brief It schedules the I/O on a Bin according to priority classes
+ *
+ * A single worker thread performs all the operations submitted, so
+ * while the scheduler is running the Bin must be used only through it.
+ * Foreground operations always run before the queued background ones,
+ * and background writes are split in chunks: a foreground read waits
+ * at most for the chunk being written, not for the whole export.
+ * If the Bin has a RateLimiter, the background chunks are paced by it:
+ * the worker never sleeps on the limiter, it delays the dispatch of the
+ * next background chunk and keeps serving foreground operations meanwhile.
+ */
+class BinScheduler {
+ public:
+  //! The type used to indicate positions inside the file
+  using size_type = Bin::size_type;
+
+  /*! \brief The priority classes
+   *
+   * foreground: Latency-critical operations\n
+   * background: Flushes, exports, compaction, prefetch...
+   */
+  enum class Priority { foreground, background };
+
+  /*! \brief The constructor
+   *
+   * \param b The Bin instance
+   * \param chunk_bytes The size of the chunks background writes are split in. The default value is 1 MiB
+   */
+  explicit BinScheduler(Bin &b, size_type chunk_bytes = 1 << 20) : bin(b), chunk(chunk_bytes) {
+    if (chunk <= 0)
+      throw std::domain_error("The chunk size must be positive!");
+    worker = std::thread(&BinScheduler::run, this);
+  }
+
+  BinScheduler(const BinScheduler &) = delete;
+  BinScheduler &operator=(const BinScheduler &) = delete;
+
+  /*! \brief The destructor
+   *
+   * The operations still queued are performed before returning.
+   */
+  ~BinScheduler() {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      stopping = true;
+    }
+    cv.notify_one();
+    worker.join();
+  }
+
+  /*! \brief Submit an operation on the Bin
+   *
+   * \param fn The operation
+   * \param pr The priority class. The default value is Priority::foreground
+   * \return It returns a future which tells when the operation is done
+   */
+  std::future<void> submit(std::function<void(Bin&)> fn, Priority pr = Priority::foreground) {
+    std::shared_ptr<std::promise<void>> done(new std::promise<void>);
+    std::future<void> ret = done->get_future();
+    enqueue(Task{[this, fn, done] {
+      try {
+        fn(bin);
+        done->set_value();
+      } catch (...) {
+        done->set_exception(std::current_exception());
+      }
+    }, 0, false, false}, pr);
+    return ret;
+  }
+
+  /*! \brief Read multiple values of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \param pr The priority class. The default value is Priority::foreground
+   * \return It returns a future holding the values in a std::vector<T>
+   */
+  template <typename T>
+  std::future<std::vector<T>> read(size_type n, size_type p, Priority pr = Priority::foreground) {
+    std::shared_ptr<std::promise<std::vector<T>>> done(new std::promise<std::vector<T>>);
+    std::future<std::vector<T>> ret = done->get_future();
+    enqueue(Task{[this, n, p, done] {
+      try {
+        done->set_value(bin.get_values<T>(n, p));
+      } catch (...) {
+        done->set_exception(std::current_exception());
+      }
+    }, 0, false, false}, pr);
+    return ret;
+  }
+
+  /*! \brief Write multiple values starting from the specified position
+   *
+   * In the background class the values are written in chunks, so
+   * that foreground operations can run between two chunks. Each chunk
+   * is written with a single call.
+   * \tparam T The type of the values
+   * \param vals The values
+   * \param p The position where you want to write
+   * \param pr The priority class. The default value is Priority::background
+   * \return It returns a future which tells when all the values are written
+   */
+  template <typename T>
+  std::future<void> write(std::vector<T> vals, size_type p, Priority pr = Priority::background) {
+    struct Job {
+      std::vector<T> vals;
+      std::promise<void> done;
+      std::size_t chunks_left;
+      bool failed = false;
+    };
+    std::shared_ptr<Job> job(new Job);
+    std::future<void> ret = job->done.get_future();
+    size_type chunk_bytes = bin.rate_limiter() ? std::min(chunk, bin.rate_limiter()->chunk_bytes()) : chunk;
+    std::size_t per_chunk = pr == Priority::background ?
+        std::max<std::size_t>(1, chunk_bytes / sizeof(T)) : std::max<std::size_t>(1, vals.size());
+    std::size_t n = vals.size();
+    job->vals = std::move(vals);
+    job->chunks_left = n == 0 ? 1 : (n + per_chunk - 1) / per_chunk;
+    std::lock_guard<std::mutex> lock(m);
+    std::size_t first = 0;
+    do {
+      std::size_t last = std::min(n, first + per_chunk);
+      queue(pr).push_back(Task{[this, job, first, last, p] {
+        if (!job->failed) {
+          try {
+            check_write(bin.try_write_many(job->vals.data() + first, last - first, p + Bin::bytes<T>(first)));
+          } catch (...) {
+            job->failed = true;
+            job->done.set_exception(std::current_exception());
+          }
+        }
+        if (--job->chunks_left == 0 && !job->failed)
+          job->done.set_value();
+      }, Bin::bytes<T>(last - first), pr == Priority::background, false});
+      first = last;
+    } while (first < n);
+    cv.notify_one();
+    return ret;
+  }
+
+  /*! \brief Flush the buffer of the Bin
+   *
+   * \param pr The priority class. The default value is Priority::background
+   * \return It returns a future which tells when the buffer is flushed
+   */
+  std::future<void> flush(Priority pr = Priority::background) {
+    std::shared_ptr<std::promise<void>> done(new std::promise<void>);
+    std::future<void> ret = done->get_future();
+    enqueue(Task{[this, done] {
+      try {
+        bin.flush();
+        done->set_value();
+      } catch (...) {
+        done->set_exception(std::current_exception());
+      }
+    }, 0, pr == Priority::background, false}, pr);
+    return ret;
+  }
+
+  /*! \brief Get the number of operations (or chunks) waiting in a priority class
+   *
+   * \param pr The priority class
+   */
+  std::size_t pending(Priority pr) {
+    std::lock_guard<std::mutex> lock(m);
+    return queue(pr).size();
+  }
+
+ private:
+  //! \brief An operation in a queue
+  struct Task {
+    std::function<void()> fn;  //!< \brief The operation
+    size_type bytes;  //!< \brief The bytes moved, charged to the limiter
+    bool paced;  //!< \brief Tells if the operation is paced by the limiter of the Bin
+    bool charged;  //!< \brief Tells if the tokens of the operation have been taken
+  };
+
+  using clock = std::chrono::steady_clock;
+
+  Bin &bin;  //!< \brief The Bin instance the operations are performed on
+  const size_type chunk;  //!< \brief The size of the chunks of background writes
+  std::deque<Task> fg;  //!< \brief The foreground queue
+  std::deque<Task> bg;  //!< \brief The background queue
+  std::mutex m;  //!< \brief Protects the queues
+  std::condition_variable cv;  //!< \brief Wakes up the worker
+  bool stopping = false;  //!< \brief Tells the worker to stop once the queues are empty
+  clock::time_point paced_after;  //!< \brief When the next paced operation can be dispatched
+  std::thread worker;  //!< \brief The worker thread
+
+  //! \brief Get the queue of a priority class
+  std::deque<Task> &queue(Priority pr) { return pr == Priority::foreground ? fg : bg; }
+
+  //! \brief Turn the outcome of a write into an exception
+  static void check_write(Bin::Status st) {
+    if (st == Bin::Status::closed)
+      throw std::domain_error("Can't write on closed file!");
+    if (st == Bin::Status::read_only)
+      throw std::domain_error("Can't write on read-only file!");
+    if (st != Bin::Status::ok)
+      throw std::runtime_error("Couldn't write file!");
+  }
+
+  //! \brief Add an operation to a queue and wake up the worker
+  void enqueue(Task task, Priority pr) {
+    {
+      std::lock_guard<std::mutex> lock(m);
+      queue(pr).push_back(std::move(task));
+    }
+    cv.notify_one();
+  }
+
+  /*! \brief The loop of the worker: foreground operations first
+   *
+   * When a paced operation reaches the front of its queue it takes its
+   * tokens, and it is dispatched once the limiter is out of debt. The
+   * worker waits for that time on the condition variable, so a
+   * foreground operation submitted meanwhile runs at once.
+   */
+  void run() {
+    for (;;) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(m);
+        for (;;) {
+          cv.wait(lock, [this] { return stopping || !fg.empty() || !bg.empty(); });
+          if (!fg.empty() || bg.empty() || !bg.front().paced || !bin.rate_limiter())
+            break;
+          if (!bg.front().charged) {
+            bg.front().charged = true;
+            double wait = bin.rate_limiter()->reserve(bg.front().bytes);
+            paced_after = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(wait));
+          }
+          if (clock::now() >= paced_after)
+            break;
+          cv.wait_until(lock, paced_after, [this] { return !fg.empty() || clock::now() >= paced_after; });
+        }
+        if (fg.empty() && bg.empty())
+          return;
+        std::deque<Task> &q = fg.empty() ? bg : fg;
+        task = std::move(q.front());
+        q.pop_front();
+      }
+      task.fn();
+    }
+  }
+};
+
+#endif // BINSCHEDULER_H
@@ -0,0 +1,564 @@
+#ifndef BINTEXT_H
+#define BINTEXT_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <exception>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <utility>
+#include <stdexcept>
+#include <type_traits>
+#include "readwritebin.h"
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#if defined(__cpp_lib_to_chars)
+#define BINTEXT_TO_CHARS
+#endif
+
+/*! \brief The numeric types of the columns of a text file
+ *
+ * i8, i16, i32, i64: Signed integers (std::int8_t ... std::int64_t)\n
+ * u8, u16, u32, u64: Unsigned integers (std::uint8_t ... std::uint64_t)\n
+ * f32, f64: float and double
+ */
+enum class NumType { i8, i16, i32, i64, u8, u16, u32, u64, f32, f64 };
+
+/*! \brief Get the size of a numeric type
+ *
+ * \param t The type
+ * \return It returns the number of bytes of a value of type t
+ */
+inline std::size_t num_type_size(NumType t) {
+  switch (t) {
+    case NumType::i8: case NumType::u8: return 1;
+    case NumType::i16: case NumType::u16: return 2;
+    case NumType::i32: case NumType::u32: case NumType::f32: return 4;
+    default: return 8;
+  }
+}
+
+/*! \brief Helpers of the text functions */
+namespace bin_text {
+
+//! \brief Tells if a character is a blank inside a line
+inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
+
+//! \brief Skip the blanks
+inline const char *skip_blanks(const char *p, const char *end) {
+  while (p != end && is_blank(*p))
+    ++p;
+  return p;
+}
+
+/*! \brief Parse an integer
+ *
+ * \param p The first character, moved after the number
+ * \param end The end of the line
+ * \param out The value
+ * \return It returns false if there isn't a number or it doesn't fit T
+ */
+template <typename T> bool parse_int(const char *&p, const char *end, T &out) {
+  bool neg = false;
+  if (p != end && (*p == '-' || *p == '+'))
+    neg = *p++ == '-';
+  if (neg && !std::is_signed<T>::value)
+    return false;
+  const char *start = p;
+  std::uint64_t v = 0;
+  for (; p != end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+    unsigned d = *p - '0';
+    if (v > (std::numeric_limits<std::uint64_t>::max() - d) / 10)
+      return false;
+    v = v * 10 + d;
+  }
+  if (p == start)
+    return false;
+  std::uint64_t limit = static_cast<std::uint64_t>(std::numeric_limits<T>::max()) + (neg ? 1 : 0);
+  if (v > limit)
+    return false;
+  // Negate in unsigned arithmetic, so that the minimum of T doesn't overflow
+  out = neg ? static_cast<T>(-static_cast<std::int64_t>(v - 1) - 1) : static_cast<T>(v);
+  return true;
+}
+
+/*! \brief Parse a floating point number
+ *
+ * Numbers with at most 19 significant digits whose value and power of
+ * ten are exact in T are computed with a single multiplication or
+ * division, which is correctly rounded (Clinger's fast path). The
+ * others (and inf, nan...) are converted with strtod or strtof.
+ * \param p The first character, moved after the number
+ * \param end The end of the field
+ * \param out The value
+ * \return It returns false if there isn't a number
+ */
+template <typename T> bool parse_float(const char *&p, const char *end, T &out) {
+  static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const bool is_float = sizeof(T) == sizeof(float);
+  const std::uint64_t max_exact = is_float ? std::uint64_t(1) << 24 : std::uint64_t(1) << 53;
+  const int max_pow = is_float ? 10 : 22;
+  const char *start = p, *q = p;
+  bool neg = false;
+  if (q != end && (*q == '-' || *q == '+'))
+    neg = *q++ == '-';
+  std::uint64_t m = 0;
+  int digits = 0, exp = 0;
+  bool any = false, exact = true;
+  for (; q != end && static_cast<unsigned>(*q - '0') < 10; ++q, any = true) {
+    if (digits < 19) {
+      m = m * 10 + (*q - '0');
+      digits += m != 0;
+    } else {
+      ++exp;
+      exact = exact && *q == '0';
+    }
+  }
+  if (q != end && *q == '.') {
+    for (++q; q != end && static_cast<unsigned>(*q - '0') < 10; ++q, any = true) {
+      if (digits < 19) {
+        m = m * 10 + (*q - '0');
+        digits += m != 0;
+        --exp;
+      } else {
+        exact = exact && *q == '0';
+      }
+    }
+  }
+  if (any && q != end && (*q == 'e' || *q == 'E')) {
+    const char *e = q + 1;
+    bool eneg = false;
+    if (e != end && (*e == '-' || *e == '+'))
+      eneg = *e++ == '-';
+    if (e != end && static_cast<unsigned>(*e - '0') < 10) {
+      int v = 0;
+      for (; e != end && static_cast<unsigned>(*e - '0') < 10; ++e)
+        v = std::min(v * 10 + (*e - '0'), 100000);
+      exp += eneg ? -v : v;
+      q = e;
+    }
+  }
+  if (any && exact && m <= max_exact && (m == 0 || (exp >= -max_pow && exp <= max_pow))) {
+    double d = static_cast<double>(m);
+    if (m != 0)
+      d = exp < 0 ? d / pow10[-exp] : d * pow10[exp];
+    out = static_cast<T>(neg ? -d : d);
+    p = q;
+    return true;
+  }
+  // The slow path, on a copy of the field which can be terminated
+  const char *field_end = start;
+  while (field_end != end && (std::isalnum(static_cast<unsigned char>(*field_end)) ||
+                              *field_end == '.' || *field_end == '+' || *field_end == '-'))
+    ++field_end;
+  std::string copy(start, field_end);
+  char *stop;
+  out = is_float ? static_cast<T>(std::strtof(copy.c_str(), &stop)) : static_cast<T>(std::strtod(copy.c_str(), &stop));
+  if (stop == copy.c_str())
+    return false;
+  p = start + (stop - copy.c_str());
+  return true;
+}
+
+//! \brief Parse a value of type T and append it to a column
+template <typename T, bool = std::is_floating_point<T>::value>
+struct Field {
+  static bool parse(const char *&p, const char *end, std::vector<char> &col) {
+    T v;
+    if (!parse_float(p, end, v))
+      return false;
+    const char *b = reinterpret_cast<const char*>(&v);
+    col.insert(col.end(), b, b + sizeof(T));
+    return true;
+  }
+};
+
+template <typename T>
+struct Field<T, false> {
+  static bool parse(const char *&p, const char *end, std::vector<char> &col) {
+    T v;
+    if (!parse_int(p, end, v))
+      return false;
+    const char *b = reinterpret_cast<const char*>(&v);
+    col.insert(col.end(), b, b + sizeof(T));
+    return true;
+  }
+};
+
+//! \brief Parse a value of a numeric type and append it to a column
+inline bool parse_field(NumType t, const char *&p, const char *end, std::vector<char> &col) {
+  switch (t) {
+    case NumType::i8: return Field<std::int8_t>::parse(p, end, col);
+    case NumType::i16: return Field<std::int16_t>::parse(p, end, col);
+    case NumType::i32: return Field<std::int32_t>::parse(p, end, col);
+    case NumType::i64: return Field<std::int64_t>::parse(p, end, col);
+    case NumType::u8: return Field<std::uint8_t>::parse(p, end, col);
+    case NumType::u16: return Field<std::uint16_t>::parse(p, end, col);
+    case NumType::u32: return Field<std::uint32_t>::parse(p, end, col);
+    case NumType::u64: return Field<std::uint64_t>::parse(p, end, col);
+    case NumType::f32: return Field<float>::parse(p, end, col);
+    default: return Field<double>::parse(p, end, col);
+  }
+}
+
+//! \brief Write the values of a column, stored in memory, with a single write
+template <typename T> void write_column(Bin &b, const std::vector<char> &col) {
+  if (b.try_write_many(reinterpret_cast<const T*>(col.data()), col.size() / sizeof(T)) != Bin::Status::ok)
+    throw std::runtime_error("Couldn't write file!");
+}
+
+//! \brief Write the values of a column of a numeric type
+inline void write_column(NumType t, Bin &b, const std::vector<char> &col) {
+  switch (t) {
+    case NumType::i8: write_column<std::int8_t>(b, col); break;
+    case NumType::i16: write_column<std::int16_t>(b, col); break;
+    case NumType::i32: write_column<std::int32_t>(b, col); break;
+    case NumType::i64: write_column<std::int64_t>(b, col); break;
+    case NumType::u8: write_column<std::uint8_t>(b, col); break;
+    case NumType::u16: write_column<std::uint16_t>(b, col); break;
+    case NumType::u32: write_column<std::uint32_t>(b, col); break;
+    case NumType::u64: write_column<std::uint64_t>(b, col); break;
+    case NumType::f32: write_column<float>(b, col); break;
+    default: write_column<double>(b, col); break;
+  }
+}
+
+/*! \brief Parse the lines of a part of a text file
+ *
+ * \param text The beginning of the file, used for the error messages
+ * \param first,last The part, made of whole lines
+ * \param types The types of the columns
+ * \param delimiter The delimiter of the fields, or ' ' for blanks
+ * \param cols The columns where the values are appended
+ * \return It returns the number of rows parsed
+ */
+inline std::size_t parse_lines(const char *text, const char *first, const char *last, const std::vector<NumType> &types,
+                               char delimiter, std::vector<std::vector<char>> &cols) {
+  std::size_t rows = 0;
+  auto fail = [&](const char *p) {
+    throw std::runtime_error("Malformed line at byte " + std::to_string(p - text) + "!");
+  };
+  while (first != last) {
+    const char *nl = static_cast<const char*>(std::memchr(first, '\n', last - first));
+    const char *end = nl ? nl : last;
+    const char *next = nl ? nl + 1 : last;
+    if (end != first && end[-1] == '\r')
+      --end;
+    const char *p = skip_blanks(first, end);
+    if (p == end) {
+      first = next;
+      continue;
+    }
+    for (std::size_t c = 0; c != types.size(); ++c) {
+      if (c != 0) {
+        if (delimiter == ' ') {
+          if (p == end || !is_blank(p[-1]))
+            fail(p);
+        } else {
+          if (p == end || *p != delimiter)
+            fail(p);
+          p = skip_blanks(p + 1, end);
+        }
+      }
+      if (!parse_field(types[c], p, end, cols[c]))
+        fail(p);
+      p = skip_blanks(p, end);
+    }
+    if (p != end)
+      fail(p);
+    ++rows;
+    first = next;
+  }
+  return rows;
+}
+
+//! \brief Append an integer to a text
+template <typename T> void format_int(T v, std::string &out) {
+#ifdef BINTEXT_TO_CHARS
+  char tmp[24];
+  out.append(tmp, std::to_chars(tmp, tmp + sizeof(tmp), v).ptr);
+#else
+  char tmp[24];
+  char *last = tmp + sizeof(tmp), *p = last;
+  bool neg = std::is_signed<T>::value && v < T(0);
+  std::uint64_t u = neg ? 0 - static_cast<std::uint64_t>(v) : static_cast<std::uint64_t>(v);
+  do {
+    *--p = static_cast<char>('0' + u % 10);
+    u /= 10;
+  } while (u != 0);
+  if (neg)
+    *--p = '-';
+  out.append(p, last);
+#endif
+}
+
+//! \brief Append a floating point number to a text, with the digits needed to read it back exactly
+template <typename T> void format_float(T v, std::string &out) {
+  char tmp[32];
+#ifdef BINTEXT_TO_CHARS
+  out.append(tmp, std::to_chars(tmp, tmp + sizeof(tmp), v).ptr);
+#else
+  int n = std::snprintf(tmp, sizeof(tmp), sizeof(T) == sizeof(float) ? "%.9g" : "%.17g", static_cast<double>(v));
+  out.append(tmp, n);
+#endif
+}
+
+template <typename T> void format_number(T v, std::string &out, std::true_type) { format_float(v, out); }
+template <typename T> void format_number(T v, std::string &out, std::false_type) { format_int(v, out); }
+
+//! \brief Append a value of type T, stored at p, to a text
+template <typename T> void format_value(const char *p, std::string &out) {
+  T v;
+  std::memcpy(&v, p, sizeof(T));
+  format_number(v, out, std::is_floating_point<T>());
+}
+
+//! \brief Append a value of a numeric type, stored at p, to a text
+inline void format_field(NumType t, const char *p, std::string &out) {
+  switch (t) {
+    case NumType::i8: format_value<std::int8_t>(p, out); break;
+    case NumType::i16: format_value<std::int16_t>(p, out); break;
+    case NumType::i32: format_value<std::int32_t>(p, out); break;
+    case NumType::i64: format_value<std::int64_t>(p, out); break;
+    case NumType::u8: format_value<std::uint8_t>(p, out); break;
+    case NumType::u16: format_value<std::uint16_t>(p, out); break;
+    case NumType::u32: format_value<std::uint32_t>(p, out); break;
+    case NumType::u64: format_value<std::uint64_t>(p, out); break;
+    case NumType::f32: format_value<float>(p, out); break;
+    default: format_value<double>(p, out); break;
+  }
+}
+
+//! \brief A file holding some of the fields of the rows, in records of fixed size
+struct RowSource {
+  Bin *bin;  //!< \brief The file
+  Bin::size_type first;  //!< \brief The position of the first record
+  std::size_t record;  //!< \brief The size of a record
+  std::vector<std::pair<NumType, std::size_t>> fields;  //!< \brief The type and the offset of each field
+};
+
+/*! \brief Write rows as text, the fields of each row taken from the sources in order
+ *
+ * \param sources The sources
+ * \param rows The number of rows
+ * \param out The file where the text is written, from its current position
+ * \param delimiter The delimiter of the fields
+ * \param threads The number of threads, 0 for the number of cores
+ */
+inline void export_rows(const std::vector<RowSource> &sources, std::size_t rows, Bin &out, char delimiter, unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  std::size_t row_bytes = 0;
+  for (const auto &s : sources)
+    row_bytes += s.record;
+  const std::size_t per_thread = std::max<std::size_t>(1, (1 << 20) / std::max<std::size_t>(1, row_bytes));
+  std::vector<std::string> texts(threads);
+  std::vector<std::vector<std::vector<char>>> raw(threads, std::vector<std::vector<char>>(sources.size()));
+  for (std::size_t r0 = 0; r0 < rows; r0 += per_thread * threads) {
+    std::vector<std::exception_ptr> errors(threads);
+    auto worker = [&](unsigned t) {
+      try {
+        std::size_t first = std::min(rows, r0 + t * per_thread), last = std::min(rows, first + per_thread);
+        std::string &text = texts[t];
+        text.clear();
+        for (std::size_t s = 0; s != sources.size(); ++s) {
+          const RowSource &src = sources[s];
+          std::vector<char> &bytes = raw[t][s];
+          bytes.resize((last - first) * src.record);
+          if (!bytes.empty() && src.bin->try_get_values_at(bytes.data(), bytes.size(), src.first + first * src.record) != Bin::Status::ok)
+            throw std::runtime_error("Trying to read past EOF!");
+          if (src.bin->is_little_endian() != Bin::is_default_little_endian())
+            for (std::size_t r = 0; r != last - first; ++r)
+              for (const auto &f : src.fields)
+                std::reverse(&bytes[r * src.record + f.second], &bytes[r * src.record + f.second + num_type_size(f.first)]);
+        }
+        for (std::size_t r = 0; r != last - first; ++r) {
+          bool lead = true;
+          for (std::size_t s = 0; s != sources.size(); ++s) {
+            const char *rec = raw[t][s].data() + r * sources[s].record;
+            for (const auto &f : sources[s].fields) {
+              if (!lead)
+                text.push_back(delimiter);
+              lead = false;
+              format_field(f.first, rec + f.second, text);
+            }
+          }
+          text.push_back('\n');
+        }
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &t : pool)
+      t.join();
+    for (unsigned t = 0; t != threads; ++t) {
+      if (errors[t])
+        std::rethrow_exception(errors[t]);
+      if (!texts[t].empty() && out.try_write_many(texts[t].data(), texts[t].size()) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+    }
+  }
+}
+
+}  // namespace bin_text
+
+/*! \brief Convert a text file of numbers to typed columns
+ *
+ * The file is mapped and processed in rounds of 16 MiB per thread: each
+ * round is split between the threads at line boundaries (found with
+ * memchr, which uses the SIMD instructions of the machine), the threads
+ * parse their lines with hand-written integer and float parsers, and
+ * then each column is written with a single write per thread, in order.
+ * Empty lines are skipped. Blanks around the fields are allowed.
+ * \param fname The text file
+ * \param types The types of the columns
+ * \param columns
+ * \parblock
+ * The files where the columns are written, from their current
+ * position. They can be nullptr to skip a column
+ * \endparblock
+ * \param delimiter The delimiter of the fields, or ' ' if they are separated by blanks. The default value is ','
+ * \param skip_lines The number of lines to skip at the beginning, like a header. The default value is 0
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ * \return It returns the number of rows converted
+ */
+inline std::size_t ingest_text(const std::string &fname, const std::vector<NumType> &types,
+                               const std::vector<Bin*> &columns, char delimiter = ',',
+                               std::size_t skip_lines = 0, unsigned threads = 0) {
+  if (types.empty() || types.size() != columns.size())
+    throw std::domain_error("There must be a file for each column!");
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  Bin src(fname, Bin::Mode::read_only);
+  const char *text = src.data();
+  const char *end = text + src.size();
+  const char *p = text;
+  for (; skip_lines != 0 && p != end; --skip_lines) {
+    const char *nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    p = nl ? nl + 1 : end;
+  }
+
+  // After the end of the line holding q
+  auto line_end = [end](const char *q) {
+    if (q >= end)
+      return end;
+    const char *nl = static_cast<const char*>(std::memchr(q, '\n', end - q));
+    return nl ? nl + 1 : end;
+  };
+
+  const std::size_t per_thread = 1 << 24;
+  std::size_t rows = 0;
+  std::vector<std::vector<std::vector<char>>> cols(threads, std::vector<std::vector<char>>(types.size()));
+  std::vector<std::size_t> parsed(threads);
+  while (p != end) {
+    std::vector<const char*> cuts(1, p);
+    for (unsigned t = 1; t <= threads; ++t)
+      cuts.push_back(line_end(cuts.back() + std::min<std::size_t>(per_thread, end - cuts.back())));
+    std::vector<std::exception_ptr> errors(threads);
+    auto worker = [&](unsigned t) {
+      try {
+        for (auto &c : cols[t])
+          c.clear();
+        parsed[t] = bin_text::parse_lines(text, cuts[t], cuts[t + 1], types, delimiter, cols[t]);
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &t : pool)
+      t.join();
+    for (unsigned t = 0; t != threads; ++t) {
+      if (errors[t])
+        std::rethrow_exception(errors[t]);
+      for (std::size_t c = 0; c != types.size(); ++c)
+        if (columns[c])
+          bin_text::write_column(types[c], *columns[c], cols[t][c]);
+      rows += parsed[t];
+    }
+    p = cuts.back();
+  }
+  return rows;
+}
+
+/*! \brief Convert records of fixed layout to text, a line per record
+ *
+ * The records are read and formatted in parallel, in rounds of 1 MiB of
+ * records per thread: each thread formats its records in its own buffer
+ * (with std::to_chars if available, otherwise with a hand-written integer
+ * formatter and snprintf), and the buffers are written in order.
+ * The floating point numbers are written with the digits needed to read
+ * them back exactly.
+ * \param src The file holding the records
+ * \param layout The types of the fields of a record, which are packed
+ * \param out The file where the text is written, from its current position
+ * \param delimiter The delimiter of the fields. The default value is ','
+ * \param first The position of the first record. The default value is 0
+ * \param rows
+ * \parblock
+ * The number of records. By default, all the records from first
+ * to the end of the file
+ * \endparblock
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ * \return It returns the number of records converted
+ */
+inline std::size_t export_text(Bin &src, const std::vector<NumType> &layout, Bin &out, char delimiter = ',',
+                               Bin::size_type first = 0, std::size_t rows = std::size_t(-1), unsigned threads = 0) {
+  if (layout.empty())
+    throw std::domain_error("The layout must have at least a field!");
+  bin_text::RowSource s{&src, first, 0, {}};
+  for (NumType t : layout) {
+    s.fields.emplace_back(t, s.record);
+    s.record += num_type_size(t);
+  }
+  std::size_t available = first < src.size() ? (src.size() - first) / s.record : 0;
+  if (rows == std::size_t(-1))
+    rows = available;
+  if (rows > available)
+    throw std::runtime_error("Trying to read past EOF!");
+  bin_text::export_rows({s}, rows, out, delimiter, threads);
+  return rows;
+}
+
+/*! \brief Convert typed columns to text, a line per row
+ *
+ * It is the inverse of ingest_text(). See export_text() for the details.
+ * \param types The types of the columns
+ * \param columns The files holding the columns, from their beginning
+ * \param out The file where the text is written, from its current position
+ * \param delimiter The delimiter of the fields. The default value is ','
+ * \param threads The number of threads. If 0 (the default) it is the number of cores
+ * \return It returns the number of rows converted, which is the length of the shortest column
+ */
+inline std::size_t export_columns(const std::vector<NumType> &types, const std::vector<Bin*> &columns, Bin &out,
+                                  char delimiter = ',', unsigned threads = 0) {
+  if (types.empty() || types.size() != columns.size())
+    throw std::domain_error("There must be a file for each column!");
+  std::vector<bin_text::RowSource> sources;
+  std::size_t rows = std::size_t(-1);
+  for (std::size_t c = 0; c != types.size(); ++c) {
+    std::size_t size = num_type_size(types[c]);
+    sources.push_back(bin_text::RowSource{columns[c], 0, size, {std::make_pair(types[c], std::size_t(0))}});
+    rows = std::min<std::size_t>(rows, columns[c]->size() / size);
+  }
+  bin_text::export_rows(sources, rows, out, delimiter, threads);
+  return rows;
+}
+
+#endif // BINTEXT_H
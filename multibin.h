@@ -0,0 +1,281 @@
+#ifndef MULTIBIN_H
+#define MULTIBIN_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <iterator>
+#include <sys/stat.h>
+#include "readwritebin.h"
+
+template <typename T> class MultiBinIt;
+
+/*! \brief It presents an ordered list of files as a single file for read operations
+ *
+ * The files (segments) are concatenated in a single address space.
+ * The segment holding a position is found with a binary search over
+ * the offsets of the segments, and the reads crossing the end of a
+ * segment are split between the segments involved.
+ */
+class MultiBin {
+ public:
+  //! The type used to indicate positions inside the files
+  using size_type = Bin::size_type;
+
+  /*! \brief The constructor
+   *
+   * \param fnames The filenames, in order
+   * \param mode The mode used to open every segment. The default value is Bin::Mode::read_only
+   * \param use_little_endian
+   * \parblock
+   * Decide if you want to read in little_endian.
+   * By default it is set to the default endianness of the machine.
+   * \endparblock
+   */
+  explicit MultiBin(const std::vector<std::string> &fnames, Bin::Mode mode = Bin::Mode::read_only,
+                    bool use_little_endian = Bin::is_default_little_endian()) :
+      open_mode(mode), opposite_endian(use_little_endian != Bin::is_default_little_endian()) {
+    for (const auto &f : fnames)
+      segs.emplace_back(new Bin(f, open_mode));
+    refresh();
+  }
+
+  /*! \brief Add a segment at the end
+   *
+   * \param fname The filename
+   */
+  void append_segment(const std::string &fname) {
+    segs.emplace_back(new Bin(fname, open_mode));
+    refresh();
+  }
+
+  /*! \brief Compute again the offsets of the segments
+   *
+   * It must be called if a segment changed its size. A read-only segment
+   * is a mapping with the size the file had when it was opened, so the
+   * segments whose size on disk changed are opened again (dropping any
+   * layer enabled on them).
+   */
+  void refresh() {
+    offsets.assign(1, 0);
+    for (auto &s : segs) {
+      struct stat st;
+      if (open_mode == Bin::Mode::read_only && ::stat(s->get_filename().c_str(), &st) == 0 && st.st_size != s->size())
+        s.reset(new Bin(s->get_filename(), open_mode));
+      offsets.push_back(offsets.back() + s->size());
+    }
+  }
+
+  /*! \brief Get the number of segments */
+  std::size_t segments() const { return segs.size(); }
+
+  /*! \brief Get a segment
+   *
+   * \param i The index of the segment
+   * \return It returns the Bin handling the segment
+   */
+  Bin &segment(std::size_t i) { return *segs.at(i); }
+
+  /*! \brief Get the position where a segment begins
+   *
+   * \param i The index of the segment
+   * \return It returns the position of the first byte of the segment
+   */
+  size_type segment_offset(std::size_t i) const { return offsets.at(i); }
+
+  /*! \brief Get the total size of the segments */
+  size_type size() const { return offsets.back(); }
+
+  /*! \brief Get the position you are currently on */
+  size_type rpos() const { return cur; }
+
+  /*! \brief Jump to a location to read
+   *
+   * \param point The point (in bytes) where you want to jump
+   */
+  void rjump_to(size_type point) {
+    if (point < 0 || point > size())
+      throw std::domain_error("Can't jump and read past EOF!");
+    cur = point;
+  }
+
+  /*! \brief Move by a certain number of steps, forward or backward.
+   *
+   * The size of the step is deduced by the type specified
+   * \tparam T The type used to determine the size of a step
+   * \param n_steps The number of steps
+   */
+  template <typename T = char>
+  void rmove_by(std::streamoff n_steps) { rjump_to(cur + Bin::bytes<T>(n_steps)); }
+
+  /*! \brief Read a single value of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \return It returns the value read of type T
+   */
+  template <typename T = unsigned char> T get_value() {
+    T ret;
+    read_into(&ret, 1);
+    return ret;
+  }
+
+  /*! \brief Read a single value of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param p The position from where you want to read
+   * \return It returns the value read of type T
+   */
+  template <typename T = unsigned char> T get_value(size_type p) {
+    rjump_to(p);
+    return get_value<T>();
+  }
+
+  /*! \brief Read multiple values of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n) {
+    std::vector<T> ret(n);
+    read_into(ret.data(), n);
+    return ret;
+  }
+
+  /*! \brief Read multiple values of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n, size_type p) {
+    rjump_to(p);
+    return get_values<T>(n);
+  }
+
+  template <typename T> MultiBinIt<T> begin();
+  template <typename T> MultiBinIt<T> end();
+
+ private:
+  std::vector<std::unique_ptr<Bin>> segs;  //!< \brief The segments
+  std::vector<size_type> offsets;  //!< \brief The position where each segment begins, plus the total size
+  const Bin::Mode open_mode;  //!< \brief The mode used to open the segments
+  const bool opposite_endian;  /*!< \brief Tells if the endianness you want to read
+                                *          is the opposite of the default one of the machine
+                                */
+  size_type cur = 0;  //!< \brief The current position
+
+  /*! \brief Read values from the current position, splitting the read at the segment boundaries
+   *
+   * \param dst The destination
+   * \param n The number of values
+   */
+  template <typename T> void read_into(T *dst, size_type n) {
+    size_type len = Bin::bytes<T>(n);
+    if (size() - cur < len)
+      throw std::runtime_error("Trying to read past EOF!");
+    char *out = reinterpret_cast<char*>(dst);
+    std::size_t s = std::upper_bound(offsets.begin(), offsets.end(), cur) - offsets.begin() - 1;
+    for (size_type done = 0; done < len; ++s) {
+      size_type local = cur + done - offsets[s];
+      size_type k = std::min(len - done, offsets[s + 1] - offsets[s] - local);
+      if (k == 0)
+        continue;
+      if (segs[s]->try_get_values_into(out + done, k, local) != Bin::Status::ok)
+        throw std::runtime_error("Couldn't read segment " + segs[s]->get_filename() + "!");
+      done += k;
+    }
+    cur += len;
+    // Floating point values are reversed too, as Bin does
+    if (opposite_endian && sizeof(T) > 1)
+      for (size_type i = 0; i != n; ++i)
+        std::reverse(out + Bin::bytes<T>(i), out + Bin::bytes<T>(i + 1));
+  }
+};
+
+/*! \brief A read-only iterator over the values of a MultiBin
+ *
+ * Like BinPtr, it reads the file at every dereference, so
+ * it is meant for convenience rather than for speed.
+ * \tparam T The type handled by the iterator
+ */
+template <typename T>
+class MultiBinIt {
+ public:
+  using difference_type = std::ptrdiff_t;
+  using value_type = T;
+  using reference = T;
+  using pointer = void;
+  using iterator_category = std::random_access_iterator_tag;
+
+  /*! \brief Default constructor */
+  MultiBinIt() = default;
+
+  /*! \brief The main constructor
+   *
+   * \param m The MultiBin instance
+   * \param p The position where to point
+   */
+  MultiBinIt(MultiBin &m, MultiBin::size_type p) : mb(&m), curr(p) { }
+
+  /*! \brief The dereference operator
+   *
+   * \return It returns the value pointed
+   */
+  T operator*() const { return mb->get_value<T>(curr); }
+
+  /*! \brief Random access iterator bahaviour
+   *
+   * \param n The number of steps
+   * \return It returns the value n steps forward
+   */
+  T operator[](difference_type n) const { return *(*this + n); }
+
+  MultiBinIt &operator++() { curr += sizeof(T); return *this; }
+  MultiBinIt &operator--() { curr -= sizeof(T); return *this; }
+  MultiBinIt operator++(int) { MultiBinIt ret = *this; ++*this; return ret; }
+  MultiBinIt operator--(int) { MultiBinIt ret = *this; --*this; return ret; }
+  MultiBinIt &operator+=(difference_type n) { curr += Bin::bytes<T>(n); return *this; }
+  MultiBinIt &operator-=(difference_type n) { curr -= Bin::bytes<T>(n); return *this; }
+  MultiBinIt operator+(difference_type n) const { MultiBinIt ret = *this; return ret += n; }
+  MultiBinIt operator-(difference_type n) const { MultiBinIt ret = *this; return ret -= n; }
+
+  /*! \brief Difference between two iterators
+   *
+   * \param b The right-hand side iterator
+   * \return It returns the distance between the two iterators
+   */
+  difference_type operator-(const MultiBinIt &b) const { return (curr - b.curr) / static_cast<difference_type>(sizeof(T)); }
+
+  bool operator==(const MultiBinIt &b) const { return mb == b.mb && curr == b.curr; }
+  bool operator!=(const MultiBinIt &b) const { return !(*this == b); }
+  bool operator<(const MultiBinIt &b) const { return curr < b.curr; }
+  bool operator>(const MultiBinIt &b) const { return b < *this; }
+  bool operator<=(const MultiBinIt &b) const { return !(b < *this); }
+  bool operator>=(const MultiBinIt &b) const { return !(*this < b); }
+
+ private:
+  MultiBin *mb = nullptr;  //!< \brief The MultiBin instance which the iterator belongs to
+  MultiBin::size_type curr = 0;  //!< \brief The current position of the iterator
+};
+
+/*! \brief Return the begin iterator
+ *
+ * \tparam T The type that will be handled by the iterator
+ * \return It returns the begin iterator
+ */
+template <typename T>
+MultiBinIt<T> MultiBin::begin() { return MultiBinIt<T>(*this, 0); }
+
+/*! \brief Return the end iterator
+ *
+ * \tparam T The type that will be handled by the iterator
+ * \return It returns the end iterator
+ */
+template <typename T>
+MultiBinIt<T> MultiBin::end() { return MultiBinIt<T>(*this, size()); }
+
+#endif // MULTIBIN_H
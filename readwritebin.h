@@ -10,9 +10,31 @@
 #include <utility>
 #include <initializer_list>
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// AES-NI and the CRC32 instruction are chosen at run time, so the intrinsics are compiled for their own target
+#define READWRITEBIN_AESNI
+#define READWRITEBIN_SSE42
+#include <wmmintrin.h>
+#include <nmmintrin.h>
+#endif
 #include <iterator>
+#include <cstring>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <type_traits>
+#include <random>
 
 // *******************************************
 // *                                         *
@@ -22,577 +44,3459 @@
 
 template <typename T> class BinPtr;
 template <typename T> class TypeBin;
+class BinWindow;
 
-/*! \brief It handles a binary file for read/write operations
+//! \brief Map any list of types to void, to detect members in a template specialization
+template <typename...> struct bin_void { typedef void type; };
+
+/*! \brief Tells if a type looks like an allocator
+ *
+ * It is true when A has a value_type and an allocate(n) member, so that
+ * positions (like std::streampos) never pick the allocator overloads.
  */
-class Bin {
-  template <typename T> friend class BinPtr;
-  template <typename T> friend class TypePtr;
-  template <typename T> using iterator = BinPtr<T>;
+template <typename A, typename = void> struct is_bin_allocator : std::false_type { };
+
+template <typename A>
+struct is_bin_allocator<A, typename bin_void<typename A::value_type,
+                                             decltype(std::declval<A&>().allocate(std::size_t(1)))>::type> : std::true_type { };
+
+/*! \brief Write the content of a file to the disk
+ *
+ * \param fname The filename
+ * \return It returns true on success
+ */
+inline bool fsync_file(const std::string &fname) {
+  int fd = ::open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = ::fsync(fd) == 0;
+  return ::close(fd) == 0 && ok;
+}
+
+/*! \brief Write the directory holding a file to the disk
+ *
+ * It makes durable the creation, the removal or the renaming of the
+ * file, which the sync of the file itself doesn't.
+ * \param fname The filename
+ * \return It returns true on success
+ */
+inline bool fsync_parent_dir(const std::string &fname) {
+  std::string::size_type slash = fname.find_last_of('/');
+  std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : fname.substr(0, slash);
+  int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  bool ok = ::fsync(fd) == 0;
+  return ::close(fd) == 0 && ok;
+}
+
+/*! \brief A read-only stream buffer over a shared mapping of a file
+ *
+ * The file is mapped with PROT_READ and MAP_SHARED, so all the
+ * processes reading the same file share the same pages and
+ * reading a value is a plain memory copy.
+ */
+class MappedBuf : public std::streambuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param fname The filename. The file must exist, it is never created
+   */
+  explicit MappedBuf(const std::string &fname) {
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::domain_error("Couldn't open file!");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::domain_error("Couldn't open file!");
+    }
+    len = st.st_size;
+    if (len > 0) {
+      void *p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::domain_error("Couldn't map file!");
+      }
+      base = static_cast<char*>(p);
+    }
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    setg(base, base, base + len);
+  }
+
+  MappedBuf(const MappedBuf &) = delete;
+  MappedBuf &operator=(const MappedBuf &) = delete;
+
+  ~MappedBuf() {
+    if (base)
+      munmap(base, len);
+  }
+
+  /*! \brief Get the beginning of the mapping */
+  const char *data() const { return base; }
+
+  /*! \brief Get the size of the mapping */
+  std::streamsize size() const { return len; }
+
+ protected:
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    if (dir == std::ios_base::cur)
+      off += gptr() - eback();
+    else if (dir == std::ios_base::end)
+      off += len;
+    return seekpos(off, which);
+  }
+
+  pos_type seekpos(pos_type p, std::ios_base::openmode) override {
+    if (p < 0 || off_type(p) > len)
+      return pos_type(off_type(-1));
+    setg(base, base + off_type(p), base + len);
+    return p;
+  }
+
+ private:
+  char *base = nullptr;  //!< \brief The beginning of the mapping
+  off_type len = 0;  //!< \brief The size of the mapping
+};
+
+/*! \brief A stream buffer keeping the whole file in a growable memory buffer
+ *
+ * Like a file, it has a single position for reading and writing and
+ * writing past the end fills the gap with zeros.
+ */
+class MemoryBuf : public std::streambuf {
+ public:
+  MemoryBuf() = default;
+
+  /*! \brief Replace the content with the one of a file, in a single read
+   *
+   * \param fname The filename
+   */
+  void load(const std::string &fname) {
+    int fd = ::open(fname.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::domain_error("Couldn't open file!");
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::domain_error("Couldn't open file!");
+    }
+    mem.resize(st.st_size);
+    std::size_t done = 0;
+    while (done < mem.size()) {
+      ssize_t r = ::read(fd, mem.data() + done, mem.size() - done);
+      if (r <= 0) {
+        ::close(fd);
+        throw std::runtime_error("Couldn't read file!");
+      }
+      done += r;
+    }
+    ::close(fd);
+    pos = 0;
+  }
+
+  /*! \brief Write the whole content to a file, in a single write
+   *
+   * The content goes to fname + ".tmp", which is synced and renamed
+   * over fname, and the rename is synced too: after a crash the file
+   * holds either the old content or the new one.
+   * \param fname The filename. If the file already exists it is replaced
+   */
+  void save(const std::string &fname) const {
+    const std::string tmp = fname + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw std::domain_error("Couldn't open file!");
+    std::size_t done = 0;
+    while (done < mem.size()) {
+      ssize_t w = ::write(fd, mem.data() + done, mem.size() - done);
+      if (w <= 0) {
+        ::close(fd);
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Couldn't write file!");
+      }
+      done += w;
+    }
+    bool ok = fdatasync(fd) == 0;
+    if (::close(fd) != 0 || !ok || std::rename(tmp.c_str(), fname.c_str()) != 0) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("Couldn't write file!");
+    }
+    if (!fsync_parent_dir(fname))
+      throw std::runtime_error("Couldn't write file!");
+  }
+
+ protected:
+  std::streamsize xsgetn(char *s, std::streamsize n) override {
+    std::streamsize k = pos < end() ? std::min(n, end() - pos) : 0;
+    std::memcpy(s, mem.data() + pos, k);
+    pos += k;
+    return k;
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    if (pos + n > end())
+      mem.resize(pos + n);
+    std::memcpy(mem.data() + pos, s, n);
+    pos += n;
+    return n;
+  }
+
+  int_type underflow() override {
+    return pos < end() ? traits_type::to_int_type(mem[pos]) : traits_type::eof();
+  }
+
+  int_type uflow() override {
+    int_type c = underflow();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      ++pos;
+    return c;
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    char ch = traits_type::to_char_type(c);
+    xsputn(&ch, 1);
+    return c;
+  }
+
+  std::streamsize showmanyc() override { return pos < end() ? end() - pos : -1; }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    if (dir == std::ios_base::cur)
+      off += pos;
+    else if (dir == std::ios_base::end)
+      off += end();
+    return seekpos(off, which);
+  }
+
+  pos_type seekpos(pos_type p, std::ios_base::openmode) override {
+    if (p < 0)
+      return pos_type(off_type(-1));
+    pos = p;
+    return p;
+  }
+
+ private:
+  std::vector<char> mem;  //!< \brief The content of the file
+  std::streamsize pos = 0;  //!< \brief The current position
+
+  //! \brief The size of the content
+  std::streamsize end() const { return mem.size(); }
+};
+
+/*! \brief A stream buffer stacked on top of another one
+ *
+ * It keeps its own position and forwards every operation to the
+ * buffer below at an explicit position, so a layer can read or
+ * write around the requested range (whole blocks, side tables...)
+ * without side effects. Derived classes override read_at() and write_at().
+ */
+class LayerBuf : public std::streambuf {
+ public:
+  using size_type = std::streamsize;
+
+  LayerBuf() = default;
+  LayerBuf(const LayerBuf &) = delete;
+  LayerBuf &operator=(const LayerBuf &) = delete;
+
+  /*! \brief Stack the layer on top of a buffer
+   *
+   * \param below The buffer below, the layer takes its ownership
+   */
+  void attach(std::unique_ptr<std::streambuf> below) { inner = std::move(below); }
+
+  /*! \brief Give back the buffer below
+   *
+   * \return It returns the buffer below
+   */
+  std::unique_ptr<std::streambuf> detach() { return std::move(inner); }
+
+  /*! \brief Prepare the layer, once it is stacked on the buffer below
+   *
+   * If it throws, the layer is removed from the stack.
+   */
+  virtual void init() { }
+
+  /*! \brief Get and clear the reason of the last failure of a layer in this thread
+   *
+   * The streams swallow the exceptions thrown by their buffers, so a
+   * layer records why it failed before returning a short count.
+   * \return It returns the reason, or an empty string if there isn't any
+   */
+  static std::string take_failure() {
+    std::string ret;
+    ret.swap(failure());
+    return ret;
+  }
+
+ protected:
+  /*! \brief Record the reason of a failure, see take_failure()
+   *
+   * \param what The reason
+   */
+  static void set_failure(const std::string &what) { failure() = what; }
+
+  /*! \brief Overwrite a word of a side table in place, durably
+   *
+   * The layers keeping a side table use it to mark the table as open
+   * before the first write following a clean save, so that a crash
+   * leaves a table which is recognized as stale.
+   * \param fname The file of the side table
+   * \param value The new value of the word
+   * \param p The position of the word
+   * \return It returns true on success
+   */
+  static bool patch_table_word(const std::string &fname, std::uint64_t value, size_type p) {
+    int fd = ::open(fname.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    bool ok = ::pwrite(fd, &value, sizeof(value), p) == sizeof(value) && fdatasync(fd) == 0;
+    return ::close(fd) == 0 && ok;
+  }
+
+  std::unique_ptr<std::streambuf> inner;  //!< \brief The buffer below
+  size_type pos = 0;  //!< \brief The current position of the layer
+  size_type inner_pos = -1;  //!< \brief The position of the buffer below, -1 if unknown
+
+  /*! \brief Read bytes at a given position
+   *
+   * \param s The destination
+   * \param n The number of bytes
+   * \param p The position
+   * \return It returns the number of bytes read
+   */
+  virtual size_type read_at(char *s, size_type n, size_type p) { return inner_read(s, n, p); }
+
+  /*! \brief Write bytes at a given position
+   *
+   * \param s The source
+   * \param n The number of bytes
+   * \param p The position
+   * \return It returns the number of bytes written
+   */
+  virtual size_type write_at(const char *s, size_type n, size_type p) { return inner_write(s, n, p); }
+
+  //! \brief Read from the buffer below, seeking only if needed
+  size_type inner_read(char *s, size_type n, size_type p) {
+    if (!inner_seek(p))
+      return 0;
+    size_type k = inner->sgetn(s, n);
+    inner_pos = p + k;
+    return k;
+  }
+
+  //! \brief Write to the buffer below, seeking only if needed
+  size_type inner_write(const char *s, size_type n, size_type p) {
+    if (!inner_seek(p))
+      return 0;
+    size_type k = inner->sputn(s, n);
+    inner_pos = p + k;
+    return k;
+  }
+
+  //! \brief The size of the buffer below
+  size_type inner_size() {
+    inner_pos = inner->pubseekoff(0, std::ios_base::end);
+    return inner_pos;
+  }
+
+  std::streamsize xsgetn(char *s, std::streamsize n) override {
+    size_type k = read_at(s, n, pos);
+    pos += k;
+    return k;
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override {
+    size_type k = write_at(s, n, pos);
+    pos += k;
+    return k;
+  }
+
+  int_type underflow() override {
+    char c;
+    return read_at(&c, 1, pos) == 1 ? traits_type::to_int_type(c) : traits_type::eof();
+  }
+
+  int_type uflow() override {
+    int_type c = underflow();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      ++pos;
+    return c;
+  }
+
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+    char ch = traits_type::to_char_type(c);
+    return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+    if (dir == std::ios_base::cur)
+      off += pos;
+    else if (dir == std::ios_base::end)
+      off += inner_size();
+    return seekpos(off, which);
+  }
+
+  pos_type seekpos(pos_type p, std::ios_base::openmode) override {
+    if (p < 0)
+      return pos_type(off_type(-1));
+    pos = p;
+    return p;
+  }
+
+  int sync() override { return inner->pubsync(); }
+
+ private:
+  //! \brief The reason of the last failure in this thread
+  static std::string &failure() {
+    static thread_local std::string what;
+    return what;
+  }
+
+  //! \brief Move the buffer below to a position, if it isn't already there
+  bool inner_seek(size_type p) {
+    if (p == inner_pos)
+      return true;
+    inner_pos = inner->pubseekpos(p);
+    return inner_pos == p;
+  }
+};
+
+/*! \brief A layer keeping the most accessed regions of a file in memory
+ *
+ * Every read counts a hit for the regions it touches. A region reaching
+ * the promotion threshold is copied in memory, as long as it fits the
+ * budget or a colder region can be evicted to make room for it. The
+ * counters are halved periodically, so the hot set can shift over time.
+ * Reads of resident regions are served from memory while writes go
+ * through to the file and update the resident copies.
+ */
+class TierBuf : public LayerBuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param budget_bytes The maximum number of bytes kept in memory
+   * \param region_bytes The size of a region
+   * \param lock_memory If set to true the resident regions are locked in RAM with mlock
+   * \param promote_hits The number of hits needed to promote a region
+   */
+  TierBuf(size_type budget_bytes, size_type region_bytes, bool lock_memory, unsigned promote_hits) :
+      budget(budget_bytes), region(region_bytes), lock(lock_memory), threshold(promote_hits) {
+    if (region <= 0 || threshold == 0)
+      throw std::domain_error("The region size and the promotion threshold must be positive!");
+  }
+
+  ~TierBuf() {
+    for (auto &r : regions)
+      unpin(r.second);
+  }
+
+  /*! \brief Get the number of bytes currently kept in memory */
+  size_type resident_bytes() const { return resident; }
+
+ protected:
+  size_type read_at(char *s, size_type n, size_type p) override {
+    size_type done = 0;
+    while (done < n) {
+      size_type idx = (p + done) / region;
+      size_type off = (p + done) % region;
+      size_type k = std::min(n - done, region - off);
+      Region &r = touch(idx);
+      // A region which doesn't fit is retried every threshold hits
+      if (r.data.empty() && r.hits % threshold == 0)
+        promote(idx, r);
+      if (static_cast<size_type>(r.data.size()) >= off + k) {
+        std::memcpy(s + done, r.data.data() + off, k);
+      } else {
+        size_type got = inner_read(s + done, k, p + done);
+        done += got;
+        if (got < k)
+          break;
+        continue;
+      }
+      done += k;
+    }
+    return done;
+  }
+
+  size_type write_at(const char *s, size_type n, size_type p) override {
+    size_type k = inner_write(s, n, p);
+    // Keep the resident copies in sync
+    for (size_type idx = p / region; idx <= (p + k - 1) / region && k > 0; ++idx) {
+      auto it = regions.find(idx);
+      if (it == regions.end() || it->second.data.empty())
+        continue;
+      std::vector<char> &d = it->second.data;
+      size_type first = std::max(p, idx * region), last = std::min(p + k, (idx + 1) * region);
+      size_type off = first - idx * region;
+      if (static_cast<size_type>(d.size()) < last - idx * region) {
+        // The region grew: it is simpler to reload it when it gets hot again
+        evict(it->second);
+        continue;
+      }
+      std::memcpy(d.data() + off, s + (first - p), last - first);
+    }
+    return k;
+  }
+
+ private:
+  /*! \brief The statistics of a region and its copy in memory, if resident */
+  struct Region {
+    unsigned hits = 0;  //!< \brief The (decaying) number of accesses
+    std::vector<char> data;  //!< \brief The copy in memory, empty if not resident
+    bool locked = false;  //!< \brief Tells if the copy is locked in RAM
+  };
+
+  const size_type budget;  //!< \brief The maximum number of bytes kept in memory
+  const size_type region;  //!< \brief The size of a region
+  const bool lock;  //!< \brief Tells if the resident regions are locked in RAM
+  const unsigned threshold;  //!< \brief The hits needed to promote a region
+  size_type resident = 0;  //!< \brief The bytes currently kept in memory
+  unsigned long accesses = 0;  //!< \brief The accesses since the last decay
+  std::unordered_map<size_type, Region> regions;  //!< \brief The regions seen so far
+
+  //! \brief Count a hit on a region, halving all the counters once in a while
+  Region &touch(size_type idx) {
+    if (++accesses == 1ul << 16) {
+      accesses = 0;
+      for (auto it = regions.begin(); it != regions.end();) {
+        it->second.hits /= 2;
+        if (it->second.hits == 0 && it->second.data.empty())
+          it = regions.erase(it);
+        else
+          ++it;
+      }
+    }
+    Region &r = regions[idx];
+    ++r.hits;
+    return r;
+  }
+
+  //! \brief Copy a region in memory, evicting colder ones if needed
+  void promote(size_type idx, Region &r) {
+    while (resident + region > budget) {
+      Region *coldest = nullptr;
+      for (auto &c : regions)
+        if (!c.second.data.empty() && (!coldest || c.second.hits < coldest->hits))
+          coldest = &c.second;
+      if (!coldest || coldest->hits >= r.hits)
+        return;
+      evict(*coldest);
+    }
+    r.data.resize(region);
+    size_type got = inner_read(r.data.data(), region, idx * region);
+    if (got <= 0) {
+      std::vector<char>().swap(r.data);
+      return;
+    }
+    r.data.resize(got);
+    resident += got;
+    // If the limit of locked memory is reached the region simply stays unlocked
+    if (lock)
+      r.locked = mlock(r.data.data(), r.data.size()) == 0;
+  }
+
+  //! \brief Drop the copy in memory of a region
+  void evict(Region &r) {
+    unpin(r);
+    resident -= r.data.size();
+    std::vector<char>().swap(r.data);
+  }
+
+  //! \brief Unlock the copy in memory of a region
+  void unpin(Region &r) {
+    if (r.locked)
+      munlock(r.data.data(), r.data.size());
+    r.locked = false;
+  }
+};
+
+/*! \brief The AES block cipher
+ *
+ * On x86-64 with GCC or Clang the blocks are encrypted with the AES-NI
+ * instructions when the CPU has them, detected at run time, so no
+ * special compiler flag is needed. Otherwise a portable implementation
+ * is used.
+ */
+class Aes {
+ public:
+  /*! \brief The constructor
+   *
+   * \param key The key
+   * \param key_len The length of the key: 16, 24 or 32 bytes
+   * \param allow_aesni If false the portable implementation is always used. The default value is true
+   */
+  Aes(const unsigned char *key, std::size_t key_len, bool allow_aesni = true) : aesni(allow_aesni && has_aesni()) {
+    if (key_len != 16 && key_len != 24 && key_len != 32)
+      throw std::domain_error("The AES key must be 16, 24 or 32 bytes long!");
+    const int nk = key_len / 4;
+    rounds = nk + 6;
+    std::memcpy(rk, key, key_len);
+    unsigned char rcon = 1;
+    for (int i = nk; i < 4 * (rounds + 1); ++i) {
+      unsigned char t[4];
+      std::memcpy(t, rk + 4 * (i - 1), 4);
+      if (i % nk == 0) {
+        unsigned char first = t[0];
+        t[0] = sbox()[t[1]] ^ rcon;
+        t[1] = sbox()[t[2]];
+        t[2] = sbox()[t[3]];
+        t[3] = sbox()[first];
+        rcon = xtime(rcon);
+      } else if (nk > 6 && i % nk == 4) {
+        for (auto &b : t)
+          b = sbox()[b];
+      }
+      for (int j = 0; j != 4; ++j)
+        rk[4 * i + j] = rk[4 * (i - nk) + j] ^ t[j];
+    }
+  }
+
+  Aes(const Aes &) = delete;
+  Aes &operator=(const Aes &) = delete;
+
+  ~Aes() {
+    // Don't leave the round keys around in memory
+    volatile unsigned char *p = rk;
+    for (std::size_t i = 0; i != sizeof(rk); ++i)
+      p[i] = 0;
+  }
+
+  /*! \brief Encrypt consecutive blocks of 16 bytes
+   *
+   * \param in The plain blocks
+   * \param out The encrypted blocks, it can be the same as in
+   * \param n_blocks The number of blocks
+   */
+  void encrypt_blocks(const unsigned char *in, unsigned char *out, std::size_t n_blocks) const {
+#ifdef READWRITEBIN_AESNI
+    if (aesni) {
+      encrypt_blocks_aesni(in, out, n_blocks);
+      return;
+    }
+#endif
+    for (std::size_t i = 0; i != n_blocks; ++i)
+      encrypt_block(in + 16 * i, out + 16 * i);
+  }
+
+  /*! \brief Decrypt consecutive blocks of 16 bytes
+   *
+   * \param in The encrypted blocks
+   * \param out The plain blocks, it can be the same as in
+   * \param n_blocks The number of blocks
+   */
+  void decrypt_blocks(const unsigned char *in, unsigned char *out, std::size_t n_blocks) const {
+#ifdef READWRITEBIN_AESNI
+    if (aesni) {
+      decrypt_blocks_aesni(in, out, n_blocks);
+      return;
+    }
+#endif
+    for (std::size_t i = 0; i != n_blocks; ++i)
+      decrypt_block(in + 16 * i, out + 16 * i);
+  }
+
+  /*! \brief Tells if the blocks are encrypted with the AES-NI instructions */
+  bool uses_aesni() const { return aesni; }
+
+  /*! \brief Tells if the CPU has the AES-NI instructions and they are compiled in */
+  static bool has_aesni() {
+#ifdef READWRITEBIN_AESNI
+    static const bool ret = __builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2");
+    return ret;
+#else
+    return false;
+#endif
+  }
+
+ private:
+  int rounds;  //!< \brief The number of rounds
+  unsigned char rk[240];  //!< \brief The round keys
+  const bool aesni;  //!< \brief Tells if the AES-NI instructions are used
+
+#ifdef READWRITEBIN_AESNI
+  //! \brief Encrypt consecutive blocks with the AES-NI instructions
+  __attribute__((target("aes,sse2")))
+  void encrypt_blocks_aesni(const unsigned char *in, unsigned char *out, std::size_t n_blocks) const {
+    __m128i k[15];
+    for (int r = 0; r <= rounds; ++r)
+      k[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rk + 16 * r));
+    std::size_t i = 0;
+    // Four blocks at a time, to keep the pipeline of the AES unit busy
+    for (; i + 4 <= n_blocks; i += 4) {
+      __m128i b[4];
+      for (int j = 0; j != 4; ++j)
+        b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j))), k[0]);
+      for (int r = 1; r < rounds; ++r)
+        for (int j = 0; j != 4; ++j)
+          b[j] = _mm_aesenc_si128(b[j], k[r]);
+      for (int j = 0; j != 4; ++j)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_aesenclast_si128(b[j], k[rounds]));
+    }
+    for (; i < n_blocks; ++i) {
+      __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)), k[0]);
+      for (int r = 1; r < rounds; ++r)
+        b = _mm_aesenc_si128(b, k[r]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_aesenclast_si128(b, k[rounds]));
+    }
+  }
+
+  //! \brief Decrypt consecutive blocks with the AES-NI instructions
+  __attribute__((target("aes,sse2")))
+  void decrypt_blocks_aesni(const unsigned char *in, unsigned char *out, std::size_t n_blocks) const {
+    // The round keys in reverse order, the inner ones through InvMixColumns
+    __m128i k[15];
+    k[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rk + 16 * rounds));
+    for (int r = 1; r < rounds; ++r)
+      k[r] = _mm_aesimc_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rk + 16 * (rounds - r))));
+    k[rounds] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rk));
+    std::size_t i = 0;
+    for (; i + 4 <= n_blocks; i += 4) {
+      __m128i b[4];
+      for (int j = 0; j != 4; ++j)
+        b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * (i + j))), k[0]);
+      for (int r = 1; r < rounds; ++r)
+        for (int j = 0; j != 4; ++j)
+          b[j] = _mm_aesdec_si128(b[j], k[r]);
+      for (int j = 0; j != 4; ++j)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + j)), _mm_aesdeclast_si128(b[j], k[rounds]));
+    }
+    for (; i < n_blocks; ++i) {
+      __m128i b = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)), k[0]);
+      for (int r = 1; r < rounds; ++r)
+        b = _mm_aesdec_si128(b, k[r]);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), _mm_aesdeclast_si128(b, k[rounds]));
+    }
+  }
+#endif
+
+  //! \brief The substitution box
+  static const unsigned char *sbox() {
+    static const unsigned char table[256] = {
+      0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+      0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+      0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+      0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+      0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+      0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+      0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+      0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+      0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+      0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+      0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+      0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+      0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+      0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+      0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+      0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+    };
+    return table;
+  }
+
+  //! \brief The inverse of the substitution box
+  static const unsigned char *inv_sbox() {
+    static unsigned char table[256];
+    static const bool ready = [] {
+      for (int i = 0; i != 256; ++i)
+        table[sbox()[i]] = static_cast<unsigned char>(i);
+      return true;
+    }();
+    (void)ready;
+    return table;
+  }
+
+  //! \brief Multiplication by x in GF(2^8)
+  static unsigned char xtime(unsigned char b) { return (b << 1) ^ ((b & 0x80) ? 0x1b : 0); }
+
+  //! \brief MixColumns on a column
+  static void mix_column(unsigned char *a) {
+    unsigned char all = a[0] ^ a[1] ^ a[2] ^ a[3], first = a[0];
+    a[0] ^= all ^ xtime(a[0] ^ a[1]);
+    a[1] ^= all ^ xtime(a[1] ^ a[2]);
+    a[2] ^= all ^ xtime(a[2] ^ a[3]);
+    a[3] ^= all ^ xtime(a[3] ^ first);
+  }
+
+  //! \brief Encrypt a single block with the portable implementation
+  void encrypt_block(const unsigned char *in, unsigned char *out) const {
+    unsigned char st[16], tmp[16];
+    for (int i = 0; i != 16; ++i)
+      st[i] = in[i] ^ rk[i];
+    for (int r = 1; r <= rounds; ++r) {
+      // SubBytes and ShiftRows: the byte of row i, column c moves to column c - i
+      for (int c = 0; c != 4; ++c)
+        for (int i = 0; i != 4; ++i)
+          tmp[4 * c + i] = sbox()[st[4 * ((c + i) % 4) + i]];
+      if (r != rounds)
+        for (int c = 0; c != 4; ++c)
+          mix_column(tmp + 4 * c);
+      for (int i = 0; i != 16; ++i)
+        st[i] = tmp[i] ^ rk[16 * r + i];
+    }
+    std::memcpy(out, st, 16);
+  }
+
+  //! \brief Decrypt a single block with the portable implementation
+  void decrypt_block(const unsigned char *in, unsigned char *out) const {
+    unsigned char st[16], tmp[16];
+    for (int i = 0; i != 16; ++i)
+      st[i] = in[i] ^ rk[16 * rounds + i];
+    for (int r = rounds - 1; r >= 0; --r) {
+      // InvShiftRows and InvSubBytes: the byte of row i, column c moves back to column c + i
+      for (int c = 0; c != 4; ++c)
+        for (int i = 0; i != 4; ++i)
+          tmp[4 * ((c + i) % 4) + i] = inv_sbox()[st[4 * c + i]];
+      for (int i = 0; i != 16; ++i)
+        tmp[i] ^= rk[16 * r + i];
+      if (r != 0)
+        for (int c = 0; c != 4; ++c) {
+          // InvMixColumns, as a multiplication by 4x^2 + 5 followed by MixColumns
+          unsigned char *a = tmp + 4 * c;
+          unsigned char u = xtime(xtime(a[0] ^ a[2])), v = xtime(xtime(a[1] ^ a[3]));
+          a[0] ^= u;
+          a[1] ^= v;
+          a[2] ^= u;
+          a[3] ^= v;
+          mix_column(a);
+        }
+      std::memcpy(st, tmp, 16);
+    }
+    std::memcpy(out, st, 16);
+  }
+};
+
+/*! \brief A layer encrypting the file with AES in XTS mode (IEEE 1619)
+ *
+ * The file is split in data units of 512 bytes, and the tweak of the
+ * unit i is made of i (first 8 bytes) and the nonce (last 8 bytes),
+ * both little endian: with the nonce 0 the tweaks are the standard
+ * data unit numbers. Each block of 16 bytes is encrypted alone, so
+ * reads decrypt only the blocks touched and writes re-encrypt only
+ * the blocks touched, and the size of the file doesn't change. The
+ * last partial block borrows bytes from the block before it
+ * (ciphertext stealing), so those two blocks are always processed
+ * together; a file shorter than a block is XORed with the encrypted
+ * tweak of its first block.
+ *
+ * Unlike a stream cipher, rewriting a position doesn't reveal the XOR
+ * of the old and new data: whoever sees two versions of the file only
+ * learns which blocks of 16 bytes changed.
+ */
+class EncryptBuf : public LayerBuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param key The key, 32, 48 or 64 bytes long: the first half encrypts the data and the second the tweaks
+   * \param nonce The nonce, which should be unique for each file using the same key
+   */
+  EncryptBuf(const std::string &key, std::uint64_t nonce) :
+      aes(reinterpret_cast<const unsigned char*>(checked(key).data()), key.size() / 2),
+      tweak_aes(reinterpret_cast<const unsigned char*>(key.data()) + key.size() / 2, key.size() / 2), iv(nonce) { }
+
+  /*! \brief Get the nonce of the file */
+  std::uint64_t nonce() const { return iv; }
+
+  void init() override { file_size = inner_size(); }
+
+ protected:
+  size_type read_at(char *s, size_type n, size_type p) override {
+    n = std::max<size_type>(0, std::min(n, file_size - p));
+    unsigned char stage[stage_bytes + 64];
+    size_type done = 0;
+    while (done < n) {
+      size_type a = p + done, e = std::min(p + n, a - a % 16 + stage_bytes);
+      size_type first = a;
+      widen(a, e, file_size);
+      if (inner_read(reinterpret_cast<char*>(stage), e - a, a) != e - a)
+        break;
+      crypt_range(stage, a, e, file_size, false);
+      size_type k = std::min(e, p + n) - first;
+      std::memcpy(s + done, stage + (first - a), k);
+      done += k;
+    }
+    return done;
+  }
+
+  size_type write_at(const char *s, size_type n, size_type p) override {
+    unsigned char stage[stage_bytes + 64];
+    // A write past EOF encrypts the zeros before it too, so that they read back as zeros
+    size_type from = std::min(p, file_size), done = from;
+    while (done < p + n) {
+      size_type a = done, e = std::min(p + n, a - a % 16 + stage_bytes);
+      size_type next = std::max(file_size, e), lo = a, hi = e;
+      widen(lo, hi, next);
+      if (lo < file_size) {
+        // The old bytes are decrypted with the old size, whose last two blocks may differ
+        size_type old_lo = lo, old_hi = std::min(hi, file_size);
+        widen(old_lo, old_hi, file_size);
+        lo = std::min(lo, old_lo);
+        hi = std::max(hi, old_hi);
+      }
+      size_type kept = std::max<size_type>(0, std::min(hi, file_size) - lo);
+      if (kept > 0 && (lo < a || hi > e)) {
+        if (inner_read(reinterpret_cast<char*>(stage), kept, lo) != kept)
+          break;
+        crypt_range(stage, lo, lo + kept, file_size, false);
+      }
+      std::memset(stage + kept, 0, hi - lo - kept);
+      if (e > p)
+        std::memcpy(stage + (std::max(a, p) - lo), s + (std::max(a, p) - p), e - std::max(a, p));
+      crypt_range(stage, lo, hi, next, true);
+      if (inner_write(reinterpret_cast<const char*>(stage), hi - lo, lo) != hi - lo)
+        break;
+      file_size = next;
+      done = e;
+    }
+    return std::max<size_type>(0, done - p);
+  }
+
+ private:
+  //! \brief The size of the chunks processed at once
+  static const size_type stage_bytes = 4096;
+  //! \brief The number of blocks of a data unit
+  static const size_type unit_blocks = 32;
+
+  const Aes aes;  //!< \brief The cipher of the data
+  const Aes tweak_aes;  //!< \brief The cipher of the tweaks
+  const std::uint64_t iv;  //!< \brief The nonce
+  size_type file_size = 0;  //!< \brief The size of the file
+
+  //! \brief Check the length of the key and that its halves differ, as IEEE 1619 requires
+  static const std::string &checked(const std::string &key) {
+    if (key.size() != 32 && key.size() != 48 && key.size() != 64)
+      throw std::domain_error("The XTS key must be 32, 48 or 64 bytes long!");
+    if (key.compare(0, key.size() / 2, key, key.size() / 2, key.size() / 2) == 0)
+      throw std::domain_error("The two halves of the XTS key must differ!");
+    return key;
+  }
+
+  //! \brief Multiply a tweak by x in GF(2^128)
+  static void mul_alpha(unsigned char *t) {
+    unsigned char carry = 0;
+    for (int i = 0; i != 16; ++i) {
+      unsigned char c = t[i] >> 7;
+      t[i] = static_cast<unsigned char>((t[i] << 1) | carry);
+      carry = c;
+    }
+    if (carry)
+      t[0] ^= 0x87;
+  }
+
+  //! \brief Compute the tweaks of n consecutive blocks, starting from block b
+  void tweaks(size_type b, std::size_t n, unsigned char *t) const {
+    for (std::size_t i = 0; i != n; ++i) {
+      unsigned char *ti = t + 16 * i;
+      size_type block = b + static_cast<size_type>(i);
+      if (i != 0 && block % unit_blocks != 0) {
+        std::memcpy(ti, ti - 16, 16);
+        mul_alpha(ti);
+        continue;
+      }
+      std::uint64_t unit = block / unit_blocks;
+      for (int k = 0; k != 8; ++k) {
+        ti[k] = static_cast<unsigned char>(unit >> (8 * k));
+        ti[8 + k] = static_cast<unsigned char>(iv >> (8 * k));
+      }
+      tweak_aes.encrypt_blocks(ti, ti, 1);
+      for (size_type j = 0; j != block % unit_blocks; ++j)
+        mul_alpha(ti);
+    }
+  }
+
+  //! \brief Encrypt or decrypt n whole blocks in place, starting from block b
+  void crypt_blocks(unsigned char *s, size_type b, std::size_t n, bool encrypt) const {
+    unsigned char t[64 * 16];
+    for (std::size_t done = 0; done < n; ) {
+      std::size_t k = std::min<std::size_t>(64, n - done);
+      unsigned char *x = s + 16 * done;
+      tweaks(b + done, k, t);
+      for (std::size_t i = 0; i != 16 * k; ++i)
+        x[i] ^= t[i];
+      if (encrypt)
+        aes.encrypt_blocks(x, x, k);
+      else
+        aes.decrypt_blocks(x, x, k);
+      for (std::size_t i = 0; i != 16 * k; ++i)
+        x[i] ^= t[i];
+      done += k;
+    }
+  }
+
+  //! \brief Widen a range to whole blocks, and to the last two blocks of the file if it touches them
+  static void widen(size_type &a, size_type &e, size_type size) {
+    a -= a % 16;
+    if (size < 16) {
+      a = 0;
+      e = size;
+      return;
+    }
+    e = std::min(size, (e + 15) / 16 * 16);
+    size_type pair = size - size % 16 - 16;
+    if (size % 16 != 0 && e > pair) {
+      a = std::min(a, pair);
+      e = size;
+    }
+  }
+
+  /*! \brief Encrypt or decrypt in place a range widened by widen()
+   *
+   * \param s The bytes of the range
+   * \param a The start of the range
+   * \param e The end of the range
+   * \param size The size of the file
+   * \param encrypt True to encrypt, false to decrypt
+   */
+  void crypt_range(unsigned char *s, size_type a, size_type e, size_type size, bool encrypt) const {
+    if (size < 16) {
+      unsigned char ks[16];
+      tweaks(0, 1, ks);
+      aes.encrypt_blocks(ks, ks, 1);
+      for (size_type i = 0; i != e; ++i)
+        s[i] ^= ks[i];
+      return;
+    }
+    size_type tail = e == size ? size % 16 : 0;
+    size_type whole = (e - a - tail) / 16 - (tail ? 1 : 0);
+    crypt_blocks(s, a / 16, whole, encrypt);
+    if (!tail)
+      return;
+    // Ciphertext stealing: the last whole block q and the partial block m = q + 1
+    unsigned char *pq = s + 16 * whole, *pm = pq + 16, x[16];
+    size_type q = a / 16 + whole;
+    std::memcpy(x, pq, 16);
+    crypt_blocks(x, encrypt ? q : q + 1, 1, encrypt);
+    std::memcpy(pq, pm, tail);
+    std::memcpy(pq + tail, x + tail, 16 - tail);
+    std::memcpy(pm, x, tail);
+    crypt_blocks(pq, encrypt ? q + 1 : q, 1, encrypt);
+  }
+};
+
+/*! \brief Helpers of crc32c() */
+namespace bin_crc {
+
+//! \brief Update an inverted CRC32C with a table, a byte at a time
+inline std::uint32_t update_table(std::uint32_t crc, const char *data, std::size_t n) {
+  struct Table {
+    std::uint32_t t[256];
+    Table() {
+      for (std::uint32_t i = 0; i != 256; ++i) {
+        std::uint32_t c = i;
+        for (int k = 0; k != 8; ++k)
+          c = (c >> 1) ^ ((c & 1) ? 0x82f63b78u : 0);
+        t[i] = c;
+      }
+    }
+  };
+  static const Table table;
+  for (; n > 0; --n)
+    crc = table.t[(crc ^ static_cast<unsigned char>(*data++)) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef READWRITEBIN_SSE42
+//! \brief Update an inverted CRC32C with the CRC32 instruction, 8 bytes at a time
+__attribute__((target("sse4.2")))
+inline std::uint32_t update_sse42(std::uint32_t crc, const char *data, std::size_t n) {
+  std::uint64_t c = crc;
+  for (; n >= 8; data += 8, n -= 8) {
+    std::uint64_t v;
+    std::memcpy(&v, data, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  crc = static_cast<std::uint32_t>(c);
+  for (; n > 0; --n)
+    crc = _mm_crc32_u8(crc, static_cast<unsigned char>(*data++));
+  return crc;
+}
+#endif
+
+//! \brief Tells if the CPU has the CRC32 instruction and it is compiled in
+inline bool has_sse42() {
+#ifdef READWRITEBIN_SSE42
+  static const bool ret = __builtin_cpu_supports("sse4.2");
+  return ret;
+#else
+  return false;
+#endif
+}
+
+}  // namespace bin_crc
+
+/*! \brief Compute the CRC32C (Castagnoli) of a range of bytes
+ *
+ * On x86-64 the CRC32 instruction of SSE4.2 is used if the CPU has it,
+ * checked at run time, so no special compiler flag is needed. Otherwise
+ * a table is used.
+ * \param crc The CRC of the previous bytes, 0 at the beginning
+ * \param data The bytes
+ * \param n The number of bytes
+ * \return It returns the CRC updated with the bytes
+ */
+inline std::uint32_t crc32c(std::uint32_t crc, const char *data, std::size_t n) {
+#ifdef READWRITEBIN_SSE42
+  if (bin_crc::has_sse42())
+    return ~bin_crc::update_sse42(~crc, data, n);
+#endif
+  return ~bin_crc::update_table(~crc, data, n);
+}
+
+/*! \brief Compute the XXH64 hash of a range of bytes
+ *
+ * It is the 64 bit xxHash: a fast non-cryptographic hash, whose
+ * result doesn't depend on the endianness of the machine.
+ * \param data The bytes
+ * \param n The number of bytes
+ * \param seed The seed. The default value is 0
+ * \return It returns the hash
+ */
+inline std::uint64_t xxhash64(const char *data, std::size_t n, std::uint64_t seed = 0) {
+  const std::uint64_t p1 = 11400714785074694791ull, p2 = 14029467366897019727ull,
+                      p3 = 1609587929392839161ull, p4 = 9650029242287828579ull, p5 = 2870177450012600261ull;
+  auto rotl = [] (std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+  auto read = [] (const char *p, int bytes) {
+    std::uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i)
+      v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+  };
+  auto round = [&] (std::uint64_t acc, std::uint64_t input) { return rotl(acc + input * p2, 31) * p1; };
+  const char *end = data + n;
+  std::uint64_t h;
+  if (n >= 32) {
+    std::uint64_t v[4] = {seed + p1 + p2, seed + p2, seed, seed - p1};
+    for (; end - data >= 32; data += 32)
+      for (int i = 0; i != 4; ++i)
+        v[i] = round(v[i], read(data + 8 * i, 8));
+    h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+    for (int i = 0; i != 4; ++i)
+      h = (h ^ round(0, v[i])) * p1 + p4;
+  } else {
+    h = seed + p5;
+  }
+  h += n;
+  for (; end - data >= 8; data += 8)
+    h = rotl(h ^ round(0, read(data, 8)), 27) * p1 + p4;
+  if (end - data >= 4) {
+    h = rotl(h ^ (read(data, 4) * p1), 23) * p2 + p3;
+    data += 4;
+  }
+  for (; data != end; ++data)
+    h = rotl(h ^ (static_cast<unsigned char>(*data) * p5), 11) * p1;
+  h ^= h >> 33;
+  h *= p2;
+  h ^= h >> 29;
+  h *= p3;
+  return h ^ (h >> 32);
+}
+
+/*! \brief A layer verifying the integrity of the file with block checksums
+ *
+ * Every block of the file has a CRC32C, kept in a side table. A write
+ * only marks the blocks it touches as stale: their checksums are
+ * computed again when they are read or when the file is flushed, so
+ * small writes don't read back whole blocks. The table is saved when
+ * the file is flushed (or the layer destroyed). Before the first write
+ * following a save, the table is marked as open on disk: a table left
+ * open by a crash is not trusted, and is built again from the content.
+ * A block is verified the first time it is read: after that it is
+ * considered clean, and not verified again, until it is written.
+ * A read touching a corrupted block fails.
+ */
+class ChecksumBuf : public LayerBuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param table_name The file of the side table. If empty the table is kept in memory only
+   * \param block_bytes The size of a block
+   */
+  ChecksumBuf(const std::string &table_name, size_type block_bytes) : table_file(table_name), block(block_bytes) {
+    if (block <= 0)
+      throw std::domain_error("The block size must be positive!");
+  }
+
+  ~ChecksumBuf() {
+    try {
+      save_table();
+    } catch (...) { }
+  }
+
+  /*! \brief Load the side table, or build it from the content if it doesn't exist or was left open */
+  void init() override {
+    file_size = inner_size();
+    size_type n_blocks = (file_size + block - 1) / block;
+    struct stat st;
+    if (!table_file.empty() && stat(table_file.c_str(), &st) == 0) {
+      std::uint64_t head[2] = {0, 0};
+      if (static_cast<std::size_t>(st.st_size) < sizeof(head) || (st.st_size - sizeof(head)) % sizeof(std::uint32_t) != 0)
+        throw std::runtime_error("The checksum table is corrupted!");
+      MemoryBuf mb;
+      mb.load(table_file);
+      mb.sgetn(reinterpret_cast<char*>(head), sizeof(head));
+      if (static_cast<size_type>(head[0]) != block)
+        throw std::runtime_error("The checksum table was made with a different block size!");
+      if (head[1] != open_state) {
+        crcs.resize((st.st_size - sizeof(head)) / sizeof(std::uint32_t));
+        mb.sgetn(reinterpret_cast<char*>(crcs.data()), table_bytes(crcs.size()));
+        if (static_cast<size_type>(head[1]) != file_size || static_cast<size_type>(crcs.size()) != n_blocks)
+          throw std::runtime_error("The checksum table doesn't match the file!");
+        verified.assign(n_blocks, false);
+        stale.assign(n_blocks, false);
+        return;
+      }
+    }
+    crcs.assign(n_blocks, 0);
+    verified.assign(n_blocks, false);
+    stale.assign(n_blocks, false);
+    for (size_type b = 0; b != n_blocks; ++b)
+      update_block(b, nullptr, 0, 0);
+    table_dirty = true;
+  }
+
+  /*! \brief Get the number of blocks verified so far */
+  size_type verified_blocks() const { return std::count(verified.begin(), verified.end(), true); }
+
+ protected:
+  size_type read_at(char *s, size_type n, size_type p) override {
+    size_type k = inner_read(s, n, p);
+    if (k <= 0)
+      return k;
+    for (size_type b = p / block; b <= (p + k - 1) / block; ++b) {
+      if (b < static_cast<size_type>(verified.size()) && verified[b])
+        continue;
+      if (b >= static_cast<size_type>(crcs.size())) {
+        set_failure("Block " + std::to_string(b) + " is outside the checksum table!");
+        return 0;
+      }
+      if (stale[b]) {
+        // Written since its checksum was computed: there is nothing to verify
+        try {
+          update_block(b, s, k, p);
+        } catch (const std::exception &e) {
+          set_failure(e.what());
+          return 0;
+        }
+        continue;
+      }
+      size_type first = b * block, last = std::min(first + block, file_size);
+      std::uint32_t c;
+      if (first >= p && last <= p + k) {
+        c = crc32c(0, s + (first - p), last - first);
+      } else {
+        std::vector<char> tmp(last - first);
+        if (inner_read(tmp.data(), last - first, first) != last - first) {
+          set_failure("Couldn't read block " + std::to_string(b) + " to verify it!");
+          return 0;
+        }
+        c = crc32c(0, tmp.data(), tmp.size());
+      }
+      if (c != crcs[b]) {
+        set_failure("Checksum mismatch in block " + std::to_string(b) + "!");
+        return 0;
+      }
+      verified[b] = true;
+    }
+    return k;
+  }
+
+  size_type write_at(const char *s, size_type n, size_type p) override {
+    if (!mark_open()) {
+      set_failure("Couldn't mark the checksum table as open!");
+      return 0;
+    }
+    size_type old_size = file_size;
+    size_type k = inner_write(s, n, p);
+    if (k <= 0)
+      return k;
+    file_size = std::max(file_size, p + k);
+    size_type n_blocks = (file_size + block - 1) / block;
+    crcs.resize(n_blocks);
+    verified.resize(n_blocks);
+    stale.resize(n_blocks);
+    // A write past EOF also changes the blocks filled with zeros before it
+    for (size_type b = std::min(p, old_size) / block; b <= (p + k - 1) / block; ++b) {
+      if (!stale[b])
+        stale_list.push_back(b);
+      stale[b] = true;
+      verified[b] = false;
+    }
+    table_dirty = true;
+    return k;
+  }
+
+  int sync() override {
+    int ret = LayerBuf::sync();
+    try {
+      save_table();
+    } catch (...) {
+      set_failure("Couldn't save the checksum table!");
+      return -1;
+    }
+    return ret;
+  }
+
+ private:
+  //! \brief The state stored in the table while it is open, in place of the size of the file
+  static const std::uint64_t open_state = ~std::uint64_t(0);
+
+  const std::string table_file;  //!< \brief The file of the side table
+  const size_type block;  //!< \brief The size of a block
+  size_type file_size = 0;  //!< \brief The size of the file
+  std::vector<std::uint32_t> crcs;  //!< \brief The checksum of each block
+  std::vector<bool> verified;  //!< \brief Tells if a block is known to be clean
+  std::vector<bool> stale;  //!< \brief Tells if the checksum of a block must be computed again
+  std::vector<size_type> stale_list;  //!< \brief The blocks which may be stale, in no order
+  bool table_dirty = false;  //!< \brief Tells if the table must be saved
+  bool table_open = false;  //!< \brief Tells if the table is marked as open on disk
+
+  //! \brief The number of bytes of n checksums
+  static size_type table_bytes(std::size_t n) { return n * sizeof(std::uint32_t); }
+
+  /*! \brief Compute again the checksum of a block
+   *
+   * \param b The block
+   * \param s,n,p The bytes just read or written at p, used instead of reading back the block if they cover it
+   */
+  void update_block(size_type b, const char *s, size_type n, size_type p) {
+    size_type first = b * block, last = std::min(first + block, file_size);
+    if (s && first >= p && last <= p + n) {
+      crcs[b] = crc32c(0, s + (first - p), last - first);
+    } else {
+      std::vector<char> tmp(last - first);
+      if (inner_read(tmp.data(), last - first, first) != last - first)
+        throw std::runtime_error("Couldn't read block " + std::to_string(b) + " to checksum it!");
+      crcs[b] = crc32c(0, tmp.data(), tmp.size());
+    }
+    verified[b] = true;
+    stale[b] = false;
+  }
+
+  //! \brief Mark the table as open on disk, before the first write following a save
+  bool mark_open() {
+    if (table_open || table_file.empty())
+      return true;
+    table_open = true;
+    struct stat st;
+    if (stat(table_file.c_str(), &st) == 0)
+      return patch_table_word(table_file, open_state, sizeof(std::uint64_t));
+    try {
+      write_table(open_state);
+    } catch (...) {
+      return false;
+    }
+    return true;
+  }
+
+  //! \brief Write the whole side table
+  void write_table(std::uint64_t state) const {
+    std::uint64_t head[2] = {static_cast<std::uint64_t>(block), state};
+    MemoryBuf mb;
+    mb.sputn(reinterpret_cast<const char*>(head), sizeof(head));
+    mb.sputn(reinterpret_cast<const char*>(crcs.data()), table_bytes(crcs.size()));
+    mb.save(table_file);
+  }
+
+  //! \brief Compute the stale checksums and write the side table, marked as clean, if it changed
+  void save_table() {
+    if (!stale_list.empty()) {
+      inner->pubsync();
+      for (size_type b : stale_list)
+        if (b < static_cast<size_type>(stale.size()) && stale[b])
+          update_block(b, nullptr, 0, 0);
+      stale_list.clear();
+    }
+    if (!table_dirty || table_file.empty())
+      return;
+    write_table(static_cast<std::uint64_t>(file_size));
+    table_dirty = false;
+    table_open = false;
+  }
+};
+
+/*! \brief A range of bytes of a file */
+struct BinRange {
+  std::streamsize offset;  //!< \brief The position of the first byte
+  std::streamsize length;  //!< \brief The number of bytes
+};
+
+/*! \brief A layer recording which blocks of the file are written
+ *
+ * A bit per block is set by every write, and cleared by a checkpoint.
+ * Each checkpoint has a token, so a backup knows if the blocks set
+ * are relative to the last copy it made. The bitmap is kept in a side
+ * table, saved when the file is flushed (or the layer destroyed) along
+ * with the size of the file: if the size doesn't match when the table
+ * is loaded, the file was changed without tracking, and every block
+ * is considered written. Before the first write following a save, the
+ * size in the table is replaced (durably) by an "open" marker, so a
+ * table left behind by a crash is recognized and every block is
+ * considered written too.
+ */
+class DirtyBuf : public LayerBuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param table_name The file of the side table. If empty the table is kept in memory only
+   * \param block_bytes The size of a block
+   */
+  DirtyBuf(const std::string &table_name, size_type block_bytes) : table_file(table_name), block(block_bytes) {
+    if (block <= 0)
+      throw std::domain_error("The block size must be positive!");
+  }
+
+  ~DirtyBuf() {
+    try {
+      save_table();
+    } catch (...) { }
+  }
+
+  /*! \brief Load the side table, or start with every block written if it doesn't exist */
+  void init() override {
+    file_size = inner_size();
+    struct stat st;
+    if (!table_file.empty() && stat(table_file.c_str(), &st) == 0) {
+      std::uint64_t head[3] = {0, 0, 0};
+      if (static_cast<std::size_t>(st.st_size) < sizeof(head) || (st.st_size - sizeof(head)) % sizeof(std::uint64_t) != 0)
+        throw std::runtime_error("The dirty table is corrupted!");
+      MemoryBuf mb;
+      mb.load(table_file);
+      mb.sgetn(reinterpret_cast<char*>(head), sizeof(head));
+      if (static_cast<size_type>(head[0]) != block)
+        throw std::runtime_error("The dirty table was made with a different block size!");
+      tok = head[1];
+      bits.resize((st.st_size - sizeof(head)) / sizeof(std::uint64_t));
+      mb.sgetn(reinterpret_cast<char*>(bits.data()), bits.size() * sizeof(std::uint64_t));
+      if (head[2] != open_state && static_cast<size_type>(head[2]) == file_size && bits.size() == words(blocks()))
+        return;
+    }
+    // The history is unknown
+    ++tok;
+    bits.assign(words(blocks()), ~std::uint64_t(0));
+    table_dirty = true;
+  }
+
+  /*! \brief Get the token of the last checkpoint */
+  std::uint64_t token() const { return tok; }
+
+  /*! \brief Get the size of a block */
+  size_type block_bytes() const { return block; }
+
+  /*! \brief Clear the blocks written
+   *
+   * \return It returns the token of the new checkpoint
+   */
+  std::uint64_t checkpoint() {
+    std::fill(bits.begin(), bits.end(), 0);
+    table_dirty = true;
+    return ++tok;
+  }
+
+  /*! \brief Get the ranges written since a checkpoint
+   *
+   * \param since The token of the checkpoint
+   * \return
+   * \parblock
+   * It returns the ranges made of the blocks written, in order and
+   * never adjacent. If the token isn't the one of the last checkpoint,
+   * it returns the whole file.
+   * \endparblock
+   */
+  std::vector<BinRange> ranges(std::uint64_t since) const {
+    std::vector<BinRange> ret;
+    if (since != tok) {
+      if (file_size > 0)
+        ret.push_back(BinRange{0, file_size});
+      return ret;
+    }
+    for (size_type b = 0, n = blocks(); b < n; ++b) {
+      std::uint64_t w = bits[b / 64] >> (b % 64);
+      if (w == 0) {
+        // Skip the clean blocks up to the next word
+        b |= 63;
+        continue;
+      }
+      if (!(w & 1))
+        continue;
+      size_type first = b * block, last = std::min(first + block, file_size);
+      if (!ret.empty() && ret.back().offset + ret.back().length == first)
+        ret.back().length = last - ret.back().offset;
+      else
+        ret.push_back(BinRange{first, last - first});
+    }
+    return ret;
+  }
+
+ protected:
+  size_type write_at(const char *s, size_type n, size_type p) override {
+    if (!mark_open()) {
+      set_failure("Couldn't mark the dirty table as open!");
+      return 0;
+    }
+    size_type k = inner_write(s, n, p);
+    if (k <= 0)
+      return k;
+    // A write past EOF also changes the blocks filled with zeros before it
+    size_type first = std::min(p, file_size) / block, last = (p + k - 1) / block;
+    file_size = std::max(file_size, p + k);
+    bits.resize(words(blocks()));
+    for (size_type b = first; b <= last; ++b)
+      bits[b / 64] |= std::uint64_t(1) << (b % 64);
+    table_dirty = true;
+    return k;
+  }
+
+  int sync() override {
+    int ret = LayerBuf::sync();
+    try {
+      save_table();
+    } catch (...) {
+      set_failure("Couldn't save the dirty table!");
+      return -1;
+    }
+    return ret;
+  }
+
+ private:
+  //! \brief The size stored in the table while it is open
+  static const std::uint64_t open_state = ~std::uint64_t(0);
+
+  const std::string table_file;  //!< \brief The file of the side table
+  const size_type block;  //!< \brief The size of a block
+  size_type file_size = 0;  //!< \brief The size of the file
+  std::uint64_t tok = 0;  //!< \brief The token of the last checkpoint
+  std::vector<std::uint64_t> bits;  //!< \brief A bit per block, set if the block was written
+  bool table_dirty = false;  //!< \brief Tells if the table must be saved
+  bool table_open = false;  //!< \brief Tells if the table is marked as open on disk
+
+  //! \brief The number of blocks of the file
+  size_type blocks() const { return (file_size + block - 1) / block; }
+
+  //! \brief The number of words holding the bits of n blocks
+  static std::size_t words(size_type n) { return (n + 63) / 64; }
+
+  //! \brief Mark the table as open on disk, before the first write following a save
+  bool mark_open() {
+    if (table_open || table_file.empty())
+      return true;
+    table_open = true;
+    struct stat st;
+    if (stat(table_file.c_str(), &st) == 0)
+      return patch_table_word(table_file, open_state, 2 * sizeof(std::uint64_t));
+    try {
+      write_table(open_state);
+    } catch (...) {
+      return false;
+    }
+    return true;
+  }
+
+  //! \brief Write the whole side table
+  void write_table(std::uint64_t size_state) const {
+    std::uint64_t head[3] = {static_cast<std::uint64_t>(block), tok, size_state};
+    MemoryBuf mb;
+    mb.sputn(reinterpret_cast<const char*>(head), sizeof(head));
+    mb.sputn(reinterpret_cast<const char*>(bits.data()), bits.size() * sizeof(std::uint64_t));
+    mb.save(table_file);
+  }
+
+  //! \brief Write the side table, marked as clean, if it changed
+  void save_table() {
+    if (!table_dirty || table_file.empty())
+      return;
+    write_table(static_cast<std::uint64_t>(file_size));
+    table_dirty = false;
+    table_open = false;
+  }
+};
+
+/*! \brief A layer applying every write to a secondary file too, asynchronously
+ *
+ * The writes reach the file below right away and are queued for a
+ * background thread, which applies them to the mirror in the same order.
+ * Contiguous writes are merged in the queue. The queue is bounded:
+ * a write which would make the lag exceed the limit waits for the
+ * thread to catch up. Flushing the file is a barrier, which returns
+ * once the mirror holds every write made before it.
+ *
+ * The mirror receives the bytes this layer sees: enable mirroring
+ * before encryption to mirror the encrypted file.
+ */
+class MirrorBuf : public LayerBuf {
+ public:
+  /*! \brief The constructor
+   *
+   * \param mirror_name The mirror file. If it already exists it is replaced
+   * \param max_lag_bytes The maximum number of bytes waiting to be mirrored
+   */
+  MirrorBuf(const std::string &mirror_name, size_type max_lag_bytes) : mirror_file(mirror_name), max_lag(max_lag_bytes) {
+    if (max_lag <= 0)
+      throw std::domain_error("The maximum lag must be positive!");
+  }
+
+  ~MirrorBuf() {
+    if (!worker.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(m);
+      stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+    mirror.pubsync();
+  }
+
+  /*! \brief Copy the current content to the mirror and start the background thread */
+  void init() override {
+    if (!mirror.open(mirror_file, std::ios::out | std::ios::in | std::ios::trunc))
+      throw std::domain_error("Couldn't open mirror file!");
+    const size_type chunk = 1 << 20;
+    size_type size = inner_size();
+    std::vector<char> stage(std::min(chunk, size));
+    for (size_type p = 0; p < size; p += chunk) {
+      size_type k = std::min(chunk, size - p);
+      if (inner_read(stage.data(), k, p) != k || mirror.sputn(stage.data(), k) != k)
+        throw std::runtime_error("Couldn't copy the file to the mirror!");
+    }
+    worker = std::thread(&MirrorBuf::run, this);
+  }
+
+  /*! \brief Get the number of bytes waiting to be mirrored */
+  size_type lag() const { return queued; }
+
+  /*! \brief Get the maximum number of bytes waiting to be mirrored */
+  size_type max_lag_bytes() const { return max_lag; }
+
+  /*! \brief Tells if a write to the mirror failed, after which the mirror is left behind */
+  bool failed() const { return broken; }
+
+ protected:
+  size_type write_at(const char *s, size_type n, size_type p) override {
+    size_type k = inner_write(s, n, p);
+    if (k <= 0)
+      return k;
+    std::unique_lock<std::mutex> lock(m);
+    drained.wait(lock, [&] { return queued == 0 || queued + k <= max_lag; });
+    if (!q.empty() && q.back().p + static_cast<size_type>(q.back().bytes.size()) == p)
+      q.back().bytes.insert(q.back().bytes.end(), s, s + k);
+    else
+      q.push_back(Pending{p, std::vector<char>(s, s + k)});
+    queued += k;
+    lock.unlock();
+    wake.notify_one();
+    return k;
+  }
+
+  int sync() override {
+    int ret = LayerBuf::sync();
+    std::unique_lock<std::mutex> lock(m);
+    drained.wait(lock, [&] { return queued == 0; });
+    if (broken || mirror.pubsync() != 0) {
+      set_failure("Couldn't write the mirror file!");
+      return -1;
+    }
+    return ret;
+  }
+
+ private:
+  //! \brief A write waiting to be mirrored
+  struct Pending {
+    size_type p;  //!< \brief The position
+    std::vector<char> bytes;  //!< \brief The bytes
+  };
+
+  const std::string mirror_file;  //!< \brief The name of the mirror file
+  const size_type max_lag;  //!< \brief The maximum number of bytes waiting to be mirrored
+  std::filebuf mirror;  //!< \brief The mirror file
+  std::deque<Pending> q;  //!< \brief The writes waiting to be mirrored
+  std::atomic<size_type> queued{0};  //!< \brief The bytes queued or being mirrored
+  std::atomic<bool> broken{false};  //!< \brief Tells if a write to the mirror failed
+  bool stopping = false;  //!< \brief Tells the thread to stop once the queue is empty
+  std::mutex m;  //!< \brief Protects the queue
+  std::condition_variable wake;  //!< \brief Wakes up the thread
+  std::condition_variable drained;  //!< \brief Tells the writers that the lag decreased
+  std::thread worker;  //!< \brief The thread writing the mirror
+
+  //! \brief The loop of the thread: apply the writes in order
+  void run() {
+    std::unique_lock<std::mutex> lock(m);
+    for (;;) {
+      wake.wait(lock, [this] { return stopping || !q.empty(); });
+      if (q.empty())
+        return;
+      Pending w = std::move(q.front());
+      q.pop_front();
+      lock.unlock();
+      size_type k = w.bytes.size();
+      if (!broken && (mirror.pubseekpos(w.p) != w.p || mirror.sputn(w.bytes.data(), k) != k))
+        broken = true;
+      lock.lock();
+      queued -= k;
+      drained.notify_all();
+    }
+  }
+};
+
+/*! \brief A token bucket limiting the bandwidth and the operations per second
+ *
+ * It can be shared by many Bin instances (and threads) to limit them as
+ * a group. The tokens are refilled continuously up to the burst size.
+ * A request larger than the tokens available is granted and leaves the
+ * bucket in debt, so the following requests wait until it is paid back.
+ */
+class RateLimiter {
+ public:
+  /*! \brief The constructor
+   *
+   * \param bytes_per_second The bandwidth. If 0 it is unlimited
+   * \param ops_per_second The operations per second. If 0 (the default) they are unlimited
+   * \param burst_seconds The size of the bursts, expressed in seconds of traffic. The default value is 0.1
+   */
+  explicit RateLimiter(double bytes_per_second, double ops_per_second = 0, double burst_seconds = 0.1) :
+      byte_rate(bytes_per_second), op_rate(ops_per_second),
+      byte_burst(bytes_per_second * burst_seconds), op_burst(ops_per_second * burst_seconds),
+      byte_tokens(byte_burst), op_tokens(op_burst), last(std::chrono::steady_clock::now()) {
+    if (bytes_per_second < 0 || ops_per_second < 0 || burst_seconds <= 0)
+      throw std::domain_error("Invalid rate limits!");
+  }
+
+  /*! \brief Wait until an operation can be performed
+   *
+   * \param bytes The number of bytes moved by the operation
+   * \param ops The number of operations. The default value is 1
+   */
+  void acquire(std::streamsize bytes, double ops = 1) {
+    double wait = reserve(bytes, ops);
+    if (wait > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+  }
+
+  /*! \brief Take the tokens of an operation without waiting
+   *
+   * It is meant for callers with other work to do in the meantime,
+   * like a scheduler delaying only its next paced operation.
+   * \param bytes The number of bytes moved by the operation
+   * \param ops The number of operations. The default value is 1
+   * \return It returns the seconds to wait before the bucket is out of debt, 0 if it isn't in debt
+   */
+  double reserve(std::streamsize bytes, double ops = 1) {
+    double wait = 0;
+    std::lock_guard<std::mutex> lock(m);
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last).count();
+    last = now;
+    if (byte_rate > 0) {
+      byte_tokens = std::min(byte_burst, byte_tokens + elapsed * byte_rate) - bytes;
+      wait = std::max(wait, -byte_tokens / byte_rate);
+    }
+    if (op_rate > 0) {
+      op_tokens = std::min(op_burst, op_tokens + elapsed * op_rate) - ops;
+      wait = std::max(wait, -op_tokens / op_rate);
+    }
+    return wait;
+  }
+
+  /*! \brief Get the size of the chunks bulk operations should be split in
+   *
+   * \return It returns the size of a burst, between 4 KiB and 1 MiB
+   */
+  std::streamsize chunk_bytes() const {
+    if (byte_rate <= 0)
+      return 1 << 20;
+    return std::max<std::streamsize>(1 << 12, std::min<std::streamsize>(1 << 20, byte_burst));
+  }
+
+ private:
+  const double byte_rate;  //!< \brief The bytes per second
+  const double op_rate;  //!< \brief The operations per second
+  const double byte_burst;  //!< \brief The maximum number of byte tokens
+  const double op_burst;  //!< \brief The maximum number of operation tokens
+  double byte_tokens;  //!< \brief The byte tokens available, negative if in debt
+  double op_tokens;  //!< \brief The operation tokens available, negative if in debt
+  std::chrono::steady_clock::time_point last;  //!< \brief The time of the last refill
+  std::mutex m;  //!< \brief Protects the tokens
+};
+
+/*! \brief It handles a binary file for read/write operations
+ */
+class Bin {
+  template <typename T> friend class BinPtr;
+  template <typename T> friend class TypePtr;
+  friend class BinWindow;
+  template <typename T> using iterator = BinPtr<T>;
+
+ public:
+  /*! \brief An empty class.
+   *
+   * This class is used as default type for
+   * some template functions and it is used to understand
+   * if the template parameter is omitted.
+   */
+  class TypeNotSpecified {};
+
+  //! The type used to indicate positions inside the file
+  using size_type = std::streamsize;
+
+  /*! \brief The outcome of the non-throwing functions (try_*)
+   *
+   * ok:        The operation succeeded\n
+   * closed:    The file has been closed\n
+   * eof:       The requested range goes past EOF, nothing was read\n
+   * io_error:  The underlying stream failed\n
+   * read_only: The file has been opened in read-only mode
+   */
+  enum class Status { ok, closed, eof, io_error, read_only };
+
+  /*! \brief How the file is opened
+   *
+   * read_write: The file is opened for reading and writing, it is
+   *             created if it doesn't exist\n
+   * read_only:  The file must exist and it is never modified. It is
+   *             mapped in memory with a shared mapping, see data()\n
+   * in_memory:  The whole file lives in memory: it is loaded with a
+   *             single read if it exists (the filename can also be
+   *             empty) and it is written back only by save()
+   */
+  enum class Mode { read_write, read_only, in_memory };
+
+  /*! \brief The constructor.
+   *
+   * The destructor of the shared_ptr simply puts the pointer
+   * to 0 in order to avoid infinite loop of destructors
+   * (it would end up destroying itself more than once).
+   *
+   * \param fname             The filename. If the file doesn't exist it is created
+   * \param truncate          If set to true and the file already exists it is cleared. The default value is false.
+   * \param use_little_endian
+   * \parblock
+   * Decide if you want to read/write in little_endian.
+   * By default it is set to the default endianness of the machine.
+   * \endparblock
+   */
+  explicit Bin(const std::string &fname, bool truncate = false, bool use_little_endian = Bin::is_default_little_endian()) :
+      filename(fname), sptr(this, [] (Bin *p) { return p = 0; }) {
+    opposite_endian = use_little_endian != Bin::is_default_little_endian();
+    open(truncate);
+  }
+
+  /*! \brief The constructor specifying the open mode.
+   *
+   * \param fname             The filename
+   * \param m                 The open mode. An existing file is never truncated
+   * \param use_little_endian
+   * \parblock
+   * Decide if you want to read/write in little_endian.
+   * By default it is set to the default endianness of the machine.
+   * \endparblock
+   */
+  Bin(const std::string &fname, Mode m, bool use_little_endian = Bin::is_default_little_endian()) :
+      filename(fname), sptr(this, [] (Bin *p) { return p = 0; }), mode(m) {
+    opposite_endian = use_little_endian != Bin::is_default_little_endian();
+    open(false);
+  }
+
+  Bin(const Bin &) = delete;
+  Bin &operator=(const Bin &) = delete;
+
+  /*! \brief The destructor */
+  ~Bin() {
+    if (base_fd >= 0)
+      ::close(base_fd);
+  }
+
+  /*! \brief Tells if the machine is little endian or big endian
+   *
+   * \return It returns a bool:\n 
+   * \reutrn true:  The machine uses little endian\n 
+   * \return false: The machine uses big endian
+   */
+  static bool is_default_little_endian() {
+    short int n = 1;
+    char *address = reinterpret_cast<char*>(&n);
+    if (*(address + 1) == 1) return false;
+    else if (*address == 1) return true;
+    throw std::domain_error("Can't detect endianness of the machine!");
+  }
+
+  /*! \brief Compute the bytes occupied by instances of a given type
+   * 
+   * \tparam T The type used to determine the size of an instance of type T
+   * \param n_instances The number of instances of an object of type T
+   * \return It returns the number of bytes occupied by n_instances instances of T
+   */
+  template <typename T> static constexpr size_type bytes(size_type n_instances) {
+    return sizeof(T) * n_instances;
+  }
+
+  /*! \brief Jump to a location in the file to read
+   *
+   * \param point The point (in bytes) where you want to jump
+   */
+  void rjump_to(std::streampos point) {
+    if (closed)
+      throw std::domain_error("Can't jump and read closed file!");
+    if (point > size())
+      throw std::domain_error("Can't jump and read past EOF!");
+    fs.seekg(point);
+  }
+
+  /*! \brief Jump to a location in the file to write
+   *
+   * The only difference I found between seekg and seekp is
+   * that the former doesn't allow you to read past EOF.
+   *
+   * \param point The point (in bytes) where you want to jump
+   */
+  void wjump_to(std::streampos point) {
+    if (closed)
+      throw std::domain_error("Can't jump and write on closed file!");
+    fs.seekp(point);
+  }
+
+  // Getters
+
+  /*! \brief Get the size of the file
+   *
+   * \return It returns the size of the file handled.
+   */
+  size_type size() {
+    if (closed)
+      throw std::domain_error("Can't tell size of closed file!");
+    auto p = fs.tellp();
+    fs.seekp(0, std::ios::end);
+    auto sz = fs.tellp();
+    fs.seekp(p);
+    return sz;
+  }
+  
+  /*! \brief Get the position you ar currently on (write)
+   *
+   * \param It returns the current position for writing.
+   */
+  size_type wpos() { return fs.tellp(); }
+
+  /*! \brief Get the position you ar currently on (read)
+   *
+   * It seems to be identical to the write version
+   * \param It returns the current position for reading. */
+  size_type rpos() { return fs.tellg(); }
+
+  /*! \brief Move by a certain number of steps, forward or backward.
+   *
+   * The size of the step is deduced by the type specified
+   * \tparam T The type used to determine the size of a step
+   * \param n_steps The number of steps
+   */
+  template <typename T = char>
+  void wmove_by(std::streamoff n_steps) { fs.seekp(bytes<T>(n_steps), std::ios::cur); }
+
+  /*! \brief Move by a certain number of steps, forward or backward.
+   *
+   * The size of the step is deduced by the type specified
+   * \tparam T The type used to determine the size of a step
+   * \param n_steps The number of steps
+   */
+  template <typename T = char>
+  void rmove_by(std::streamoff n_steps) { fs.seekg(bytes<T>(n_steps), std::ios::cur); }
+
+  /***********
+   * WRITING *
+   ***********/
+
+  /*! \brief Write a value in the current position
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   */
+  template <typename T> void write(T val) {
+    if (closed)
+      throw std::domain_error("Can't write on closed file!");
+    if (mode == Mode::read_only)
+      throw std::domain_error("Can't write on read-only file!");
+    char *buf = reinterpret_cast<char*>(&val);
+    if (opposite_endian) std::reverse(buf, buf + sizeof(T));
+    fs.write(buf, sizeof(T));
+    check_stream("Couldn't write file!");
+  }
+
+  /*! \brief Write multiple values starting from the current position
+   *         given two iterators.
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input iterators. It is deduced from the
+   * iterators assigned.
+   * \endparblock
+   * \param begit The beginning interator
+   * \param endit The ending interator
+   */
+  template <typename T> void write_many(T begit, T endit) {
+    for (auto it = begit; it != endit; ++it)
+      write(*it);
+  }
+
+  /*! \brief Write multiple values starting from the current position
+   *         given two iterators.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K The type used to interpret bytes of the output values
+   * \tparam T
+   * \parblock
+   * The type of the input iterators. It is deduced from the
+   * iterators assigned
+   * \endparblock
+   * \param begit The beginning interator
+   * \param endit The ending interator
+   */
+  template <typename K, typename T> void write_many(T begit, T endit) {
+    for (auto it = begit; it != endit; ++it)
+      write<K>(*it);
+  }
+
+  /*! \brief Write multiple values starting from the current position
+   *         given an initializer list.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K
+   * \parblock
+   * The type used to interpret bytes of the output values. If
+   * omitted it is used T by default
+   * \endparblock
+   * \tparam T
+   * \parblock
+   * The type of the input values. It is deduced from the
+   * values assigned
+   * \endparblock
+   * \param il The initializer list
+   */
+  template <typename K = Bin::TypeNotSpecified, typename T> void write_many(const std::initializer_list<T> &il) {
+    /*
+    // IN C++17 I WOULD HAVE DONE THE FOLLOWING
+    if constexpr(std::is_same<K, Bin::TypeNotSpecified>::value) {
+	    write_many(std::begin(il), std::end(il));
+    } else {
+	    write_many<K>(std::begin(il), std::end(il));
+    }
+    */
+    is_initializer_list_cast_specified<K, T>(std::integral_constant<bool, std::is_same<K, Bin::TypeNotSpecified>::value>{}, il);
+  }
+
+  /*! \brief Write multiple values starting from the current position
+   *         given a container.
+   *
+   * \tparam T
+   * \parblock
+   * The type of the container. It is deduced from the
+   * container assigned. The type handled by the container is
+   * used to interpret bytes of the output values
+   * \endparblock
+   * \param vals The container
+   */
+  template <typename T>
+  void write_many(const T &vals) {
+    for (auto it = std::begin(vals); it != std::end(vals); ++it)
+      write(*it);
+  }
+
+
+  /*! \brief Write multiple values starting from the current position
+   *         given a container.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K The type used to interpret bytes of the output values
+   * \tparam T
+   * \parblock
+   * The type of the container. It is deduced from the
+   * container assigned
+   * \endparblock
+   * \param vals The container
+   */
+  template <typename K, typename T>
+  void write_many(const T &vals) {
+    for (auto it = std::begin(vals); it != std::end(vals); ++it)
+      write<K>(*it);
+  }
+
+  /**************************************
+   * Specify the location where to write*
+   **************************************/
+  // Check the functions above for details
+ 
+
+  /*! \brief Write a value in the specified position
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   * \param p The position where you want to write
+   */
+  template <typename T> void write(T val, size_type p) {
+    wjump_to(p);
+    write(val);
+  }
+
+
+  /*! \brief Write multiple values starting from the specified position
+   *         given an initializer list.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K
+   * \parblock
+   * The type used to interpret bytes of the output values. If
+   * omitted it is used T by default
+   * \endparblock
+   * \tparam T
+   * \parblock
+   * The type of the input values. It is deduced from the
+   * values assigned
+   * \endparblock
+   * \param il The initializer list
+   * \param p The position where you want to write
+   */
+  template <typename K = Bin::TypeNotSpecified, typename T> void write_many(const std::initializer_list<T> &il, size_type p) {
+    wjump_to(p);
+    write_many<K>(il);
+  }
+
+
+  /*! \brief Write multiple values starting from the specified position
+   *         given two iterators.
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input iterators. It is deduced from the
+   * iterators assigned.
+   * \endparblock
+   * \param begit The beginning interator
+   * \param endit The ending interator
+   * \param p The position where you want to write
+   */
+  template <typename T> void write_many(T begit, T endit, size_type p) {
+    wjump_to(p);
+    write_many(begit, endit);
+  }
+
+
+  /*! \brief Write multiple values starting from the specified position
+   *         given two iterators.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K The type used to interpret bytes of the output values
+   * \tparam T
+   * \parblock
+   * The type of the input iterators. It is deduced from the
+   * iterators assigned
+   * \endparblock
+   * \param begit The beginning interator
+   * \param endit The ending interator
+   * \param p The position where you want to write
+   */
+  template <typename K, typename T> void write_many(T begit, T endit, size_type p) {
+    wjump_to(p);
+    write_many<K>(begit, endit);
+  }
+
+
+  /*! \brief Write multiple values starting from the specified position
+   *         given a container.
+   *
+   * \tparam T
+   * \parblock
+   * The type of the container. It is deduced from the
+   * container assigned. The type handled by the container is
+   * used to interpret bytes of the output values
+   * \endparblock
+   * \param vals The container
+   * \param p The position where you want to write
+   */
+  template <typename T>
+  void write_many(const T &vals, size_type p) {
+    wjump_to(p);
+    for (auto it = std::begin(vals); it != std::end(vals); ++it)
+      write(*it);
+  }
+
+
+  /*! \brief Write multiple values starting from the specified position
+   *         given a container.
+   *
+   * If you want, this implementation allows you to specify the
+   * type you want to cast the values to
+   * \tparam K The type used to interpret bytes of the output values
+   * \tparam T
+   * \parblock
+   * The type of the container. It is deduced from the
+   * container assigned
+   * \endparblock
+   * \param vals The container
+   * \param p The position where you want to write
+   */
+  template <typename K, typename T>
+  void write_many(const T &vals, size_type p) {
+    wjump_to(p);
+    for (auto it = std::begin(vals); it != std::end(vals); ++it)
+      write<K>(*it);
+  }
+
+  /*! \brief Assign operator.
+   *
+   * It is used to write a in the file the value assigned
+   * \tparam T
+   * \parblock
+   * The type used to interpret bytes. It is deduced from
+   * the value assigned
+   * \endparblock
+   * \param val The value to write
+   */
+  template <typename T> void operator=(T val) { write(val); }
+
+  /*! \brief Casting operator
+   *
+   * It is used to read from the file a value casted from
+   * a certain type.
+   * \tparam T The type used to interpret bytes
+   */
+  template <typename T> operator T() { return get_value<T>(); }
+
+  /*! \brief Write a string in the current position
+   *
+   * \param s The string you want to write
+   */
+  void write_string(const std::string &s) {
+    if (closed)
+      throw std::domain_error("Can't write string on closed file!");
+    if (mode == Mode::read_only)
+      throw std::domain_error("Can't write string on read-only file!");
+    fs.write(s.data(), bytes<char>(s.size()));
+    check_stream("Couldn't write file!");
+  }
+
+  /*! \brief Write a string in the specified position
+   *
+   * \param s The string you want to write
+   * \param p The position where you want to write
+   */
+  void write_string(const std::string &s, size_type p) {
+    wjump_to(p);
+    write_string(s);
+  }
+
+  /***********
+   * READING *
+   ***********/
+  
+  /*! \brief Read a single value of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \return It returns the value read of type T
+   */
+  template <typename T = unsigned char> T get_value() {
+    if (closed)
+      throw std::domain_error("Can't read from closed file!");
+    if (static_cast<decltype(sizeof(T))>(size() - rpos()) < sizeof(T))
+      throw std::runtime_error("Trying to read past EOF!");
+    char buf[sizeof(T)];
+    fs.read(buf, sizeof(T));
+    check_stream("Couldn't read file!");
+    // Floating point values are reversed too, as the writes do
+    if (opposite_endian)
+      std::reverse(&buf[0], &buf[sizeof(T)]);
+    T *d = reinterpret_cast<T*>(buf);
+    return *d;
+  }
+
+  /*! \brief Read multiple values of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n) {
+    return read_vector(n, std::vector<T>());
+  }
+
+  /*! \brief Read multiple values of type T from the current position
+   *         using a custom allocator
+   *
+   * It can be used with an arena, for example with a
+   * std::pmr::polymorphic_allocator over a std::pmr::monotonic_buffer_resource,
+   * so that the results of a request are freed all at once.
+   * \tparam T The type used to interpret bytes
+   * \tparam Alloc The type of the allocator. It is deduced from the allocator assigned
+   * \param n The number of elements of type T you want to read
+   * \param alloc The allocator of the returned vector
+   * \return It returns the values in a std::vector<T, Alloc>
+   */
+  template <typename T = unsigned char, typename Alloc,
+            typename = typename std::enable_if<is_bin_allocator<Alloc>::value>::type>
+  std::vector<T, Alloc> get_values(size_type n, const Alloc &alloc) {
+    return read_vector(n, std::vector<T, Alloc>(alloc));
+  }
 
- public:
-  /*! \brief An empty class.
+
+  /*! \brief Read a single value of type T from the specified position
    *
-   * This class is used as default type for
-   * some template functions and it is used to understand
-   * if the template parameter is omitted.
+   * \tparam T The type used to interpret bytes
+   * \param p The position from where you want to read
+   * \return It returns the value read of type T
    */
-  class TypeNotSpecified {};
+  template <typename T = unsigned char> T get_value(size_type p) {
+    rjump_to(p);
+    return get_value<T>();
+  }
 
-  //! The type used to indicate positions inside the file
-  using size_type = std::streamsize;
+  /*! \brief Read multiple values of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n, size_type p) {
+    rjump_to(p);
+    return get_values<T>(n);
+  }
 
-  /*! \brief The constructor.
+  /*! \brief Read multiple values of type T from the specified position
+   *         using a custom allocator
    *
-   * The destructor of the shared_ptr simply puts the pointer
-   * to 0 in order to avoid infinite loop of destructors
-   * (it would end up destroying itself more than once).
+   * \tparam T The type used to interpret bytes
+   * \tparam Alloc The type of the allocator. It is deduced from the allocator assigned
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \param alloc The allocator of the returned vector
+   * \return It returns the values in a std::vector<T, Alloc>
+   */
+  template <typename T = unsigned char, typename Alloc>
+  std::vector<T, Alloc> get_values(size_type n, size_type p, const Alloc &alloc) {
+    rjump_to(p);
+    return get_values<T>(n, alloc);
+  }
+
+  /*! \brief Read a string from the current location
    *
-   * \param fname             The filename. If the file doesn't exist it is created
-   * \param truncate          If set to true and the file already exists it is cleared. The default value is false.
-   * \param use_little_endian
-   * \parblock
-   * Decide if you want to read/write in little_endian.
-   * By default it is set to the default endianness of the machine.
-   * \endparblock
+   * \param len The length of the string to read
+   * \return It returns the string read
    */
-  explicit Bin(const std::string &fname, bool truncate = false, bool use_little_endian = Bin::is_default_little_endian()) :
-      filename(fname), sptr(this, [] (Bin *p) { return p = 0; }) {
-    opposite_endian = use_little_endian != Bin::is_default_little_endian();
-    struct stat buffer;
-    bool already_exists = stat(filename.c_str(), &buffer) == 0;
-    if (truncate || !already_exists)
-      // Files are opened this way because otherwise the seekp
-      // function wouldn't work.
-      fs.open(filename,
-               std::ios::out |
-               std::ios::in |
-               std::ios::ate | std::ios::trunc);
-    else
-      fs.open(filename,
-               std::ios::out |
-               std::ios::in |
-               std::ios::ate);
-    if (!fs.good() || !fs.is_open())
-      throw std::domain_error("Couldn't open file!");
+  std::string get_string(std::string::size_type len) {
+    return read_string(len, std::string());
+  }
 
-    rjump_to(0);
+  /*! \brief Read a string from the current location using a custom allocator
+   *
+   * \tparam Alloc The type of the allocator. It is deduced from the allocator assigned
+   * \param len The length of the string to read
+   * \param alloc The allocator of the returned string
+   * \return It returns the string read
+   */
+  template <typename Alloc, typename = typename std::enable_if<is_bin_allocator<Alloc>::value>::type>
+  std::basic_string<char, std::char_traits<char>, Alloc> get_string(std::string::size_type len, const Alloc &alloc) {
+    return read_string(len, std::basic_string<char, std::char_traits<char>, Alloc>(alloc));
   }
 
-  /*! \brief Tells if the machine is little endian or big endian
+  /*! \brief Read a string from the specified location
    *
-   * \return It returns a bool:\n 
-   * \reutrn true:  The machine uses little endian\n 
-   * \return false: The machine uses big endian
+   * \param len The length of the string to read
+   * \param p The position from where you want to read
+   * \return It returns the string read
    */
-  static bool is_default_little_endian() {
-    short int n = 1;
-    char *address = reinterpret_cast<char*>(&n);
-    if (*(address + 1) == 1) return false;
-    else if (*address == 1) return true;
-    throw std::domain_error("Can't detect endianness of the machine!");
+  std::string get_string(std::string::size_type len, size_type p) {
+    rjump_to(p);
+    return get_string(len);
   }
 
-  /*! \brief Compute the bytes occupied by instances of a given type
-   * 
-   * \tparam T The type used to determine the size of an instance of type T
-   * \param n_instances The number of instances of an object of type T
-   * \return It returns the number of bytes occupied by n_instances instances of T
+  /*! \brief Read a string from the specified location using a custom allocator
+   *
+   * \tparam Alloc The type of the allocator. It is deduced from the allocator assigned
+   * \param len The length of the string to read
+   * \param p The position from where you want to read
+   * \param alloc The allocator of the returned string
+   * \return It returns the string read
    */
-  template <typename T> static constexpr size_type bytes(size_type n_instances) {
-    return sizeof(T) * n_instances;
+  template <typename Alloc>
+  std::basic_string<char, std::char_traits<char>, Alloc> get_string(std::string::size_type len, size_type p, const Alloc &alloc) {
+    rjump_to(p);
+    return get_string(len, alloc);
   }
 
-  /*! \brief Jump to a location in the file to read
+  /**********************
+   * NON-THROWING CALLS *
+   **********************/
+  // They never throw and report failures through Status.
+  // The bounds are checked once per call, so reading a
+  // batch of n values costs a single check.
+
+  /*! \brief Read multiple values of type T from the current position
+   *         into a buffer without throwing
    *
-   * \param point The point (in bytes) where you want to jump
+   * If the values don't fit before EOF nothing is read
+   * and the position is left untouched.
+   * \tparam T The type used to interpret bytes
+   * \param dst The buffer, it must have room for n values
+   * \param n The number of elements of type T you want to read
+   * \return It returns Status::ok on success
    */
-  void rjump_to(std::streampos point) {
+  template <typename T> Status try_get_values_into(T *dst, size_type n) noexcept {
     if (closed)
-      throw std::domain_error("Can't jump and read closed file!");
-    if (point > size())
-      throw std::domain_error("Can't jump and read past EOF!");
-    fs.seekg(point);
+      return Status::closed;
+    size_type left = bytes_left();
+    if (left < 0)
+      return Status::io_error;
+    if (left < bytes<T>(n))
+      return Status::eof;
+    if (!fs.read(reinterpret_cast<char*>(dst), bytes<T>(n))) {
+      return stream_failed();
+    }
+    fix_read_endianness(dst, n);
+    return Status::ok;
   }
 
-  /*! \brief Jump to a location in the file to write
+  /*! \brief Read multiple values of type T from the specified position
+   *         into a buffer without throwing
    *
-   * The only difference I found between seekg and seekp is
-   * that the former doesn't allow you to read past EOF.
+   * If the call fails the position is left untouched.
+   * \tparam T The type used to interpret bytes
+   * \param dst The buffer, it must have room for n values
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_get_values_into(T *dst, size_type n, size_type p) noexcept {
+    if (closed)
+      return Status::closed;
+    size_type old = fs.tellg();
+    Status s = try_rjump_to(p);
+    if (s == Status::ok)
+      s = try_get_values_into(dst, n);
+    if (s != Status::ok && old >= 0) {
+      fs.clear();
+      fs.seekg(old);
+    }
+    return s;
+  }
+
+  /*! \brief Read a single value of type T from the current position
+   *         without throwing
    *
-   * \param point The point (in bytes) where you want to jump
+   * \tparam T The type used to interpret bytes
+   * \param val Where the value read is stored
+   * \return It returns Status::ok on success
    */
-  void wjump_to(std::streampos point) {
+  template <typename T> Status try_get_value(T &val) noexcept {
+    return try_get_values_into(&val, 1);
+  }
+
+  /*! \brief Read a single value of type T from the specified position
+   *         without throwing
+   *
+   * \tparam T The type used to interpret bytes
+   * \param val Where the value read is stored
+   * \param p The position from where you want to read
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_get_value(T &val, size_type p) noexcept {
+    return try_get_values_into(&val, 1, p);
+  }
+
+  /*! \brief Read multiple values of type T from the specified position
+   *         into a buffer without throwing and without moving the position
+   *
+   * It is safe to call it from many threads at the same time, see window().
+   * \tparam T The type used to interpret bytes
+   * \param dst The buffer, it must have room for n values
+   * \param n The number of elements of type T you want to read
+   * \param p The position from where you want to read
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_get_values_at(T *dst, size_type n, size_type p) noexcept {
+    return read_shared(dst, n, p);
+  }
+
+  /*! \brief Write a value in the current position without throwing
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_write(T val) noexcept {
     if (closed)
-      throw std::domain_error("Can't jump and write on closed file!");
-    fs.seekp(point);
+      return Status::closed;
+    if (mode == Mode::read_only)
+      return Status::read_only;
+    char *buf = reinterpret_cast<char*>(&val);
+    if (opposite_endian) std::reverse(buf, buf + sizeof(T));
+    if (!fs.write(buf, sizeof(T))) {
+      return stream_failed();
+    }
+    return Status::ok;
   }
 
-  // Getters
+  /*! \brief Write a value in the specified position without throwing
+   *
+   * If the call fails the position is left untouched.
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   * \param p The position where you want to write
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_write(T val, size_type p) noexcept {
+    return try_write_many(&val, 1, p);
+  }
 
-  /*! \brief Get the size of the file
+  /*! \brief Write multiple values starting from the current position
+   *         with a single write, without throwing
    *
-   * \return It returns the size of the file handled.
+   * \tparam T The type of the values
+   * \param src The values
+   * \param n The number of values
+   * \return It returns Status::ok on success
    */
-  size_type size() {
+  template <typename T> Status try_write_many(const T *src, size_type n) noexcept {
+    return write_block(src, n);
+  }
+
+  /*! \brief Write multiple values starting from the specified position
+   *         with a single write, without throwing
+   *
+   * If the call fails the position is left untouched.
+   * \tparam T The type of the values
+   * \param src The values
+   * \param n The number of values
+   * \param p The position where you want to write
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Status try_write_many(const T *src, size_type n, size_type p) noexcept {
     if (closed)
-      throw std::domain_error("Can't tell size of closed file!");
-    auto p = fs.tellp();
-    fs.seekp(0, std::ios::end);
-    auto sz = fs.tellp();
-    fs.seekp(p);
-    return sz;
+      return Status::closed;
+    size_type old = fs.tellp();
+    Status s = fs.seekp(p) ? write_block(src, n) : stream_failed();
+    if (s != Status::ok && old >= 0) {
+      fs.clear();
+      fs.seekp(old);
+    }
+    return s;
   }
-  
-  /*! \brief Get the position you ar currently on (write)
+
+  /*! \brief Flush the buffer
+   *
+   * \exception std::runtime_error If the buffer or a layer (like a mirror) couldn't write
+   */
+  void flush() {
+    fs.flush();
+    check_stream("Couldn't write file!");
+  }
+
+  /*! \brief Close the file
+   *
+   * The file is closed even if the last flush fails.
+   * \exception std::runtime_error If the buffer or a layer (like a mirror) couldn't write
+   */
+  void close() {
+    fs.flush();
+    bool ok = !fs.fail();
+    std::string why = ok ? std::string() : LayerBuf::take_failure();
+    fs.clear();
+    fs.rdbuf(nullptr);
+    buf.reset();
+    if (base_fd >= 0)
+      ::close(base_fd);
+    base_fd = -1;
+    base = nullptr;
+    dirty = nullptr;
+    cipher = nullptr;
+    closed = true;
+    if (!ok)
+      throw std::runtime_error(why.empty() ? "Couldn't write file!" : why);
+  }
+
+  /*! \brief Write the content of an in-memory file to its file, in a single write */
+  void save() { save(filename); }
+
+  /*! \brief Write the content of an in-memory file to a file, in a single write
+   *
+   * The file is replaced atomically and durably, through a synced
+   * temporary file. The nonce of an encrypted file is written first,
+   * to fname + ".nonce".
+   * \param fname The filename. If the file already exists it is replaced
+   */
+  void save(const std::string &fname) {
+    if (closed)
+      throw std::domain_error("Can't save closed file!");
+    if (mode != Mode::in_memory)
+      throw std::domain_error("Only in-memory files can be saved!");
+    if (fname.empty())
+      throw std::domain_error("The file has no name!");
+    // The new file can't be decrypted without its nonce
+    if (cipher)
+      save_nonce(fname + ".nonce", cipher->nonce());
+    static_cast<MemoryBuf*>(base)->save(fname);
+  }
+
+  /*! \brief Get the filename
+   *
+   * \return It returns the file name
+   */
+  std::string get_filename() const { return filename; }
+
+  /*! \brief Tells the endianness used to read and write the file
+   *
+   * \return It returns true if the file is read and written in little endian
+   */
+  bool is_little_endian() const { return opposite_endian != is_default_little_endian(); }
+
+  /*! \brief Get the shared mapping of a file opened in read-only mode
+   *
+   * The mapping can be read by many threads at the same time without
+   * any lock, while the cursor of a Bin must not be shared between threads.
+   * \return It returns the beginning of the file in memory, or nullptr
+   *         if the file isn't opened in read-only mode (or it is empty)
+   */
+  const char *data() const {
+    if (closed || mode != Mode::read_only)
+      return nullptr;
+    return static_cast<const MappedBuf*>(base)->data();
+  }
+
+  /*! \brief Read many whole files in parallel
+   *
+   * Each worker thread opens one file at a time, reads it with a single
+   * sized read into a buffer of its own and hands it to per_file_fn. So
+   * at most threads files are open at the same time. If a file can't be
+   * read, or per_file_fn throws, the remaining files are skipped and the
+   * first exception is rethrown.
+   * \param paths The filenames
+   * \param per_file_fn
+   * \parblock
+   * The function called with the index of the file in paths, its content
+   * and its size. It is called concurrently by the worker threads and the
+   * content is valid only during the call.
+   * \endparblock
+   * \param threads The number of worker threads. If 0 (the default) it is the number of cores
+   */
+  static void read_many_files(const std::vector<std::string> &paths,
+                              const std::function<void(std::size_t, const char*, size_type)> &per_file_fn,
+                              unsigned threads = 0) {
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, std::max<std::size_t>(1, paths.size()));
+    std::atomic<std::size_t> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]() {
+      std::vector<char> content;
+      for (std::size_t i = next++; i < paths.size(); i = next++) {
+        try {
+          int fd = ::open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+          if (fd < 0)
+            throw std::domain_error("Couldn't open file " + paths[i] + "!");
+          struct stat st;
+          if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::domain_error("Couldn't open file " + paths[i] + "!");
+          }
+          content.resize(st.st_size);
+          size_type done = 0;
+          while (done < st.st_size) {
+            ssize_t r = pread(fd, content.data() + done, st.st_size - done, done);
+            if (r <= 0) {
+              ::close(fd);
+              throw std::runtime_error("Couldn't read file " + paths[i] + "!");
+            }
+            done += r;
+          }
+          ::close(fd);
+          per_file_fn(i, content.data(), done);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mutex);
+          if (!error)
+            error = std::current_exception();
+          next = paths.size();
+        }
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+      t.join();
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+  /*! \brief Limit the bulk operations on the file
+   *
+   * The bulk operations (like copy_to or the background writes of a
+   * BinScheduler) are split in chunks paced by the limiter, while the
+   * single reads and writes are never limited. A limiter can be shared
+   * by many files to limit them as a group.
+   * \param limiter The limiter, or nullptr to remove it
+   */
+  void set_rate_limiter(std::shared_ptr<RateLimiter> limiter) { rate = std::move(limiter); }
+
+  /*! \brief Get the limiter of the bulk operations
+   *
+   * \return It returns the limiter, or nullptr if there isn't any
+   */
+  std::shared_ptr<RateLimiter> rate_limiter() const { return rate; }
+
+  /*! \brief Copy a range of the file to another file
+   *
+   * The copy is done in large chunks paced by the limiters of both files,
+   * if any, with positional reads and writes, so the positions of both
+   * files are left untouched. The destination can be this file: the
+   * ranges may overlap, and the result is the one of memmove.
+   * \param dst The destination file
+   * \param first The position of the first byte to copy
+   * \param len The number of bytes to copy
+   * \param p The position where to write in the destination file
+   * \exception std::domain_error If len is negative
+   * \exception std::runtime_error If the range goes past EOF or the copy fails
+   */
+  void copy_to(Bin &dst, size_type first, size_type len, size_type p) {
+    if (len < 0)
+      throw std::domain_error("The length can't be negative!");
+    if (size() - first < len || first < 0)
+      throw std::runtime_error("Trying to read past EOF!");
+    size_type chunk = std::min(rate ? rate->chunk_bytes() : 1 << 20,
+                               dst.rate ? dst.rate->chunk_bytes() : 1 << 20);
+    std::vector<char> stage(std::min(chunk, len));
+    // Copying forward over the source itself would overwrite bytes not read yet
+    const bool backward = &dst == this && p > first && p < first + len;
+    for (size_type done = 0; done < len; done += chunk) {
+      size_type k = std::min(chunk, len - done);
+      size_type off = backward ? len - done - k : done;
+      pace(k);
+      if (dst.rate != rate)
+        dst.pace(k);
+      if (read_shared(stage.data(), k, first + off) != Status::ok)
+        throw std::runtime_error("Couldn't read file!");
+      if (dst.write_shared(stage.data(), k, p + off) != Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+    }
+  }
+
+  /*! \brief Write the same value many times from the specified position
+   *
+   * The values are written in large chunks from a staging buffer. For a
+   * value made of zero bytes, in a file opened in read-write mode without
+   * layers, no data is written: the file is extended with ftruncate and
+   * the range inside it is zeroed with fallocate, where available.
+   * \tparam T The type of the value
+   * \param value The value
+   * \param count The number of values
+   * \param p The position where you want to write
+   */
+  template <typename T> void fill(T value, size_type count, size_type p) {
+    wjump_to(p);
+    fill(value, count);
+  }
+
+  /*! \brief Write the same value many times from the current position
+   *
+   * \tparam T The type of the value
+   * \param value The value
+   * \param count The number of values
+   */
+  template <typename T> void fill(T value, size_type count) {
+    static const char zeros[sizeof(T)] = {};
+    if (std::memcmp(&value, zeros, sizeof(T)) == 0 && zero_range(bytes<T>(count)))
+      return;
+    write_generated<T>(count, [value](T *stage, size_type k) { std::fill(stage, stage + k, value); });
+  }
+
+  /*! \brief Write increasing values, like std::iota, from the specified position
+   *
+   * \tparam T The type of the values
+   * \param start The first value, which is incremented for each of the following ones
+   * \param count The number of values
+   * \param p The position where you want to write
+   */
+  template <typename T> void iota(T start, size_type count, size_type p) {
+    wjump_to(p);
+    iota(start, count);
+  }
+
+  /*! \brief Write increasing values, like std::iota, from the current position
+   *
+   * \tparam T The type of the values
+   * \param start The first value, which is incremented for each of the following ones
+   * \param count The number of values
+   */
+  template <typename T> void iota(T start, size_type count) {
+    write_generated<T>(count, [&start](T *stage, size_type k) {
+      for (size_type i = 0; i != k; ++i)
+        stage[i] = start++;
+    });
+  }
+
+  /*! \brief Write the values returned by a function, like std::generate, from the specified position
+   *
+   * \tparam T The type of the values
+   * \tparam G The type of the function. It is deduced from the function assigned
+   * \param gen The function, called once for each value, in order
+   * \param count The number of values
+   * \param p The position where you want to write
+   */
+  template <typename T, typename G> void generate(G gen, size_type count, size_type p) {
+    wjump_to(p);
+    generate<T>(gen, count);
+  }
+
+  /*! \brief Write the values returned by a function, like std::generate, from the current position
    *
-   * \param It returns the current position for writing.
+   * \tparam T The type of the values
+   * \tparam G The type of the function. It is deduced from the function assigned
+   * \param gen The function, called once for each value, in order
+   * \param count The number of values
    */
-  size_type wpos() { return fs.tellp(); }
+  template <typename T, typename G> void generate(G gen, size_type count) {
+    write_generated<T>(count, [&gen](T *stage, size_type k) {
+      for (size_type i = 0; i != k; ++i)
+        stage[i] = gen();
+    });
+  }
 
-  /*! \brief Get the position you ar currently on (read)
+  /*! \brief Encrypt the file at rest with AES in XTS mode
    *
-   * It seems to be identical to the write version
-   * \param It returns the current position for reading. */
-  size_type rpos() { return fs.tellg(); }
-
-  /*! \brief Move by a certain number of steps, forward or backward.
+   * From now on every byte is decrypted when read and encrypted when
+   * written, so it must be called right after opening the file (an
+   * in-memory file is saved encrypted). Only the blocks of 16 bytes
+   * touched are processed, so random access stays cheap. See EncryptBuf.
    *
-   * The size of the step is deduced by the type specified
-   * \tparam T The type used to determine the size of a step
-   * \param n_steps The number of steps
+   * Each file gets its own random nonce, mixed into the tweaks, so
+   * files encrypted with the same key never encrypt a block the same
+   * way. The nonce is not secret and is kept in the side file
+   * get_filename() + ".nonce": an empty file gets a new nonce, which
+   * durably replaces the side file before any data is written, while a
+   * file with data reads it back (and is refused if it is missing,
+   * since it couldn't be decrypted). save(fname) writes the nonce next
+   * to the new file too.
+   * \param key The key of the file, 32, 48 or 64 bytes long (two AES-128, AES-192 or AES-256 keys, which must differ)
    */
-  template <typename T = char>
-  void wmove_by(std::streamoff n_steps) { fs.seekp(bytes<T>(n_steps), std::ios::cur); }
+  void enable_encryption(const std::string &key) {
+    const std::string side = filename.empty() ? std::string() : filename + ".nonce";
+    std::uint64_t nonce = 0;
+    if (size() > 0) {
+      struct stat st;
+      if (side.empty() || stat(side.c_str(), &st) != 0)
+        throw std::domain_error("The nonce of the encrypted file is missing!");
+      MemoryBuf mb;
+      mb.load(side);
+      if (mb.sgetn(reinterpret_cast<char*>(&nonce), sizeof(nonce)) != sizeof(nonce))
+        throw std::runtime_error("Corrupted nonce file " + side + "!");
+    } else {
+      std::random_device rd;
+      nonce = (static_cast<std::uint64_t>(rd()) << 32) ^ rd();
+    }
+    std::unique_ptr<EncryptBuf> layer(new EncryptBuf(key, nonce));
+    if (size() == 0 && !side.empty() && mode != Mode::read_only)
+      save_nonce(side, nonce);
+    cipher = &add_layer(std::move(layer));
+  }
 
-  /*! \brief Move by a certain number of steps, forward or backward.
+  /*! \brief Encrypt the file at rest with AES in XTS mode, with a nonce managed by the caller
    *
-   * The size of the step is deduced by the type specified
-   * \tparam T The type used to determine the size of a step
-   * \param n_steps The number of steps
+   * See enable_encryption(const std::string&). Reusing a nonce with the
+   * same key for two files reveals which blocks they have in common at
+   * the same positions.
+   * \param key The key of the file, 32, 48 or 64 bytes long (two AES-128, AES-192 or AES-256 keys, which must differ)
+   * \param nonce The nonce, unique for each file using the same key
    */
-  template <typename T = char>
-  void rmove_by(std::streamoff n_steps) { fs.seekg(bytes<T>(n_steps), std::ios::cur); }
+  void enable_encryption(const std::string &key, std::uint64_t nonce) {
+    add_layer(std::unique_ptr<EncryptBuf>(new EncryptBuf(key, nonce)));
+  }
 
-  /***********
-   * WRITING *
-   ***********/
+  /*! \brief Verify the integrity of the file with CRC32C block checksums
+   *
+   * The checksums are kept in the side table get_filename() + ".crc"
+   * (in memory only, for an in-memory file without a name). If the
+   * table doesn't exist it is built from the current content. The
+   * reads touching a corrupted block throw std::runtime_error (or
+   * return Status::io_error), and each clean block is verified only once.
+   * \param block_bytes The size of a block. The default value is 4 KiB
+   * \return It returns the layer, which tells how many blocks have been verified
+   */
+  const ChecksumBuf &enable_checksums(size_type block_bytes = 1 << 12) {
+    std::string table = filename.empty() ? std::string() : filename + ".crc";
+    return add_layer(std::unique_ptr<ChecksumBuf>(new ChecksumBuf(table, block_bytes)));
+  }
 
-  /*! \brief Write a value in the current position
+  /*! \brief Hash a range of the file
    *
-   * \tparam T
-   * \parblock
-   * The type of the input value. It is deduced from the
-   * value assigned
-   * \endparblock
-   * \param val The value you want to write
+   * The range is split in chunks of 1 MiB, hashed in parallel with
+   * xxhash64(), and the result is the xxhash64() of the hashes of the
+   * chunks (little endian) followed by the length of the range. So it
+   * doesn't depend on the number of threads. A file opened in read-only
+   * mode, without layers, is hashed straight from its mapping; otherwise
+   * the reads are serialized while the hashing runs in parallel. The
+   * position in the file is preserved.
+   * \param first The position of the first byte
+   * \param len The number of bytes
+   * \param threads The number of threads. If 0 (the default) it is the number of cores
+   * \return It returns the hash of the range
    */
-  template <typename T> void write(T val) {
+  std::uint64_t hash_region(size_type first, size_type len, unsigned threads = 0) {
     if (closed)
-      throw std::domain_error("Can't write on closed file!");
-    char *buf = reinterpret_cast<char*>(&val);
-    if (opposite_endian) std::reverse(buf, buf + sizeof(T));
-    fs.write(buf, sizeof(T));
+      throw std::domain_error("Can't hash closed file!");
+    if (first < 0 || len < 0 || size() - first < len)
+      throw std::runtime_error("Trying to read past EOF!");
+    const size_type chunk = 1 << 20;
+    const std::size_t n_chunks = (len + chunk - 1) / chunk;
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, std::max<std::size_t>(1, n_chunks));
+    std::vector<char> digests(8 * n_chunks + 8);
+    std::atomic<std::size_t> next(0);
+    std::atomic<bool> failed(false);
+    const char *mapped = buf.get() == base ? data() : nullptr;
+
+    auto worker = [&]() {
+      std::vector<char> stage(mapped ? 0 : std::min(chunk, len));
+      for (std::size_t c = next++; c < n_chunks; c = next++) {
+        size_type p = first + c * chunk, k = std::min(chunk, first + len - p);
+        const char *bytes = mapped ? mapped + p : stage.data();
+        if (!mapped && read_shared(stage.data(), k, p) != Status::ok) {
+          failed = true;
+          return;
+        }
+        std::uint64_t h = xxhash64(bytes, k);
+        for (int i = 0; i != 8; ++i)
+          digests[8 * c + i] = static_cast<char>(h >> (8 * i));
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool)
+      t.join();
+    if (failed)
+      throw std::runtime_error("Couldn't read file!");
+    for (int i = 0; i != 8; ++i)
+      digests[8 * n_chunks + i] = static_cast<char>(static_cast<std::uint64_t>(len) >> (8 * i));
+    return xxhash64(digests.data(), digests.size());
   }
 
-  /*! \brief Write multiple values starting from the current position
-   *         given two iterators.
+  /*! \brief Hash the whole file
    *
-   * \tparam T
-   * \parblock
-   * The type of the input iterators. It is deduced from the
-   * iterators assigned.
-   * \endparblock
-   * \param begit The beginning interator
-   * \param endit The ending interator
+   * \param threads The number of threads. If 0 (the default) it is the number of cores
+   * \return It returns the hash of the file, see hash_region()
    */
-  template <typename T> void write_many(T begit, T endit) {
-    for (auto it = begit; it != endit; ++it)
-      write(*it);
-  }
+  std::uint64_t hash(unsigned threads = 0) { return hash_region(0, size(), threads); }
 
-  /*! \brief Write multiple values starting from the current position
-   *         given two iterators.
+  /*! \brief Keep the most accessed regions of the file in memory
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K The type used to interpret bytes of the output values
-   * \tparam T
-   * \parblock
-   * The type of the input iterators. It is deduced from the
-   * iterators assigned
-   * \endparblock
-   * \param begit The beginning interator
-   * \param endit The ending interator
+   * Reads of the resident regions are served from memory, while writes
+   * go through to the file. The regions are ordinary heap memory, so
+   * under memory pressure the kernel may swap them out like any other
+   * page. Only with lock_memory set to true (which needs a large enough
+   * RLIMIT_MEMLOCK) are they guaranteed to stay in RAM.
+   * \param budget_bytes The maximum number of bytes kept in memory
+   * \param region_bytes The size of a region. The default value is 64 KiB
+   * \param lock_memory If set to true the resident regions are locked in RAM with mlock. The default value is false
+   * \param promote_hits The number of accesses needed to promote a region. The default value is 4
+   * \return It returns the layer, which tells how many bytes are resident
    */
-  template <typename K, typename T> void write_many(T begit, T endit) {
-    for (auto it = begit; it != endit; ++it)
-      write<K>(*it);
+  const TierBuf &enable_tiering(size_type budget_bytes, size_type region_bytes = 1 << 16,
+                                bool lock_memory = false, unsigned promote_hits = 4) {
+    return add_layer(std::unique_ptr<TierBuf>(new TierBuf(budget_bytes, region_bytes, lock_memory, promote_hits)));
   }
 
-  /*! \brief Write multiple values starting from the current position
-   *         given an initializer list.
+  /*! \brief Track the blocks written, for incremental backups and syncs
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K
-   * \parblock
-   * The type used to interpret bytes of the output values. If
-   * omitted it is used T by default
-   * \endparblock
-   * \tparam T
-   * \parblock
-   * The type of the input values. It is deduced from the
-   * values assigned
-   * \endparblock
-   * \param il The initializer list
+   * The blocks written are kept in a bitmap saved in the side table
+   * get_filename() + ".dirty" (in memory only, for an in-memory file
+   * without a name). When the table doesn't exist, or the file was changed
+   * while it wasn't tracked, every block is considered written.
+   * \param block_bytes The size of a block. The default value is 4 KiB
+   * \return It returns the layer, which tells the token of the last checkpoint
    */
-  template <typename K = Bin::TypeNotSpecified, typename T> void write_many(const std::initializer_list<T> &il) {
-    /*
-    // IN C++17 I WOULD HAVE DONE THE FOLLOWING
-    if constexpr(std::is_same<K, Bin::TypeNotSpecified>::value) {
-	    write_many(std::begin(il), std::end(il));
-    } else {
-	    write_many<K>(std::begin(il), std::end(il));
-    }
-    */
-    is_initializer_list_cast_specified<K, T>(std::integral_constant<bool, std::is_same<K, Bin::TypeNotSpecified>::value>{}, il);
+  const DirtyBuf &enable_dirty_tracking(size_type block_bytes = 1 << 12) {
+    std::string table = filename.empty() ? std::string() : filename + ".dirty";
+    dirty = &add_layer(std::unique_ptr<DirtyBuf>(new DirtyBuf(table, block_bytes)));
+    return *dirty;
   }
 
-  /*! \brief Write multiple values starting from the current position
-   *         given a container.
+  /*! \brief Forget the blocks written so far
    *
-   * \tparam T
-   * \parblock
-   * The type of the container. It is deduced from the
-   * container assigned. The type handled by the container is
-   * used to interpret bytes of the output values
-   * \endparblock
-   * \param vals The container
+   * \return It returns the token of the new checkpoint, to be passed to dirty_ranges() later
    */
-  template <typename T>
-  void write_many(const T &vals) {
-    for (auto it = std::begin(vals); it != std::end(vals); ++it)
-      write(*it);
+  std::uint64_t checkpoint() {
+    std::uint64_t ret = tracker().checkpoint();
+    flush();
+    return ret;
   }
 
-
-  /*! \brief Write multiple values starting from the current position
-   *         given a container.
+  /*! \brief Get the ranges written since a checkpoint
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K The type used to interpret bytes of the output values
-   * \tparam T
+   * \param since The token returned by checkpoint()
+   * \return
    * \parblock
-   * The type of the container. It is deduced from the
-   * container assigned
+   * It returns the ranges made of the blocks written, in order and
+   * never adjacent. If there was another checkpoint after the one
+   * requested, the history is lost and it returns the whole file.
    * \endparblock
-   * \param vals The container
    */
-  template <typename K, typename T>
-  void write_many(const T &vals) {
-    for (auto it = std::begin(vals); it != std::end(vals); ++it)
-      write<K>(*it);
-  }
-
-  /**************************************
-   * Specify the location where to write*
-   **************************************/
-  // Check the functions above for details
- 
+  std::vector<BinRange> dirty_ranges(std::uint64_t since) { return tracker().ranges(since); }
 
-  /*! \brief Write a value in the specified position
+  /*! \brief Copy to another file the ranges written since a checkpoint
    *
-   * \tparam T
-   * \parblock
-   * The type of the input value. It is deduced from the
-   * value assigned
-   * \endparblock
-   * \param val The value you want to write
-   * \param p The position where you want to write
+   * The ranges are copied at the same positions with copy_to().
+   * \param dst The destination file, for example a previous copy of this file
+   * \param since The token returned by checkpoint()
+   * \return It returns the number of bytes copied
    */
-  template <typename T> void write(T val, size_type p) {
-    wjump_to(p);
-    write(val);
+  size_type copy_dirty_to(Bin &dst, std::uint64_t since) {
+    flush();
+    size_type ret = 0;
+    for (const BinRange &r : dirty_ranges(since)) {
+      copy_to(dst, r.offset, r.length, r.offset);
+      ret += r.length;
+    }
+    return ret;
   }
 
-
-  /*! \brief Write multiple values starting from the specified position
-   *         given an initializer list.
+  /*! \brief Apply every write to a secondary file too, in the background
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K
+   * The current content is copied to the mirror, then the writes are
+   * queued and applied to it in order by another thread, so they don't
+   * wait for the second device. flush() waits until the mirror has
+   * caught up, and fails if a write to the mirror failed.
+   * \param mirror_name The mirror file. If it already exists it is replaced
+   * \param max_lag_bytes
    * \parblock
-   * The type used to interpret bytes of the output values. If
-   * omitted it is used T by default
-   * \endparblock
-   * \tparam T
-   * \parblock
-   * The type of the input values. It is deduced from the
-   * values assigned
+   * The maximum number of bytes waiting to be mirrored: when they
+   * are exceeded, the writes wait. The default value is 64 MiB
    * \endparblock
-   * \param il The initializer list
-   * \param p The position where you want to write
+   * \return It returns the layer, which tells the current lag
    */
-  template <typename K = Bin::TypeNotSpecified, typename T> void write_many(const std::initializer_list<T> &il, size_type p) {
-    wjump_to(p);
-    write_many<K>(il);
+  const MirrorBuf &enable_mirroring(const std::string &mirror_name, size_type max_lag_bytes = 1 << 26) {
+    return add_layer(std::unique_ptr<MirrorBuf>(new MirrorBuf(mirror_name, max_lag_bytes)));
   }
 
 
-  /*! \brief Write multiple values starting from the specified position
-   *         given two iterators.
+  template <typename T> BinPtr<T> begin();
+  template <typename T> BinPtr<T> end();
+  BinWindow window(size_type offset, size_type length);
+
+ private:
+  std::unique_ptr<std::streambuf> buf;  /*!< \brief The buffer the stream reads from and writes to */
+  std::streambuf *base = nullptr;  /*!< \brief The bottom of the stack of buffers, which
+                                    *          depends on the mode
+                                    */
+  std::iostream fs{nullptr};  /*!< \brief The file stream */
+  int base_fd = -1;  /*!< \brief A descriptor of the file opened in read-write mode, -1 otherwise */
+  const std::string filename;  /*!< \brief The file name */
+  bool closed = false;  /*!< \brief Tells if the file has been closed */
+  std::shared_ptr<Bin> sptr;  /*!< \brief A shared pointer which will point
+                               *          to the instance of the class itself
+                               */
+  bool opposite_endian;  /*!< \brief Tells if the endianness you want to read/write
+                          *          is the opposite of the default one of the machine
+			  */
+  Mode mode = Mode::read_write;  /*!< \brief How the file has been opened */
+  std::mutex shared_mutex;  /*!< \brief Serializes the accesses coming from windows */
+  std::shared_ptr<RateLimiter> rate;  /*!< \brief The limiter of the bulk operations, if any */
+  DirtyBuf *dirty = nullptr;  /*!< \brief The layer tracking the blocks written, if any */
+  EncryptBuf *cipher = nullptr;  /*!< \brief The layer encrypting the file, if its nonce is kept in a side file */
+
+  /*! \brief Write the nonce of an encrypted file to its side file, durably
    *
-   * \tparam T
-   * \parblock
-   * The type of the input iterators. It is deduced from the
-   * iterators assigned.
-   * \endparblock
-   * \param begit The beginning interator
-   * \param endit The ending interator
-   * \param p The position where you want to write
+   * The nonce is written to a temporary file which is synced and renamed
+   * over the side file, then the directory is synced: after a crash the
+   * side file holds either the old nonce or the new one.
+   * \param side The side file
+   * \param nonce The nonce
    */
-  template <typename T> void write_many(T begit, T endit, size_type p) {
-    wjump_to(p);
-    write_many(begit, endit);
+  static void save_nonce(const std::string &side, std::uint64_t nonce) {
+    const std::string tmp = side + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw std::domain_error("Couldn't open file " + tmp + "!");
+    bool ok = ::pwrite(fd, &nonce, sizeof(nonce), 0) == sizeof(nonce) && fdatasync(fd) == 0;
+    if (::close(fd) != 0 || !ok || std::rename(tmp.c_str(), side.c_str()) != 0 || !fsync_parent_dir(side))
+      throw std::runtime_error("Couldn't write file " + side + "!");
   }
 
+  //! \brief Get the layer tracking the blocks written, or throw if there isn't any
+  DirtyBuf &tracker() {
+    if (closed)
+      throw std::domain_error("Can't track closed file!");
+    if (!dirty)
+      throw std::domain_error("Dirty tracking is not enabled!");
+    return *dirty;
+  }
 
-  /*! \brief Write multiple values starting from the specified position
-   *         given two iterators.
+  /*! \brief Wait for the limiter, if any, before a chunk of a bulk operation
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K The type used to interpret bytes of the output values
-   * \tparam T
-   * \parblock
-   * The type of the input iterators. It is deduced from the
-   * iterators assigned
-   * \endparblock
-   * \param begit The beginning interator
-   * \param endit The ending interator
-   * \param p The position where you want to write
+   * \param bytes The size of the chunk
    */
-  template <typename K, typename T> void write_many(T begit, T endit, size_type p) {
-    wjump_to(p);
-    write_many<K>(begit, endit);
+  void pace(size_type bytes) {
+    if (rate)
+      rate->acquire(bytes);
   }
 
+  /*! \brief Write values produced in a staging buffer, chunk by chunk
+   *
+   * \param count The number of values
+   * \param produce A function filling the buffer with the next k values
+   */
+  template <typename T, typename F> void write_generated(size_type count, F produce) {
+    if (closed)
+      throw std::domain_error("Can't write on closed file!");
+    if (mode == Mode::read_only)
+      throw std::domain_error("Can't write on read-only file!");
+    size_type chunk = std::max<size_type>(1, (rate ? rate->chunk_bytes() : 1 << 20) / sizeof(T));
+    std::vector<T> stage(std::min(chunk, count));
+    for (size_type done = 0; done < count; done += chunk) {
+      size_type k = std::min(chunk, count - done);
+      produce(stage.data(), k);
+      pace(bytes<T>(k));
+      if (write_block(stage.data(), k) != Status::ok)
+        throw std::runtime_error("Couldn't write file!");
+    }
+  }
 
-  /*! \brief Write multiple values starting from the specified position
-   *         given a container.
+  /*! \brief Zero a range from the current position without writing it, if possible
    *
-   * \tparam T
-   * \parblock
-   * The type of the container. It is deduced from the
-   * container assigned. The type handled by the container is
-   * used to interpret bytes of the output values
-   * \endparblock
-   * \param vals The container
-   * \param p The position where you want to write
+   * It works only for a file opened in read-write mode, without layers.
+   * The part past EOF is added with ftruncate, and the part inside the
+   * file is zeroed with fallocate (on Linux).
+   * \param len The length of the range
+   * \return It returns false if the range must be written
    */
-  template <typename T>
-  void write_many(const T &vals, size_type p) {
-    wjump_to(p);
-    for (auto it = std::begin(vals); it != std::end(vals); ++it)
-      write(*it);
+  bool zero_range(size_type len) {
+    if (closed || mode != Mode::read_write || buf.get() != base || len <= 0)
+      return false;
+    fs.flush();
+    size_type p = fs.tellp(), old_size = size();
+    if (p < 0)
+      return false;
+    // The descriptor opened with the file: the name may point to another file by now
+    bool ok = base_fd >= 0;
+    if (ok && p < old_size) {
+#ifdef FALLOC_FL_ZERO_RANGE
+      ok = fallocate(base_fd, FALLOC_FL_ZERO_RANGE, p, std::min(len, old_size - p)) == 0;
+#else
+      ok = false;
+#endif
+    }
+    if (ok && p + len > old_size)
+      ok = ftruncate(base_fd, p + len) == 0;
+    if (!ok)
+      return false;
+    // Seeking drops what the buffer read before the change
+    fs.seekp(p + len);
+    return true;
   }
 
+  /*! \brief Open the file according to the mode
+   *
+   * Files opened for writing use both std::ios::in and std::ios::out
+   * because otherwise the seekp function wouldn't work.
+   * \param truncate If set to true and the file already exists it is cleared
+   */
+  void open(bool truncate) {
+    if (mode == Mode::read_only) {
+      buf.reset(new MappedBuf(filename));
+    } else if (mode == Mode::in_memory) {
+      std::unique_ptr<MemoryBuf> mb(new MemoryBuf);
+      struct stat buffer;
+      if (!filename.empty() && stat(filename.c_str(), &buffer) == 0)
+        mb->load(filename);
+      buf = std::move(mb);
+    } else {
+      // A descriptor of the same file, for what std::filebuf can't do (see zero_range())
+      base_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0666);
+      if (base_fd < 0)
+        throw std::domain_error("Couldn't open file!");
+      std::unique_ptr<std::filebuf> fb(new std::filebuf);
+      fb->open(filename, std::ios::out | std::ios::in);
+      struct stat by_fd, by_name;
+      if (!fb->is_open() || fstat(base_fd, &by_fd) != 0 || stat(filename.c_str(), &by_name) != 0 ||
+          by_fd.st_dev != by_name.st_dev || by_fd.st_ino != by_name.st_ino) {
+        ::close(base_fd);
+        base_fd = -1;
+        throw std::domain_error("Couldn't open file!");
+      }
+      buf = std::move(fb);
+    }
+    base = buf.get();
+    fs.rdbuf(buf.get());
+    rjump_to(0);
+  }
 
-  /*! \brief Write multiple values starting from the specified position
-   *         given a container.
+  /*! \brief Stack a layer on top of the current buffer
    *
-   * If you want, this implementation allows you to specify the
-   * type you want to cast the values to
-   * \tparam K The type used to interpret bytes of the output values
-   * \tparam T
-   * \parblock
-   * The type of the container. It is deduced from the
-   * container assigned
-   * \endparblock
-   * \param vals The container
-   * \param p The position where you want to write
+   * The position in the file is preserved.
+   * \param layer The layer
+   * \return It returns a reference to the layer
    */
-  template <typename K, typename T>
-  void write_many(const T &vals, size_type p) {
-    wjump_to(p);
-    for (auto it = std::begin(vals); it != std::end(vals); ++it)
-      write<K>(*it);
+  template <typename L> L &add_layer(std::unique_ptr<L> layer) {
+    if (closed)
+      throw std::domain_error("Can't add a layer to closed file!");
+    fs.flush();
+    size_type p = fs.tellg();
+    L &ret = *layer;
+    layer->attach(std::move(buf));
+    try {
+      layer->init();
+    } catch (...) {
+      buf = layer->detach();
+      throw;
+    }
+    buf = std::move(layer);
+    fs.rdbuf(buf.get());
+    fs.seekg(p);
+    return ret;
   }
 
-  /*! \brief Assign operator.
+  /*! \brief Throw if the last operation on the stream failed
    *
-   * It is used to write a in the file the value assigned
-   * \tparam T
-   * \parblock
-   * The type used to interpret bytes. It is deduced from
-   * the value assigned
-   * \endparblock
-   * \param val The value to write
+   * \param what The message used if no layer told why it failed
    */
-  template <typename T> void operator=(T val) { write(val); }
+  void check_stream(const char *what) {
+    if (fs)
+      return;
+    fs.clear();
+    std::string why = LayerBuf::take_failure();
+    throw std::runtime_error(why.empty() ? what : why);
+  }
 
-  /*! \brief Casting operator
+  /*! \brief Reset the stream after a failure in a non-throwing call
    *
-   * It is used to read from the file a value casted from
-   * a certain type.
-   * \tparam T The type used to interpret bytes
+   * \return It returns Status::io_error
    */
-  template <typename T> operator T() { return get_value<T>(); }
+  Status stream_failed() noexcept {
+    fs.clear();
+    LayerBuf::take_failure();
+    return Status::io_error;
+  }
 
-  /*! \brief Write a string in the current position
+  /*! \brief Count the bytes between the read position and EOF
    *
-   * \param s The string you want to write
+   * \return It returns the number of bytes left, or -1 if the stream failed
    */
-  void write_string(const std::string &s) {
-    if (closed)
-      throw std::domain_error("Can't write string on closed file!");
-    fs.write(s.data(), bytes<char>(s.size()));
+  size_type bytes_left() noexcept {
+    size_type p = fs.tellg();
+    if (p < 0)
+      return -1;
+    fs.seekg(0, std::ios::end);
+    size_type e = fs.tellg();
+    fs.seekg(p);
+    return e < 0 ? -1 : e - p;
   }
 
-  /*! \brief Write a string in the specified position
+  /*! \brief Non-throwing version of rjump_to
    *
-   * \param s The string you want to write
-   * \param p The position where you want to write
+   * If p is past EOF the position is left untouched.
+   * \param p The point (in bytes) where you want to jump
+   * \return It returns Status::ok on success
    */
-  void write_string(const std::string &s, size_type p) {
-    wjump_to(p);
-    write_string(s);
+  Status try_rjump_to(size_type p) noexcept {
+    if (closed)
+      return Status::closed;
+    size_type old = fs.tellg();
+    if (!fs.seekg(0, std::ios::end)) {
+      return stream_failed();
+    }
+    if (p < 0 || p > static_cast<size_type>(fs.tellg())) {
+      fs.seekg(old);
+      return Status::eof;
+    }
+    fs.seekg(p);
+    return Status::ok;
   }
 
-  /***********
-   * READING *
-   ***********/
-  
-  /*! \brief Read a single value of type T from the current position
+  /*! \brief Write multiple values in the current position with a single
+   *         write, reversing their bytes in a staging buffer if needed
    *
-   * \tparam T The type used to interpret bytes
-   * \return It returns the value read of type T
+   * \param src The values
+   * \param n The number of values
+   * \return It returns Status::ok on success
    */
-  template <typename T = unsigned char> T get_value() {
+  template <typename T> Status write_block(const T *src, size_type n) noexcept {
     if (closed)
-      throw std::domain_error("Can't read from closed file!");
-    if (static_cast<decltype(sizeof(T))>(size() - rpos()) < sizeof(T))
-      throw std::runtime_error("Trying to read past EOF!");
-    char buf[sizeof(T)];
-    fs.read(buf, sizeof(T));
-    // For float types, the behaviour of little and big endian is the same
-    if (opposite_endian && !std::is_floating_point<T>::value)
-      std::reverse(&buf[0], &buf[sizeof(T)]);
-    T *d = reinterpret_cast<T*>(buf);
-    return *d;
+      return Status::closed;
+    if (mode == Mode::read_only)
+      return Status::read_only;
+    const char *p = reinterpret_cast<const char*>(src);
+    if (!opposite_endian || sizeof(T) == 1) {
+      if (!fs.write(p, bytes<T>(n))) {
+        return stream_failed();
+      }
+      return Status::ok;
+    }
+    char stage[4096];
+    size_type per_chunk = sizeof(stage) / sizeof(T);
+    if (per_chunk == 0) {
+      for (size_type i = 0; i != n; ++i) {
+        Status st = try_write(src[i]);
+        if (st != Status::ok)
+          return st;
+      }
+      return Status::ok;
+    }
+    for (size_type done = 0; done < n; done += per_chunk) {
+      size_type k = std::min(per_chunk, n - done);
+      std::memcpy(stage, p + bytes<T>(done), bytes<T>(k));
+      for (size_type i = 0; i != k; ++i)
+        std::reverse(stage + bytes<T>(i), stage + bytes<T>(i + 1));
+      if (!fs.write(stage, bytes<T>(k))) {
+        return stream_failed();
+      }
+    }
+    return Status::ok;
   }
 
-  /*! \brief Read multiple values of type T from the current position
+  /*! \brief Read values at a position on behalf of a window
    *
-   * \tparam T The type used to interpret bytes
-   * \param n The number of elements of type T you want to read
-   * \return It returns the values in a std::vector<T>
+   * A file opened in read-only mode, without layers, is read straight
+   * from the mapping without any lock. Otherwise the access is
+   * serialized and the position of the file is restored afterwards.
+   * \param dst The destination
+   * \param n The number of values
+   * \param p The position
+   * \return It returns Status::ok on success
    */
-  template <typename T = unsigned char> std::vector<T> get_values(size_type n) {
+  template <typename T> Status read_shared(T *dst, size_type n, size_type p) noexcept {
     if (closed)
-      throw std::domain_error("Can't write on closed file!");
-    if (static_cast<decltype(sizeof(T))>(size() - rpos()) < bytes<T>(n))
-      throw std::runtime_error("Trying to read past EOF!");
-    char *buf = new char[bytes<T>(n)];
-    fs.read(buf, bytes<T>(n));
-    std::vector<T> ret(n);
-
-    if (opposite_endian && !std::is_floating_point<T>::value) {
-      for (int i = 0; i != n; ++i)
-        std::reverse(&buf[bytes<T>(i)], &buf[bytes<T>(i + 1)]);
+      return Status::closed;
+    if (mode == Mode::read_only && buf.get() == base) {
+      const MappedBuf *m = static_cast<const MappedBuf*>(base);
+      if (p < 0 || p + bytes<T>(n) > m->size())
+        return Status::eof;
+      std::memcpy(dst, m->data() + p, bytes<T>(n));
+      fix_read_endianness(dst, n);
+      return Status::ok;
     }
-    for (int i = 0; i != n; ++i)
-      ret[i] = *reinterpret_cast<T*>(buf + bytes<T>(i));
-    return ret;
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    size_type old = fs.tellg();
+    Status st = try_get_values_into(dst, n, p);
+    fs.seekg(old);
+    return st;
   }
 
-
-  /*! \brief Read a single value of type T from the specified position
+  /*! \brief Write values at a position on behalf of a window
    *
-   * \tparam T The type used to interpret bytes
-   * \param p The position from where you want to read
-   * \return It returns the value read of type T
+   * The access is serialized and the position of the file is restored afterwards.
+   * \param src The values
+   * \param n The number of values
+   * \param p The position
+   * \return It returns Status::ok on success
    */
-  template <typename T = unsigned char> T get_value(size_type p) {
-    rjump_to(p);
-    return get_value<T>();
+  template <typename T> Status write_shared(const T *src, size_type n, size_type p) noexcept {
+    if (closed)
+      return Status::closed;
+    std::lock_guard<std::mutex> lock(shared_mutex);
+    size_type old = fs.tellp();
+    fs.seekp(p);
+    Status st = write_block(src, n);
+    fs.seekp(old);
+    return st;
   }
 
-  /*! \brief Read multiple values of type T from the specified position
+  /*! \brief Read multiple values into an empty vector
    *
-   * \tparam T The type used to interpret bytes
-   * \param n The number of elements of type T you want to read
-   * \param p The position from where you want to read
-   * \return It returns the values in a std::vector<T>
+   * The bytes are read straight into the vector storage, except for
+   * std::vector<bool>, which has none.
+   * \param n The number of values
+   * \param ret The vector, carrying its allocator
+   * \return It returns the vector filled
    */
-  template <typename T = unsigned char> std::vector<T> get_values(size_type n, size_type p) {
-    rjump_to(p);
-    return get_values<T>(n);
+  template <typename V> V read_vector(size_type n, V ret) {
+    using T = typename V::value_type;
+    if (closed)
+      throw std::domain_error("Can't write on closed file!");
+    if (size() - rpos() < bytes<T>(n))
+      throw std::runtime_error("Trying to read past EOF!");
+    ret.resize(n);
+    read_elements(ret, n, std::is_same<T, bool>());
+    return ret;
   }
 
-  /*! \brief Read a string from the current location
+  //! \brief Read values into the contiguous storage of a vector
+  template <typename V> void read_elements(V &ret, size_type n, std::false_type) {
+    fs.read(reinterpret_cast<char*>(ret.data()), bytes<typename V::value_type>(n));
+    check_stream("Couldn't read file!");
+    fix_read_endianness(ret.data(), n);
+  }
+
+  //! \brief Read values into a std::vector<bool>, one by one
+  template <typename V> void read_elements(V &ret, size_type n, std::true_type) {
+    std::vector<char> buf(bytes<bool>(n));
+    fs.read(buf.data(), buf.size());
+    check_stream("Couldn't read file!");
+    for (size_type i = 0; i != n; ++i) {
+      bool v;
+      std::memcpy(&v, &buf[bytes<bool>(i)], sizeof(bool));
+      ret[i] = v;
+    }
+  }
+
+  /*! \brief Read a string into an empty string
    *
+   * Like a C string, the string read ends at the first null character.
    * \param len The length of the string to read
-   * \return It returns the string read
+   * \param ret The string, carrying its allocator
+   * \return It returns the string filled
    */
-  std::string get_string(std::string::size_type len) {
+  template <typename S> S read_string(std::string::size_type len, S ret) {
     if (closed)
       throw std::domain_error("Can't read string from closed file!");
     if (len > static_cast<std::string::size_type>(size() - fs.tellg()))
       throw std::domain_error("Can't read string past EOF!");
-
-    char *buf = new char[len + 1];
-    fs.read(buf, len);
-    buf[len] = '\0';
-    std::string ret = buf;
-    delete[] buf;
+    ret.resize(len);
+    fs.read(&ret[0], len);
+    check_stream("Couldn't read file!");
+    auto end = ret.find('\0');
+    if (end != S::npos)
+      ret.resize(end);
     return ret;
   }
 
-  /*! \brief Read a string from the specified location
+  /*! \brief Reverse the bytes of values just read, if needed
    *
-   * \param len The length of the string to read
-   * \param p The position from where you want to read
-   * \return It returns the string read
+   * Floating point values are reversed too, as the writes do
+   * \param vals The values read
+   * \param n The number of values
    */
-  std::string get_string(std::string::size_type len, size_type p) {
-    rjump_to(p);
-    return get_string(len);
-  }
-
-  /*! \brief Flush the buffer */
-  void flush() { fs.flush(); }
-
-  /*! \brief Close the file */
-  void close() {
-    fs.close();
-    closed = true;
+  template <typename T> void fix_read_endianness(T *vals, size_type n) noexcept {
+    if (!opposite_endian || sizeof(T) == 1)
+      return;
+    char *buf = reinterpret_cast<char*>(vals);
+    for (size_type i = 0; i != n; ++i)
+      std::reverse(buf + bytes<T>(i), buf + bytes<T>(i + 1));
   }
 
-  /*! \brief Get the filename
-   *
-   * \return It returns the file name
-   */
-  std::string get_filename() const { return filename; }
-
-
-  template <typename T> BinPtr<T> begin();
-  template <typename T> BinPtr<T> end();
-
- private:
-  std::fstream fs;  /*!< \brief The file stream */
-  const std::string filename;  /*!< \brief The file name */
-  bool closed = false;  /*!< \brief Tells if the file has been closed */
-  std::shared_ptr<Bin> sptr;  /*!< \brief A shared pointer which will point
-                               *          to the instance of the class itself
-                               */
-  bool opposite_endian;  /*!< \brief Tells if the endianness you want to read/write
-                          *          is the opposite of the default one of the machine
-			  */
-
 
   /*!
    * This function is used to handle the case when the user wants to
@@ -857,6 +3761,231 @@ BinPtr<T> Bin::begin() { return BinPtr<T>(sptr); }
 template <typename T>
 BinPtr<T> Bin::end() { return BinPtr<T>(sptr, size()); }
 
+/*! \brief A bounded view over a part of a Bin
+ *
+ * It has its own cursor and all its positions are relative to the
+ * beginning of the window. It shares the handle (and the layers)
+ * of the Bin it comes from and nothing is copied, so a file can be
+ * partitioned between threads by giving a window to each of them.
+ * The accesses through windows are serialized, unless the file is
+ * opened in read-only mode: in that case they read the shared mapping
+ * without any lock. While windows are used from many threads, the
+ * Bin itself must not be used directly, and it must outlive them.
+ */
+class BinWindow {
+ public:
+  //! The type used to indicate positions inside the window
+  using size_type = Bin::size_type;
+
+  /*! \brief The constructor
+   *
+   * \param b The Bin instance
+   * \param offset The position in the file where the window begins
+   * \param length The size of the window
+   */
+  BinWindow(Bin &b, size_type offset, size_type length) : parent(b), first(offset), len(length) {
+    if (offset < 0 || length < 0)
+      throw std::domain_error("Invalid window!");
+  }
+
+  /*! \brief Get the size of the window */
+  size_type size() const { return len; }
+
+  /*! \brief Get the position in the file where the window begins */
+  size_type offset() const { return first; }
+
+  /*! \brief Get the position you are currently on, relative to the window */
+  size_type rpos() const { return cur; }
+
+  /*! \brief Get the position you are currently on, relative to the window
+   *
+   * Reading and writing share the same cursor.
+   */
+  size_type wpos() const { return cur; }
+
+  /*! \brief Jump to a location in the window to read
+   *
+   * \param point The point (in bytes) where you want to jump
+   */
+  void rjump_to(size_type point) {
+    if (point < 0 || point > len)
+      throw std::domain_error("Can't jump past the end of the window!");
+    cur = point;
+  }
+
+  /*! \brief Jump to a location in the window to write
+   *
+   * \param point The point (in bytes) where you want to jump
+   */
+  void wjump_to(size_type point) { rjump_to(point); }
+
+  /*! \brief Move by a certain number of steps, forward or backward.
+   *
+   * The size of the step is deduced by the type specified
+   * \tparam T The type used to determine the size of a step
+   * \param n_steps The number of steps
+   */
+  template <typename T = char>
+  void rmove_by(std::streamoff n_steps) { rjump_to(cur + Bin::bytes<T>(n_steps)); }
+
+  /*! \brief Move by a certain number of steps, forward or backward.
+   *
+   * The size of the step is deduced by the type specified
+   * \tparam T The type used to determine the size of a step
+   * \param n_steps The number of steps
+   */
+  template <typename T = char>
+  void wmove_by(std::streamoff n_steps) { rmove_by<T>(n_steps); }
+
+  /*! \brief Read multiple values of type T from the current position
+   *         into a buffer without throwing
+   *
+   * \tparam T The type used to interpret bytes
+   * \param dst The buffer, it must have room for n values
+   * \param n The number of elements of type T you want to read
+   * \return It returns Status::ok on success
+   */
+  template <typename T> Bin::Status try_get_values_into(T *dst, size_type n) noexcept {
+    if (len - cur < Bin::bytes<T>(n))
+      return Bin::Status::eof;
+    Bin::Status st = parent.read_shared(dst, n, first + cur);
+    if (st == Bin::Status::ok)
+      cur += Bin::bytes<T>(n);
+    return st;
+  }
+
+  /*! \brief Read a single value of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \return It returns the value read of type T
+   */
+  template <typename T = unsigned char> T get_value() {
+    T ret;
+    check_read(try_get_values_into(&ret, 1));
+    return ret;
+  }
+
+  /*! \brief Read a single value of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param p The position, relative to the window, from where you want to read
+   * \return It returns the value read of type T
+   */
+  template <typename T = unsigned char> T get_value(size_type p) {
+    rjump_to(p);
+    return get_value<T>();
+  }
+
+  /*! \brief Read multiple values of type T from the current position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n) {
+    std::vector<T> ret(n);
+    check_read(try_get_values_into(ret.data(), n));
+    return ret;
+  }
+
+  /*! \brief Read multiple values of type T from the specified position
+   *
+   * \tparam T The type used to interpret bytes
+   * \param n The number of elements of type T you want to read
+   * \param p The position, relative to the window, from where you want to read
+   * \return It returns the values in a std::vector<T>
+   */
+  template <typename T = unsigned char> std::vector<T> get_values(size_type n, size_type p) {
+    rjump_to(p);
+    return get_values<T>(n);
+  }
+
+  /*! \brief Write a value in the current position
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   */
+  template <typename T> void write(T val) { write_many(&val, &val + 1); }
+
+  /*! \brief Write a value in the specified position
+   *
+   * \tparam T
+   * \parblock
+   * The type of the input value. It is deduced from the
+   * value assigned
+   * \endparblock
+   * \param val The value you want to write
+   * \param p The position, relative to the window, where you want to write
+   */
+  template <typename T> void write(T val, size_type p) {
+    wjump_to(p);
+    write(val);
+  }
+
+  /*! \brief Write the values of a contiguous range starting from the current position
+   *
+   * \tparam T The type of the values
+   * \param begptr The pointer to the first value
+   * \param endptr The pointer past the last value
+   */
+  template <typename T> void write_many(const T *begptr, const T *endptr) {
+    size_type n = endptr - begptr;
+    if (len - cur < Bin::bytes<T>(n))
+      throw std::domain_error("Can't write past the end of the window!");
+    Bin::Status st = parent.write_shared(begptr, n, first + cur);
+    if (st != Bin::Status::ok)
+      throw std::runtime_error("Couldn't write on the window!");
+    cur += Bin::bytes<T>(n);
+  }
+
+  /*! \brief Write the values of a vector starting from the current position
+   *
+   * \tparam T The type of the values
+   * \param vals The vector
+   */
+  template <typename T> void write_many(const std::vector<T> &vals) {
+    write_many(vals.data(), vals.data() + vals.size());
+  }
+
+  /*! \brief Get a window inside this window
+   *
+   * \param offset The position, relative to this window, where the new window begins
+   * \param length The size of the new window
+   * \return It returns the new window
+   */
+  BinWindow window(size_type offset, size_type length) const {
+    if (offset < 0 || length < 0 || offset > len || length > len - offset)
+      throw std::domain_error("The window doesn't fit in the window!");
+    return BinWindow(parent, first + offset, length);
+  }
+
+ private:
+  Bin &parent;  //!< \brief The Bin instance which the window belongs to
+  const size_type first;  //!< \brief The position in the file where the window begins
+  const size_type len;  //!< \brief The size of the window
+  size_type cur = 0;  //!< \brief The current position, relative to the window
+
+  //! \brief Turn the outcome of a read into an exception
+  static void check_read(Bin::Status st) {
+    if (st == Bin::Status::closed)
+      throw std::domain_error("Can't read from closed file!");
+    if (st != Bin::Status::ok)
+      throw std::runtime_error("Trying to read past the end of the window!");
+  }
+};
+
+/*! \brief Get a bounded view over a part of the file
+ *
+ * \param offset The position where the window begins
+ * \param length The size of the window
+ * \return It returns the window
+ */
+inline BinWindow Bin::window(size_type offset, size_type length) { return BinWindow(*this, offset, length); }
+
 /*! \brief Relational operator between two iterators
  *
  * \param ptr1,ptr2 The pointers to be compared
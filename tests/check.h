@@ -0,0 +1,58 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <iterator>
+
+// A minimal test harness: CHECK records a failure and goes on,
+// CHECK_THROWS expects an exception of the given type, and
+// check_result() is returned by main.
+
+inline int &check_failures() {
+  static int n = 0;
+  return n;
+}
+
+#define CHECK(cond)                                                          \
+  do {                                                                       \
+    if (!(cond)) {                                                           \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed\n"; \
+      ++check_failures();                                                    \
+    }                                                                        \
+  } while (0)
+
+#define CHECK_THROWS(expr, type)                                             \
+  do {                                                                       \
+    bool thrown = false;                                                     \
+    try {                                                                    \
+      expr;                                                                  \
+    } catch (const type&) {                                                  \
+      thrown = true;                                                         \
+    }                                                                        \
+    if (!thrown) {                                                           \
+      std::cerr << __FILE__ << ":" << __LINE__ << ": " #expr " didn't throw " #type "\n"; \
+      ++check_failures();                                                    \
+    }                                                                        \
+  } while (0)
+
+inline int check_result() {
+  if (check_failures())
+    std::cerr << check_failures() << " check(s) failed\n";
+  return check_failures() == 0 ? 0 : 1;
+}
+
+// Write a file with the given content, replacing it
+inline void write_file(const std::string &fname, const std::string &content) {
+  std::ofstream(fname, std::ios::binary | std::ios::trunc) << content;
+}
+
+// Read the whole content of a file
+inline std::string read_file(const std::string &fname) {
+  std::ifstream f(fname, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+#endif // CHECK_H
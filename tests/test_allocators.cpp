@@ -0,0 +1,64 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <vector>
+#include <string>
+
+// An allocator counting the allocations
+template <typename T> struct CountingAllocator {
+  typedef T value_type;
+  int *count;
+  explicit CountingAllocator(int *c) : count(c) { }
+  template <typename U> CountingAllocator(const CountingAllocator<U> &o) : count(o.count) { }
+  T *allocate(std::size_t n) {
+    ++*count;
+    return std::allocator<T>().allocate(n);
+  }
+  void deallocate(T *p, std::size_t n) { std::allocator<T>().deallocate(p, n); }
+  template <typename U> bool operator==(const CountingAllocator<U> &o) const { return count == o.count; }
+  template <typename U> bool operator!=(const CountingAllocator<U> &o) const { return count != o.count; }
+};
+
+int main() {
+  static_assert(is_bin_allocator<std::allocator<int>>::value, "std::allocator is an allocator");
+  static_assert(!is_bin_allocator<std::streampos>::value, "std::streampos isn't an allocator");
+  static_assert(!is_bin_allocator<long>::value, "long isn't an allocator");
+
+  const std::string fname = "test_allocators.bin";
+  {
+    Bin b(fname, true);
+    b.write_many<int>({10, 20, 30, 40});
+    b.write_string("a long enough string to skip the small string buffer");
+  }
+  Bin b(fname);
+
+  // Positions given as std::streampos still pick the positional overloads
+  std::vector<int> v = b.get_values<int>(2, std::streampos(4));
+  CHECK(v.size() == 2 && v[0] == 20 && v[1] == 30);
+  CHECK(b.get_string(6, std::streampos(16)) == "a long");
+
+  int count = 0;
+  CountingAllocator<int> alloc(&count);
+  std::vector<int, CountingAllocator<int>> w = b.get_values<int>(3, 0, alloc);
+  CHECK(w.size() == 3 && w[0] == 10 && w[2] == 30);
+  CHECK(count > 0);
+
+  count = 0;
+  auto s = b.get_string(40, 16, CountingAllocator<char>(&count));
+  CHECK(s == "a long enough string to skip the small s");
+  CHECK(count > 0);
+
+  // std::vector<bool> has no contiguous storage, but it is read as before
+  {
+    Bin c(fname, true);
+    c.write_many<bool>({true, false, true, true});
+    std::vector<bool> flags = c.get_values<bool>(4, 0);
+    CHECK(flags == std::vector<bool>({true, false, true, true}));
+    CHECK(c.get_values<bool>(2, 2) == std::vector<bool>({true, true}));
+    count = 0;
+    std::vector<bool, CountingAllocator<bool>> cf = c.get_values<bool>(3, 1, CountingAllocator<bool>(&count));
+    CHECK(cf.size() == 3 && !cf[0] && cf[1] && cf[2]);
+  }
+
+  std::remove(fname.c_str());
+  return check_result();
+}
@@ -0,0 +1,72 @@
+#include "check.h"
+#include "bincheckpoint.h"
+#include <sys/stat.h>
+
+int main() {
+  const std::string path = "test_checkpoint.bin", manifest = path + ".manifest";
+  std::vector<std::vector<char>> data = {std::vector<char>(3 << 20), std::vector<char>(0), std::vector<char>(1),
+                                         std::vector<char>(4097), std::vector<char>(100000)};
+  std::uint64_t x = 1;
+  for (auto &d : data)
+    for (char &c : d)
+      c = static_cast<char>((x = x * 6364136223846793005ull + 1442695040888963407ull) >> 56);
+  std::vector<std::pair<const void*, std::size_t>> spans;
+  for (auto &d : data)
+    spans.emplace_back(d.data(), d.size());
+
+  auto restore_all = [&](unsigned threads, bool direct) {
+    std::vector<std::vector<char>> back;
+    std::vector<std::pair<void*, std::size_t>> dst;
+    for (auto &d : data)
+      back.emplace_back(d.size(), 'z');
+    for (auto &b : back)
+      dst.emplace_back(b.data(), b.size());
+    restore(path, dst, threads, direct);
+    return back == data;
+  };
+
+  // Many chunks, with and without direct I/O, any number of threads
+  for (bool direct : {false, true})
+    for (unsigned threads : {1u, 4u}) {
+      checkpoint(spans, path, threads, direct, 1 << 16);
+      CHECK(read_file(manifest + ".tmp").empty());
+      CHECK(restore_all(threads, direct));
+      CHECK(restore_all(3, !direct));
+    }
+
+  // The spans must match the saved ones
+  {
+    std::vector<char> small(10);
+    std::vector<std::pair<void*, std::size_t>> dst(1, std::make_pair(static_cast<void*>(small.data()), small.size()));
+    CHECK_THROWS(restore(path, dst), std::domain_error);
+  }
+  // A corrupted byte fails the restore
+  {
+    Bin b(path);
+    char c = b.get_value<char>(1000);
+    b.write<char>(static_cast<char>(c ^ 1), 1000);
+  }
+  CHECK_THROWS(restore_all(2, false), std::runtime_error);
+  // A corrupted manifest too
+  checkpoint(spans, path);
+  {
+    Bin m(manifest);
+    m.write<char>('X', 0);
+  }
+  CHECK_THROWS(restore_all(2, false), std::runtime_error);
+  // Without a manifest there is no checkpoint
+  std::remove(manifest.c_str());
+  CHECK_THROWS(restore_all(2, false), std::domain_error);
+  // If the old manifest can't be removed the data file isn't touched
+  checkpoint(spans, path);
+  std::string saved = read_file(path);
+  std::remove(manifest.c_str());
+  ::mkdir(manifest.c_str(), 0755);
+  write_file(manifest + "/keep", "x");
+  std::vector<std::pair<const void*, std::size_t>> other(1, std::make_pair(static_cast<const void*>("abc"), 3));
+  CHECK_THROWS(checkpoint(other, path), std::runtime_error);
+  CHECK(read_file(path) == saved);
+  std::remove((manifest + "/keep").c_str());
+  ::rmdir(manifest.c_str());
+  return check_result();
+}
@@ -0,0 +1,112 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <sys/wait.h>
+
+int main() {
+  // Known answers of CRC32C (Castagnoli)
+  const std::string digits = "123456789";
+  CHECK(crc32c(0, digits.data(), digits.size()) == 0xe3069283u);
+  CHECK(crc32c(0, std::string(32, '\0').data(), 32) == 0x8a9136aau);
+  CHECK(crc32c(0, std::string(32, '\xff').data(), 32) == 0x62a8ab43u);
+  CHECK(crc32c(0, "", 0) == 0);
+  // Incremental computation
+  CHECK(crc32c(crc32c(0, digits.data(), 4), digits.data() + 4, 5) == 0xe3069283u);
+  // Unaligned tails of every length agree with the byte-by-byte computation
+  std::string text(100, '\0');
+  for (int i = 0; i != 100; ++i)
+    text[i] = static_cast<char>(i * 37);
+  for (std::size_t n = 0; n != 40; ++n) {
+    std::uint32_t c = 0;
+    for (std::size_t i = 0; i != n; ++i)
+      c = crc32c(c, text.data() + 3 + i, 1);
+    CHECK(crc32c(0, text.data() + 3, n) == c);
+    // The table and the CRC32 instruction (if the CPU has it) agree
+    CHECK(~bin_crc::update_table(~0u, text.data() + 3, n) == c);
+  }
+
+  const std::string fname = "test_checksums.bin", table = fname + ".crc";
+  std::remove(table.c_str());
+  {
+    Bin b(fname, true);
+    const ChecksumBuf &layer = b.enable_checksums(64);
+    // Small writes, element by element, across many blocks
+    for (int i = 0; i != 1000; ++i)
+      b.write<int>(i);
+    b.write<int>(-1, 4 * 500);
+    CHECK(b.get_value<int>(4 * 499) == 499);
+    CHECK(b.get_value<int>(4 * 500) == -1);
+    CHECK(layer.verified_blocks() > 0);
+  }
+  {
+    Bin b(fname);
+    b.enable_checksums(64);
+    std::vector<int> v = b.get_values<int>(1000, 0);
+    CHECK(v[0] == 0 && v[500] == -1 && v[999] == 999);
+    // Writing past EOF checksums the gap too
+    b.write<int>(7, 4 * 1100);
+  }
+  {
+    Bin b(fname);
+    b.enable_checksums(64);
+    CHECK(b.get_value<int>(4 * 1050) == 0);
+    CHECK(b.get_value<int>(4 * 1100) == 7);
+  }
+  {
+    // A corrupted byte fails the read of its block only
+    Bin raw(fname);
+    raw.write<char>('x', 100);
+  }
+  {
+    Bin b(fname);
+    b.enable_checksums(64);
+    CHECK(b.get_value<int>(0) == 0);
+    CHECK_THROWS(b.get_value<int>(100), std::runtime_error);
+  }
+  CHECK_THROWS(Bin(fname).enable_checksums(128), std::runtime_error);
+
+  // A crash after writes in place, with the table saved before them,
+  // must not report false mismatches
+  std::remove(table.c_str());
+  write_file(fname, std::string(1 << 16, 'a'));
+  pid_t pid = fork();
+  if (pid == 0) {
+    Bin b(fname);
+    b.enable_checksums(4096);
+    b.flush();
+    std::string more(1 << 15, 'b');
+    // Larger than the buffer of the stream, so it reaches the file at once
+    b.try_write_many(more.data(), more.size(), 1000);
+    ::_exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK(read_file(fname).substr(1000, 4) == "bbbb");
+  {
+    Bin b(fname);
+    b.enable_checksums(4096);
+    std::string all = b.get_string(1 << 16, 0);
+    CHECK(all.substr(999, 3) == "abb");
+  }
+
+  // A table shorter than its header is refused
+  write_file(table, "short");
+  CHECK_THROWS(Bin(fname).enable_checksums(4096), std::runtime_error);
+  write_file(table, std::string(16 + 3, '\0'));
+  CHECK_THROWS(Bin(fname).enable_checksums(4096), std::runtime_error);
+
+  // A table which can't be saved makes flush() fail
+  std::remove(table.c_str());
+  {
+    Bin b(fname);
+    b.enable_checksums(4096);
+    b.write<char>('c', 0);
+    std::remove(table.c_str());
+    CHECK(::mkdir(table.c_str(), 0755) == 0);
+    CHECK_THROWS(b.flush(), std::runtime_error);
+    CHECK(b.get_value<char>(0) == 'c');
+    CHECK(::rmdir(table.c_str()) == 0);
+  }
+  std::remove(fname.c_str());
+  std::remove(table.c_str());
+  return check_result();
+}
@@ -0,0 +1,59 @@
+#include "check.h"
+#include "bincompact.h"
+#include <cstdint>
+
+int main() {
+  const std::string fname = "test_compact.bin", tmp = "test_compact.tmp", index = "test_compact.idx";
+  // A header of 16 bytes and records of 8 bytes: the odd ones are dead
+  {
+    Bin b(fname, true);
+    b.write_string("HEADER-HEADER-16");
+    for (std::int64_t i = 0; i != 10000; ++i)
+      b.write<std::int64_t>(i % 2 ? -i : i);
+    Bin idx(index, true);
+    for (std::int64_t i = 0; i != 10000; ++i)
+      idx.write<std::int64_t>(16 + 8 * i + 3);
+    idx.write<std::int64_t>(5);
+  }
+  auto is_live = [](const char *r) {
+    std::int64_t v;
+    std::memcpy(&v, r, 8);
+    return v >= 0;
+  };
+  {
+    Bin b(fname);
+    BinCompactor c(b, tmp, 8, is_live, 16);
+    CHECK(!c.step(8 * 3000));
+    CHECK(c.scanned() == 3000);
+    // Written after being copied: a live record changes, a dead one becomes live
+    b.write<std::int64_t>(1000000, 16 + 8 * 10);
+    c.note_write(10);
+    b.write<std::int64_t>(11, 16 + 8 * 11);
+    c.note_write(11);
+    // Appended records are seen by finish()
+    b.write<std::int64_t>(10000, b.size());
+    c.finish();
+    CHECK_THROWS(c.step(8), std::domain_error);
+    CHECK(c.remap(0) == 0 && c.remap(1) == -1 && c.remap(10) == 5 && c.remap(9998) == 4999);
+    CHECK(c.remap(11) == 5001 && c.remap(10000) == 5000);
+    Bin idx(index);
+    c.rewrite_index<std::int64_t>(idx);
+    std::vector<std::int64_t> v = idx.get_values<std::int64_t>(10001, 0);
+    CHECK(v[0] == 16 + 3 && v[1] == -1 && v[2] == 16 + 8 + 3 && v[11] == 16 + 8 * 5001 + 3 && v[10000] == 5);
+  }
+  // The new file replaced the old one, and the temporary file is gone
+  {
+    Bin b(fname);
+    CHECK(b.size() == 16 + 8 * 5002);
+    CHECK(b.get_string(16, 0) == "HEADER-HEADER-16");
+    std::vector<std::int64_t> v = b.get_values<std::int64_t>(5002, 16);
+    CHECK(v[0] == 0 && v[1] == 2 && v[5] == 1000000 && v[4999] == 9998 && v[5000] == 10000 && v[5001] == 11);
+    CHECK(read_file(tmp).empty());
+  }
+  // The sync helpers, with relative and absolute paths
+  {
+    CHECK(fsync_parent_dir("/") && fsync_parent_dir(fname) && fsync_file(fname));
+    CHECK(!fsync_file("test_compact_missing/x") && !fsync_parent_dir("test_compact_missing/x"));
+  }
+  return check_result();
+}
@@ -0,0 +1,61 @@
+#include "check.h"
+#include "readwritebin.h"
+
+int main() {
+  const std::string a = "test_copy_to_a.bin", b = "test_copy_to_b.bin";
+  {
+    write_file(a, "abcdefgh");
+    Bin f(a);
+    f.rjump_to(2);
+    f.copy_to(f, 0, 4, 4);
+    // The positions are left untouched
+    CHECK(f.rpos() == 2);
+    f.close();
+    CHECK(read_file(a) == "abcdabcd");
+  }
+  {
+    // Overlapping ranges behave like memmove, in both directions
+    write_file(a, "abcdefgh");
+    Bin f(a);
+    f.copy_to(f, 0, 6, 2);
+    f.close();
+    CHECK(read_file(a) == "ababcdef");
+    write_file(a, "abcdefgh");
+    Bin g(a);
+    g.copy_to(g, 2, 6, 0);
+    g.close();
+    CHECK(read_file(a) == "cdefghgh");
+  }
+  {
+    // Overlapping ranges spanning many chunks (4 KiB with this limiter)
+    std::string content;
+    for (int i = 0; i < 20000; ++i)
+      content += static_cast<char>('a' + i % 26);
+    write_file(a, content);
+    Bin f(a);
+    f.set_rate_limiter(std::make_shared<RateLimiter>(1e9, 0, 1e-6));
+    f.copy_to(f, 0, 15000, 3000);
+    f.copy_to(f, 5000, 10000, 1000);
+    f.close();
+    std::string expected = content;
+    std::memmove(&expected[3000], &expected[0], 15000);
+    std::memmove(&expected[1000], &expected[5000], 10000);
+    CHECK(read_file(a) == expected);
+  }
+  {
+    write_file(a, "0123456789");
+    write_file(b, "");
+    Bin src(a), dst(b);
+    src.copy_to(dst, 3, 4, 2);
+    dst.close();
+    CHECK(read_file(b) == std::string("\0\0" "3456", 6));
+    CHECK_THROWS(src.copy_to(src, 8, 4, 0), std::runtime_error);
+    CHECK_THROWS(src.copy_to(dst, 3, -1, 0), std::domain_error);
+    CHECK_THROWS(src.copy_to(dst, 0, -(1 << 30), 0), std::domain_error);
+    src.copy_to(dst, 10, 0, 0);
+    CHECK(read_file(b) == std::string("\0\0" "3456", 6));
+  }
+  std::remove(a.c_str());
+  std::remove(b.c_str());
+  return check_result();
+}
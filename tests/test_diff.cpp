@@ -0,0 +1,75 @@
+#include "check.h"
+#include "bindiff.h"
+#include <cstdint>
+
+static std::vector<BinRange> diff_of(const std::string &x, const std::string &y, std::size_t max_ranges = 0) {
+  write_file("test_diff_a.bin", x);
+  write_file("test_diff_b.bin", y);
+  Bin a("test_diff_a.bin"), b("test_diff_b.bin");
+  return diff(a, b, max_ranges);
+}
+
+static bool is(const std::vector<BinRange> &r, std::vector<std::pair<std::streamsize, std::streamsize>> want) {
+  if (r.size() != want.size())
+    return false;
+  for (std::size_t i = 0; i != r.size(); ++i)
+    if (r[i].offset != want[i].first || r[i].length != want[i].second)
+      return false;
+  return true;
+}
+
+int main() {
+  // Larger than a block of the comparison, with a block which isn't full
+  const std::size_t n = (3 << 20) + 123;
+  std::string base(n, '\0');
+  std::uint64_t x = 1;
+  for (char &c : base)
+    c = static_cast<char>((x = x * 6364136223846793005ull + 1442695040888963407ull) >> 56);
+
+  // Equal files, empty ones included
+  CHECK(diff_of(base, base).empty());
+  CHECK(diff_of("", "").empty());
+
+  // A difference at offset 0, alone or with others
+  std::string d = base;
+  d[0] ^= 1;
+  d[1] ^= 1;
+  CHECK(is(diff_of(base, d), {{0, 2}}));
+  d[1 << 20] ^= 1;
+  d[n - 1] ^= 1;
+  CHECK(is(diff_of(base, d), {{0, 2}, {1 << 20, 1}, {n - 1, 1}}));
+
+  // The limit on the number of ranges keeps the first ones, whole
+  CHECK(is(diff_of(base, d, 1), {{0, 2}}));
+  CHECK(is(diff_of(base, d, 2), {{0, 2}, {1 << 20, 1}}));
+  CHECK(is(diff_of(base, d, 3), {{0, 2}, {1 << 20, 1}, {n - 1, 1}}));
+  // A range crossing a block of the comparison isn't cut by the limit
+  std::string e = base;
+  for (std::size_t i = (1 << 20) - 10; i != (1 << 20) + 10; ++i)
+    e[i] ^= 1;
+  CHECK(is(diff_of(base, e, 1), {{(1 << 20) - 10, 20}}));
+
+  // A difference at EOF: the last byte, or a longer file
+  std::string f = base;
+  f[n - 1] ^= 1;
+  CHECK(is(diff_of(base, f), {{n - 1, 1}}));
+  CHECK(is(diff_of(base, base + "tail"), {{n, 4}}));
+  CHECK(is(diff_of(base + "tail", base, 1), {{n, 4}}));
+  CHECK(is(diff_of(f, base + "tail"), {{n - 1, 5}}));
+  CHECK(is(diff_of("", "abc"), {{0, 3}}));
+  // The tail is dropped once the limit is reached
+  CHECK(is(diff_of(d, base + "tail", 1), {{0, 2}}));
+
+  // Ranges of whole elements, and a partial element before the tail
+  CHECK(is(diff_of(std::string("abcdefgh"), std::string("abcdefgX")), {{7, 1}}));
+  {
+    write_file("test_diff_a.bin", "abcdefgh");
+    write_file("test_diff_b.bin", "abcdeXghij");
+    Bin a("test_diff_a.bin"), b("test_diff_b.bin");
+    CHECK(is(diff<std::int32_t>(a, b), {{4, 6}}));
+    CHECK(is(diff<std::int32_t>(a, b, 1), {{4, 6}}));
+  }
+  std::remove("test_diff_a.bin");
+  std::remove("test_diff_b.bin");
+  return check_result();
+}
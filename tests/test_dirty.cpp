@@ -0,0 +1,89 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main() {
+  const std::string fname = "test_dirty.bin", table = fname + ".dirty", copy = "test_dirty_copy.bin";
+  std::remove(table.c_str());
+  write_file(fname, std::string(10000, 'a'));
+  std::uint64_t tok;
+  {
+    Bin b(fname);
+    b.enable_dirty_tracking(1000);
+    tok = b.checkpoint();
+    CHECK(b.dirty_ranges(tok).empty());
+    b.write<char>('b', 1500);
+    b.write<char>('c', 2999);
+    b.write<char>('d', 7000);
+    std::vector<BinRange> r = b.dirty_ranges(tok);
+    CHECK(r.size() == 2);
+    CHECK(r[0].offset == 1000 && r[0].length == 2000);
+    CHECK(r[1].offset == 7000 && r[1].length == 1000);
+    // An unknown token means the whole file
+    r = b.dirty_ranges(tok + 100);
+    CHECK(r.size() == 1 && r[0].offset == 0 && r[0].length == 10000);
+    // Writes past EOF mark the gap too
+    b.write<char>('e', 12500);
+    r = b.dirty_ranges(tok);
+    CHECK(r.size() == 3 && r[2].offset == 10000 && r[2].length == 2501);
+  }
+  {
+    // The bitmap survives a clean close
+    Bin b(fname);
+    b.enable_dirty_tracking(1000);
+    std::vector<BinRange> r = b.dirty_ranges(tok);
+    CHECK(r.size() == 3 && r[0].offset == 1000);
+    // Incremental copy to a mirror
+    write_file(copy, std::string(10000, 'a'));
+    Bin dst(copy);
+    CHECK(b.copy_dirty_to(dst, tok) == 2000 + 1000 + 2501);
+    dst.close();
+    CHECK(read_file(copy) == read_file(fname));
+    tok = b.checkpoint();
+  }
+  // A crash after writes in place must not leave a table claiming a
+  // clean file: the next open sees every block as written
+  pid_t pid = fork();
+  if (pid == 0) {
+    Bin b(fname);
+    b.enable_dirty_tracking(1000);
+    std::string more(10000, 'z');
+    // Larger than the buffer of the stream, so it reaches the file at once
+    b.try_write_many(more.data(), more.size(), 0);
+    ::_exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  CHECK(read_file(fname).substr(0, 3) == "zzz");
+  {
+    Bin b(fname);
+    b.enable_dirty_tracking(1000);
+    std::vector<BinRange> r = b.dirty_ranges(tok);
+    CHECK(r.size() == 1 && r[0].offset == 0 && r[0].length == b.size());
+  }
+  // A different block size is refused
+  CHECK_THROWS(Bin(fname).enable_dirty_tracking(512), std::runtime_error);
+  // A failed save of the table is reported by flush() and close()
+  {
+    Bin b(fname);
+    b.enable_dirty_tracking(1000);
+    b.write<char>('f', 0);
+    std::remove(table.c_str());
+    CHECK(mkdir(table.c_str(), 0777) == 0);
+    CHECK_THROWS(b.flush(), std::runtime_error);
+    CHECK(b.get_value<char>(0) == 'f');
+    CHECK_THROWS(b.close(), std::runtime_error);
+    rmdir(table.c_str());
+  }
+  // A short or truncated table is refused
+  for (std::size_t n : {0, 10, 30}) {
+    write_file(table, std::string(n, '\0'));
+    CHECK_THROWS(Bin(fname).enable_dirty_tracking(1000), std::runtime_error);
+  }
+  std::remove(fname.c_str());
+  std::remove(table.c_str());
+  std::remove(copy.c_str());
+  return check_result();
+}
@@ -0,0 +1,188 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <cstring>
+
+static std::string to_hex(const std::string &s) {
+  static const char hex[] = "0123456789abcdef";
+  std::string ret;
+  for (unsigned char b : s) {
+    ret += hex[b >> 4];
+    ret += hex[b & 15];
+  }
+  return ret;
+}
+
+// Encrypt a block with a key made of the bytes 0, 1, 2...
+static std::string encrypt(std::size_t key_len, bool aesni) {
+  unsigned char key[32], block[16];
+  for (int i = 0; i != 32; ++i)
+    key[i] = static_cast<unsigned char>(i);
+  // FIPS-197 appendix C plaintext
+  for (int i = 0; i != 16; ++i)
+    block[i] = static_cast<unsigned char>(i * 0x11);
+  Aes aes(key, key_len, aesni);
+  aes.encrypt_blocks(block, block, 1);
+  return to_hex(std::string(reinterpret_cast<char*>(block), 16));
+}
+
+int main() {
+  // Known answers from FIPS-197 appendix C, with both implementations
+  for (bool aesni : {false, true}) {
+    CHECK(encrypt(16, aesni) == "69c4e0d86a7b0430d8cdb78070b4c55a");
+    CHECK(encrypt(24, aesni) == "dda97ca4864cdfe06eaf70a0ec0d7191");
+    CHECK(encrypt(32, aesni) == "8ea2b7ca516745bfeafc49904b496089");
+  }
+  std::cout << "AES-NI " << (Aes::has_aesni() ? "available" : "not available") << "\n";
+  {
+    // Many blocks: the AES-NI path works four blocks at a time
+    unsigned char key[16] = {1, 2, 3}, a[16 * 7], b[16 * 7];
+    for (int i = 0; i != 16 * 7; ++i)
+      a[i] = b[i] = static_cast<unsigned char>(i * 7);
+    Aes(key, 16, false).encrypt_blocks(a, a, 7);
+    Aes(key, 16, true).encrypt_blocks(b, b, 7);
+    CHECK(std::memcmp(a, b, sizeof(a)) == 0);
+    // Decryption gives the blocks back, with both implementations
+    for (std::size_t len : {16, 24, 32}) {
+      unsigned char k[32] = {9, 8, 7};
+      Aes(k, len, true).encrypt_blocks(b, b, 7);
+      Aes(k, len, false).decrypt_blocks(b, b, 7);
+      CHECK(std::memcmp(a, b, sizeof(a)) == 0);
+      Aes(k, len, false).encrypt_blocks(b, b, 7);
+      Aes(k, len, true).decrypt_blocks(b, b, 7);
+      CHECK(std::memcmp(a, b, sizeof(a)) == 0);
+    }
+  }
+  CHECK_THROWS(Aes(reinterpret_cast<const unsigned char*>("short"), 5), std::domain_error);
+
+  const std::string key = "0123456789abcdef0123456789ABCDEF", f1 = "test_encryption_1.bin", f2 = "test_encryption_2.bin";
+  // IEEE 1619 test vector 4: with the nonce 0 the tweaks are the data unit numbers
+  {
+    const unsigned char k[32] = {0x27, 0x18, 0x28, 0x18, 0x28, 0x45, 0x90, 0x45, 0x23, 0x53, 0x60, 0x28, 0x74, 0x71, 0x35, 0x26,
+                                 0x31, 0x41, 0x59, 0x26, 0x53, 0x58, 0x97, 0x93, 0x23, 0x84, 0x62, 0x64, 0x33, 0x83, 0x27, 0x95};
+    Bin b(f1, true);
+    b.enable_encryption(std::string(reinterpret_cast<const char*>(k), 32), 0);
+    for (int i = 0; i != 512; ++i)
+      b.write<unsigned char>(static_cast<unsigned char>(i), i);
+    b.flush();
+    std::string c = read_file(f1);
+    CHECK(to_hex(c.substr(0, 16)) == "27a7479befa1d476489f308cd4cfa6e2");
+    CHECK(to_hex(c.substr(496)) == "0a282df920147beabe421ee5319d0568");
+  }
+  // Any write and read, against the plain bytes, with sizes which aren't whole blocks
+  {
+    std::string plain_copy;
+    Bin b(f1, true);
+    b.enable_encryption(key, 7);
+    std::uint64_t x = 1;
+    for (int round = 0; round != 3000; ++round) {
+      x = x * 6364136223846793005ull + 1442695040888963407ull;
+      std::size_t p = (x >> 33) % 3000, n = 1 + (x >> 20) % (round % 10 == 0 ? 6000 : 40);
+      if (round % 2 == 0) {
+        std::string s(n, static_cast<char>('a' + round % 26));
+        b.write_string(s, p);
+        if (plain_copy.size() < p + n)
+          plain_copy.resize(p + n, '\0');
+        plain_copy.replace(p, n, s);
+      } else if (p < plain_copy.size()) {
+        n = std::min(n, plain_copy.size() - p);
+        std::vector<char> v = b.get_values<char>(n, p);
+        CHECK(std::string(v.begin(), v.end()) == plain_copy.substr(p, n));
+      }
+    }
+    CHECK(b.size() == static_cast<Bin::size_type>(plain_copy.size()));
+    b.close();
+    Bin c(f1);
+    c.enable_encryption(key, 7);
+    std::vector<char> v = c.get_values<char>(plain_copy.size(), 0);
+    CHECK(std::string(v.begin(), v.end()) == plain_copy);
+  }
+  // Tiny files, shorter than a block, and their growth
+  for (std::size_t n : {1, 15, 16, 17, 31, 33}) {
+    Bin b(f1, true);
+    b.enable_encryption(key, 3);
+    b.write_string(std::string(n, 'x'), 0);
+    b.write_string("y", n);
+    CHECK(b.get_string(n + 1, 0) == std::string(n, 'x') + "y");
+    CHECK(read_file(f1).size() == n + 1 && read_file(f1).find("xxx") == std::string::npos);
+  }
+  // Rewriting a block gives an unrelated block, and leaves the others alone
+  {
+    Bin b(f1, true);
+    b.enable_encryption(key, 5);
+    b.write_string(std::string(64, 'a'), 0);
+    b.flush();
+    std::string before = read_file(f1);
+    b.write_string("b", 20);
+    b.flush();
+    std::string after = read_file(f1);
+    CHECK(before.substr(0, 16) == after.substr(0, 16) && before.substr(32) == after.substr(32));
+    std::size_t same = 0;
+    for (int i = 16; i != 32; ++i)
+      same += before[i] == after[i];
+    CHECK(same < 8);
+  }
+  // The key is made of two different halves
+  CHECK_THROWS(EncryptBuf("0123456789abcdef", 0), std::domain_error);
+  CHECK_THROWS(EncryptBuf(std::string(32, 'k'), 0), std::domain_error);
+  const std::string plain = "the same plaintext in both files";
+  for (const std::string &f : {f1, f2}) {
+    Bin b(f, true);
+    b.enable_encryption(key);
+    b.write_string(plain);
+  }
+  // Same key and plaintext, but each file has its own nonce and keystream
+  std::string c1 = read_file(f1), c2 = read_file(f2);
+  CHECK(c1.size() == plain.size() && c2.size() == plain.size());
+  CHECK(c1 != plain);
+  CHECK(c1 != c2);
+  CHECK(read_file(f1 + ".nonce").size() == 8 && read_file(f1 + ".nonce.tmp").empty());
+  {
+    Bin b(f1);
+    b.enable_encryption(key);
+    CHECK(b.get_string(plain.size(), 0) == plain);
+    // Random access decrypts only the bytes touched
+    CHECK(b.get_string(4, 4) == "same");
+    b.write_string("SAME", 4);
+    CHECK(b.get_string(plain.size(), 0) == "the SAME plaintext in both files");
+  }
+  {
+    Bin b(f2, Bin::Mode::read_only);
+    b.enable_encryption(key);
+    CHECK(b.get_string(plain.size(), 0) == plain);
+  }
+  {
+    // Explicit nonces still work
+    Bin b(f1, true);
+    b.enable_encryption(key, 42);
+    b.write_string(plain);
+    b.close();
+    Bin c(f1);
+    c.enable_encryption(key, 42);
+    CHECK(c.get_string(plain.size(), 0) == plain);
+  }
+  // An encrypted in-memory file saved elsewhere takes its nonce along
+  const std::string f3 = "test_encryption_3.bin";
+  {
+    Bin b("", Bin::Mode::in_memory);
+    b.enable_encryption(key);
+    b.write_string(plain);
+    b.save(f3);
+  }
+  CHECK(read_file(f3).size() == plain.size() && read_file(f3) != plain);
+  {
+    Bin b(f3);
+    b.enable_encryption(key);
+    CHECK(b.get_string(plain.size(), 0) == plain);
+  }
+  // Without its nonce a file with data is refused
+  std::remove((f2 + ".nonce").c_str());
+  {
+    Bin b(f2);
+    CHECK_THROWS(b.enable_encryption(key), std::domain_error);
+  }
+  for (const std::string &f : {f1, f2, f3}) {
+    std::remove(f.c_str());
+    std::remove((f + ".nonce").c_str());
+  }
+  return check_result();
+}
@@ -0,0 +1,63 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <cstdint>
+
+int main() {
+  const std::string fname = "test_fill.bin", other = "test_fill_other.bin";
+  {
+    Bin b(fname, true);
+    b.iota<std::int32_t>(-5, 100000, 0);
+    CHECK(b.size() == 4 * 100000);
+    CHECK(b.get_value<std::int32_t>(0) == -5 && b.get_value<std::int32_t>(4 * 99999) == 99994);
+    // Zeros inside the file and past its end, without writing them
+    b.fill<std::int32_t>(0, 1000, 4 * 10);
+    CHECK(b.wpos() == 4 * 1010);
+    b.fill<std::int64_t>(0, 50000, 4 * 99000);
+    CHECK(b.size() == 4 * 99000 + 8 * 50000);
+    std::vector<std::int32_t> v = b.get_values<std::int32_t>(1100, 0);
+    CHECK(v[9] == 4 && v[10] == 0 && v[1009] == 0 && v[1010] == 1005);
+    CHECK(b.get_value<std::int32_t>(4 * 98999) == 98994 && b.get_value<std::int64_t>(4 * 99000 + 8 * 49999) == 0);
+    // Other values are written
+    b.fill<std::uint16_t>(0xabcd, 3, 2);
+    CHECK(b.get_values<std::uint16_t>(4, 0) == std::vector<std::uint16_t>({0xfffb, 0xabcd, 0xabcd, 0xabcd}));
+    int n = 0;
+    b.generate<double>([&n] { return n++ * 0.5; }, 10000, 0);
+    CHECK(b.get_value<double>(8 * 9999) == 9999 * 0.5);
+  }
+  {
+    // Small chunks with a limiter
+    Bin b(fname, true);
+    b.set_rate_limiter(std::make_shared<RateLimiter>(1e9, 0, 1e-6));
+    b.iota<std::uint8_t>(0, 1000, 0);
+    std::vector<std::uint8_t> v = b.get_values<std::uint8_t>(1000, 0);
+    CHECK(v[255] == 255 && v[256] == 0 && v[999] == 999 % 256);
+  }
+  {
+    // The zeros go to the file opened, even if its name now points to another file
+    Bin b(fname, true);
+    b.fill<char>('x', 100, 0);
+    b.flush();
+    write_file(other, std::string(100, 'y'));
+    CHECK(std::rename(other.c_str(), fname.c_str()) == 0);
+    b.fill<char>(0, 200, 50);
+    CHECK(b.size() == 250);
+    std::vector<char> v = b.get_values<char>(250, 0);
+    CHECK(std::string(v.begin(), v.begin() + 50) == std::string(50, 'x') && std::string(v.begin() + 50, v.end()) == std::string(200, '\0'));
+    CHECK(read_file(fname) == std::string(100, 'y'));
+  }
+  {
+    // With a layer the zeros are written through it
+    Bin b(fname, true);
+    b.enable_encryption(std::string(16, 'k') + std::string(16, 'K'));
+    b.fill<char>('a', 10, 0);
+    b.fill<std::int32_t>(0, 10, 2);
+    CHECK(b.get_string(2, 0) == "aa" && b.get_values<std::int32_t>(10, 2) == std::vector<std::int32_t>(10, 0));
+    CHECK(read_file(fname).substr(2, 40) != std::string(40, '\0'));
+  }
+  {
+    Bin r(fname, Bin::Mode::read_only);
+    CHECK_THROWS(r.fill<char>(0, 10, 0), std::domain_error);
+    CHECK_THROWS(r.iota<int>(0, 10, 0), std::domain_error);
+  }
+  return check_result();
+}
@@ -0,0 +1,110 @@
+#include "check.h"
+#include "bingen.h"
+#include <cfloat>
+
+template <typename T> std::vector<T> column(const std::string &fname) {
+  Bin b(fname);
+  return b.get_values<T>(b.size() / sizeof(T), 0);
+}
+
+template <typename T> bool within(const std::vector<T> &v, T lo, T hi) {
+  for (T x : v)
+    if (!(x >= lo && x <= hi))
+      return false;
+  return true;
+}
+
+int main() {
+  const std::string names[4] = {"test_gen_a.bin", "test_gen_b.bin", "test_gen_c.bin", "test_gen_d.bin"};
+  const std::size_t rows = 200000;
+
+  // Ranges which don't fit in the type are refused
+  {
+    Bin a(names[0], true);
+    auto gen = [&a](ColumnSpec c) { generate_columns({c}, 10, {&a}); };
+    CHECK_THROWS(gen(ColumnSpec(NumType::i8, Distribution::uniform, -200, 0)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::u8, Distribution::uniform, 0, 256)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::u8, Distribution::uniform, 0, 255.6)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::u16, Distribution::uniform, -1, 10)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::i64, Distribution::uniform, 0, 9223372036854775808.0)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::u64, Distribution::uniform, 0, 18446744073709551616.0)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::f32, Distribution::uniform, 0, 1e39)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::f64, Distribution::uniform, 0, NAN)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::i32, Distribution::uniform, 10, 0)), std::domain_error);
+    CHECK_THROWS(gen(ColumnSpec(NumType::i32, Distribution::sparse, 0, 10, 2)), std::domain_error);
+    CHECK(a.size() == 0);
+  }
+
+  // The extremes of the 64-bit types
+  {
+    Bin a(names[0], true), b(names[1], true), c(names[2], true), d(names[3], true);
+    generate_columns({ColumnSpec(NumType::u64, Distribution::uniform, 1e19, 18446744073709549568.0),
+                      ColumnSpec(NumType::i64, Distribution::uniform, -9223372036854775808.0, 9223372036854774784.0),
+                      ColumnSpec(NumType::u64, Distribution::sorted, 0, 18446744073709549568.0),
+                      ColumnSpec(NumType::f64, Distribution::uniform, -DBL_MAX, DBL_MAX)},
+                     rows, {&a, &b, &c, &d}, 7);
+  }
+  {
+    std::vector<std::uint64_t> a = column<std::uint64_t>(names[0]), c = column<std::uint64_t>(names[2]);
+    std::vector<std::int64_t> b = column<std::int64_t>(names[1]);
+    std::vector<double> d = column<double>(names[3]);
+    CHECK(a.size() == rows && within<std::uint64_t>(a, 10000000000000000000ull, 18446744073709549568ull));
+    CHECK(within<std::int64_t>(b, INT64_MIN, 9223372036854774784ll));
+    CHECK(std::count_if(b.begin(), b.end(), [](std::int64_t x) { return x < 0; }) > static_cast<std::ptrdiff_t>(rows / 3));
+    CHECK(std::is_sorted(c.begin(), c.end()) && c.front() < 1000000000000000ull && c.back() > 18446000000000000000ull);
+    CHECK(within<double>(d, -DBL_MAX, DBL_MAX));
+  }
+
+  // Small types: every value of the range, and nothing outside it
+  {
+    Bin a(names[0], true), b(names[1], true), c(names[2], true), d(names[3], true);
+    generate_columns({ColumnSpec(NumType::u8, Distribution::uniform, 0, 255),
+                      ColumnSpec(NumType::i8, Distribution::zipf, -128, 127, 1.2),
+                      ColumnSpec(NumType::i16, Distribution::runs, -5, 5, 10),
+                      ColumnSpec(NumType::f32, Distribution::sparse, 1, 2, 0.25)},
+                     rows, {&a, &b, &c, &d}, 7);
+  }
+  {
+    std::vector<std::uint8_t> a = column<std::uint8_t>(names[0]);
+    std::vector<std::int8_t> b = column<std::int8_t>(names[1]);
+    std::vector<std::int16_t> c = column<std::int16_t>(names[2]);
+    std::vector<float> d = column<float>(names[3]);
+    std::vector<int> seen(256);
+    for (std::uint8_t x : a)
+      ++seen[x];
+    CHECK(std::count(seen.begin(), seen.end(), 0) == 0);
+    CHECK(std::count(b.begin(), b.end(), -128) > std::count(b.begin(), b.end(), -127));
+    CHECK(std::count(b.begin(), b.end(), -127) > std::count(b.begin(), b.end(), 0));
+    CHECK(within<std::int16_t>(c, -5, 5));
+    std::size_t changes = 0;
+    for (std::size_t i = 1; i != c.size(); ++i)
+      changes += c[i] != c[i - 1];
+    CHECK(changes < rows / 5);
+    std::size_t zeros = std::count(d.begin(), d.end(), 0.0f);
+    CHECK(zeros > rows * 7 / 10 && zeros < rows * 8 / 10);
+    d.erase(std::remove(d.begin(), d.end(), 0.0f), d.end());
+    CHECK(within<float>(d, 1, 2));
+  }
+
+  // The dataset depends only on the seed, and records hold the same values as columns
+  const std::vector<ColumnSpec> layout = {ColumnSpec(NumType::i32, Distribution::uniform, -1000, 1000),
+                                          ColumnSpec(NumType::f64, Distribution::sorted, 0, 1)};
+  {
+    Bin a(names[0], true), b(names[1], true), r1(names[2], true), r4(names[3], true, false);
+    generate_columns(layout, rows, {&a, &b}, 3, 1);
+    generate_records(layout, rows, r1, 3, 4);
+    generate_records(layout, rows, r4, 3, 3);
+  }
+  {
+    std::vector<std::int32_t> a = column<std::int32_t>(names[0]);
+    std::vector<double> b = column<double>(names[1]);
+    Bin r1(names[2]), r4(names[3], false, false);
+    bool same = true;
+    for (std::size_t i = 0; i < rows; i += 997) {
+      same = same && r1.get_value<std::int32_t>(12 * i) == a[i] && r1.get_value<double>(12 * i + 4) == b[i];
+      same = same && r4.get_value<std::int32_t>(12 * i) == a[i] && r4.get_value<double>(12 * i + 4) == b[i];
+    }
+    CHECK(same);
+  }
+  return check_result();
+}
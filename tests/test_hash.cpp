@@ -0,0 +1,58 @@
+#include "check.h"
+#include "readwritebin.h"
+
+int main() {
+  // Known answers of XXH64, computed with the reference implementation
+  std::string data(200, '\0');
+  for (int i = 0; i != 200; ++i)
+    data[i] = static_cast<char>((i * 37 + 11) & 0xff);
+  struct Case { std::size_t n; std::uint64_t seed0, seed1; };
+  const Case cases[] = {
+    {0, 0xef46db3751d8e999ull, 0xc4349fc93c010000ull},
+    {1, 0xf592c0c7639c4cb6ull, 0x3f7ebbd0a20f83ccull},
+    {3, 0x22c08528601d4f27ull, 0xb829b5fbba7f12fbull},
+    {4, 0xfb1e5cf2f1ae4d95ull, 0x4d32e4c842c6371eull},
+    {7, 0x5613ac510496c04eull, 0x566314bf1bda8aabull},
+    {8, 0x57cb2b7521f3e21aull, 0x696e1fe0e0df37f4ull},
+    {31, 0xe4a0e629e519a4aeull, 0xa348b910bc65b7bdull},
+    {32, 0xcc6b8aaada790b2dull, 0x41c2eada450d18f0ull},
+    {33, 0x35ec49850475a832ull, 0xb6f8c0b76af8f9daull},
+    {63, 0xbf9f0ba3cf95b28aull, 0xdcfe31720304f52bull},
+    {64, 0x155ccce4bf32befcull, 0x4779d2a26a5085a9ull},
+    {100, 0x4826e367566ea023ull, 0xe38491a6daeb0e8aull},
+    {200, 0x2f074b6dd9094e34ull, 0x6ed28da9cdbd792dull},
+  };
+  for (const Case &c : cases) {
+    CHECK(xxhash64(data.data(), c.n) == c.seed0);
+    CHECK(xxhash64(data.data(), c.n, 0x9e3779b97f4a7c15ull) == c.seed1);
+  }
+  CHECK(xxhash64("abc", 3) == 0x44bc2cf5ad770999ull);
+
+  // The tree hash doesn't depend on the number of threads or on the mode
+  const std::string fname = "test_hash.bin";
+  std::string content;
+  for (int i = 0; i != (3 << 20) + 123; ++i)
+    content += static_cast<char>(i * 7);
+  write_file(fname, content);
+  std::uint64_t h;
+  {
+    Bin b(fname);
+    h = b.hash(1);
+    CHECK(b.hash(3) == h);
+    CHECK(b.hash_region(5, 100, 2) == b.hash_region(5, 100, 1));
+    CHECK(b.hash_region(5, 100) != b.hash_region(6, 100));
+    CHECK_THROWS(b.hash_region(0, content.size() + 1), std::runtime_error);
+  }
+  {
+    Bin b(fname, Bin::Mode::read_only);
+    CHECK(b.hash(4) == h);
+  }
+  {
+    Bin b(fname, Bin::Mode::in_memory);
+    CHECK(b.hash() == h);
+    b.write<char>('!', 10);
+    CHECK(b.hash() != h);
+  }
+  std::remove(fname.c_str());
+  return check_result();
+}
@@ -0,0 +1,62 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main() {
+  const std::string fname = "test_in_memory.bin", other = "test_in_memory_other.bin", dir = "test_in_memory_dir";
+  {
+    // The file is loaded, and it is written back only by save()
+    write_file(fname, "abcdef");
+    Bin m(fname, Bin::Mode::in_memory);
+    CHECK(m.size() == 6 && m.get_string(3, 0) == "abc");
+    m.write_string("XY", 1);
+    m.write<std::int32_t>(-7, 10);
+    CHECK(m.size() == 14 && m.get_values<char>(4, 6) == std::vector<char>(4, '\0'));
+    CHECK(read_file(fname) == "abcdef");
+    m.save();
+    std::string saved = read_file(fname);
+    CHECK(saved.size() == 14 && saved.substr(0, 10) == std::string("aXYdef\0\0\0\0", 10));
+    CHECK(read_file(fname + ".tmp").empty());
+    Bin back(fname);
+    CHECK(back.size() == 14 && back.get_value<std::int32_t>(10) == -7);
+    // The content can be saved elsewhere too
+    m.write_string("Z", 0);
+    m.save(other);
+    CHECK(read_file(other).substr(0, 4) == "ZXYd" && read_file(fname)[0] == 'a');
+  }
+  {
+    // A staging buffer without a file
+    Bin m("", Bin::Mode::in_memory);
+    CHECK(m.size() == 0);
+    m.write_many<double>({1.5, 2.5}, 0);
+    CHECK(m.get_values<double>(2, 0) == std::vector<double>({1.5, 2.5}));
+    CHECK_THROWS(m.save(), std::domain_error);
+    m.save(other);
+    Bin back(other, Bin::Mode::in_memory);
+    CHECK(back.get_value<double>(8) == 2.5);
+    // An empty buffer saves an empty file
+    Bin e("", Bin::Mode::in_memory);
+    e.save(other);
+    CHECK(read_file(other).empty());
+  }
+  {
+    // A failed save leaves the old file and no temporary file
+    ::mkdir(dir.c_str(), 0755);
+    Bin m("", Bin::Mode::in_memory);
+    m.write_string("data", 0);
+    CHECK_THROWS(m.save(dir), std::runtime_error);
+    struct stat st;
+    CHECK(stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+    CHECK(stat((dir + ".tmp").c_str(), &st) != 0);
+    CHECK_THROWS(m.save(dir + "/missing/file.bin"), std::domain_error);
+    ::rmdir(dir.c_str());
+    m.close();
+    CHECK_THROWS(m.save(other), std::domain_error);
+    Bin f(fname);
+    CHECK_THROWS(f.save(other), std::domain_error);
+  }
+  std::remove(fname.c_str());
+  std::remove(other.c_str());
+  return check_result();
+}
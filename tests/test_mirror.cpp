@@ -0,0 +1,43 @@
+#include "check.h"
+#include "readwritebin.h"
+
+int main() {
+  const std::string fname = "test_mirror.bin", mirror = "test_mirror_copy.bin";
+  {
+    write_file(fname, "initial");
+    Bin b(fname);
+    const MirrorBuf &layer = b.enable_mirroring(mirror, 64);
+    // The current content is copied, the writes follow in order
+    for (int i = 0; i != 1000; ++i)
+      b.write<int>(i, 7 + 4 * i);
+    b.write_string("INIT", 0);
+    b.flush();
+    CHECK(layer.lag() == 0 && !layer.failed());
+    CHECK(read_file(mirror) == read_file(fname));
+    CHECK(b.get_value<int>(7 + 4 * 999) == 999);
+  }
+  CHECK(read_file(mirror) == read_file(fname) && read_file(fname).substr(0, 7) == "INITial");
+
+  // A failing mirror is reported by flush() and close(), and the file can still be used
+  {
+    write_file(fname, "");
+    Bin b(fname);
+    const MirrorBuf &layer = b.enable_mirroring("/dev/full");
+    b.write_string(std::string(1 << 16, 'a'), 0);
+    std::string what;
+    try {
+      b.flush();
+    } catch (const std::runtime_error &e) {
+      what = e.what();
+    }
+    CHECK(what == "Couldn't write the mirror file!");
+    CHECK(layer.failed());
+    CHECK(b.get_value<char>(100) == 'a');
+    CHECK(b.size() == 1 << 16);
+    b.write<char>('b', 0);
+    CHECK_THROWS(b.close(), std::runtime_error);
+    CHECK_THROWS(b.size(), std::domain_error);
+  }
+  CHECK(read_file(fname).size() == 1 << 16 && read_file(fname)[0] == 'b');
+  return check_result();
+}
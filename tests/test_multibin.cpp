@@ -0,0 +1,32 @@
+#include "check.h"
+#include "multibin.h"
+
+int main() {
+  const std::string a = "test_multibin_a.bin", b = "test_multibin_b.bin";
+  write_file(a, "abcd");
+  write_file(b, "efghijkl");
+  MultiBin m({a, b});
+  CHECK(m.size() == 12);
+  CHECK(m.get_values<char>(4, 2) == std::vector<char>({'c', 'd', 'e', 'f'}));
+
+  // A rolling segment grows on disk: refresh() sees the new bytes
+  {
+    Bin w(b);
+    w.write_many<char>({'m', 'n', 'o', 'p', 'q', 'r', 's', 't'}, 8);
+  }
+  CHECK(m.size() == 12);
+  m.refresh();
+  CHECK(m.size() == 20);
+  CHECK(m.get_value<char>(19) == 't');
+
+  // A segment shrinking is seen as well
+  write_file(a, "ab");
+  m.refresh();
+  CHECK(m.size() == 18);
+  CHECK(m.get_values<char>(3, 1) == std::vector<char>({'b', 'e', 'f'}));
+  CHECK_THROWS(m.rjump_to(19), std::domain_error);
+
+  std::remove(a.c_str());
+  std::remove(b.c_str());
+  return check_result();
+}
@@ -0,0 +1,91 @@
+#include "check.h"
+#include "binobject.h"
+
+enum class Color : std::uint8_t { red, green, blue };
+
+int main() {
+  const std::string fname = "test_object.bin";
+  using Object = std::map<std::string, std::tuple<std::vector<double>, std::array<Color, 3>,
+                                                  std::unordered_map<int, std::vector<std::string>>>>;
+  Object obj;
+  for (int i = 0; i != 50; ++i) {
+    auto &e = obj["key" + std::to_string(i)];
+    // Some arrays small enough to be staged, some written directly
+    std::get<0>(e).resize(i * i * 20);
+    for (std::size_t j = 0; j != std::get<0>(e).size(); ++j)
+      std::get<0>(e)[j] = j * 0.5 - i;
+    std::get<1>(e) = {{Color::red, Color::green, static_cast<Color>(i % 3)}};
+    for (int k = 0; k != i % 4; ++k)
+      std::get<2>(e)[k] = std::vector<std::string>(k, std::string(k + i, 'a' + k));
+  }
+
+  // Both endiannesses, at the current and at a given position
+  for (bool little : {true, false}) {
+    {
+      Bin b(fname, true, little);
+      b.write<int>(12345);
+      write_object(b, obj);
+      write_object(b, std::vector<std::pair<short, std::string>>{{1, "one"}, {-2, ""}, {3, "three"}});
+    }
+    Bin b(fname, false, little);
+    CHECK(b.get_value<int>() == 12345);
+    Object back;
+    read_object(b, back);
+    CHECK(back == obj);
+    std::vector<std::pair<short, std::string>> v;
+    read_object(b, v);
+    CHECK(v.size() == 3 && v[1].first == -2 && v[1].second.empty() && v[2].second == "three");
+    CHECK(b.rpos() == b.size());
+    Object again;
+    read_object(b, again, 4);
+    CHECK(again == obj);
+  }
+
+  // Empty containers
+  {
+    Bin b(fname, true);
+    write_object(b, std::vector<std::vector<int>>(3), 0);
+    std::vector<std::vector<int>> v{{1, 2}};
+    read_object(b, v, 0);
+    CHECK(v.size() == 3 && v[0].empty() && v[2].empty());
+  }
+
+  // A wrong type or a truncated file is reported
+  {
+    Bin b(fname, true);
+    write_object(b, std::vector<std::vector<int>>{{1, 2}, {3}}, 0);
+    std::vector<int> flat;
+    CHECK_THROWS(read_object(b, flat, 0), std::runtime_error);
+    b.write<std::uint64_t>(~0ull, 0);
+    std::vector<std::vector<int>> v;
+    CHECK_THROWS(read_object(b, v, 0), std::runtime_error);
+  }
+  // A corrupted length is reported before the container is sized
+  {
+    Bin b(fname, true);
+    write_object(b, std::vector<std::string>{"abc", "", "de"}, 0);
+    // The count of lengths, then the length of the vector
+    b.write<std::uint64_t>(std::uint64_t(1) << 40, 8);
+    std::vector<std::string> v;
+    CHECK_THROWS(read_object(b, v, 0), std::runtime_error);
+    write_object(b, std::vector<std::string>{"abc", "", "de"}, 0);
+    b.write<std::uint64_t>(std::uint64_t(1) << 40, 16);
+    CHECK_THROWS(read_object(b, v, 0), std::runtime_error);
+    write_object(b, std::map<int, std::vector<double>>{{1, {2.0}}}, 0);
+    b.write<std::uint64_t>(~0ull / 2, 8);
+    std::map<int, std::vector<double>> m;
+    CHECK_THROWS(read_object(b, m, 0), std::runtime_error);
+    // Containers taking no bytes of the body are bounded by the table only
+    b.close();
+    Bin c(fname, true);
+    write_object(c, std::vector<std::string>(100000), 0);
+    write_object(c, std::vector<std::array<std::vector<int>, 0>>(7));
+    CHECK(c.size() == 8 * (2 + 100000) + 8 * 2);
+    read_object(c, v, 0);
+    CHECK(v.size() == 100000 && v[99999].empty());
+    std::vector<std::array<std::vector<int>, 0>> empty;
+    read_object(c, empty);
+    CHECK(empty.size() == 7);
+  }
+  return check_result();
+}
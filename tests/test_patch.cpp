@@ -0,0 +1,76 @@
+#include "check.h"
+#include "binpatch.h"
+
+// Make a patch from a to b, apply it to a and compare the result with b
+static bool round_trip(const std::string &a, const std::string &b, Bin::size_type block, Bin::size_type *patch_size = nullptr) {
+  write_file("test_patch_old.bin", a);
+  write_file("test_patch_new.bin", b);
+  {
+    Bin old_bin("test_patch_old.bin"), new_bin("test_patch_new.bin"), patch("test_patch.patch", true);
+    make_patch(old_bin, new_bin, patch, block);
+    if (patch_size)
+      *patch_size = patch.size();
+  }
+  {
+    Bin old_bin("test_patch_old.bin"), patch("test_patch.patch"), out("test_patch_out.bin", true);
+    apply_patch(old_bin, patch, out);
+  }
+  return read_file("test_patch_out.bin") == b;
+}
+
+// Deterministic pseudo-random bytes
+static std::string noise(std::size_t n, unsigned seed) {
+  std::string s(n, '\0');
+  for (std::size_t i = 0; i != n; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    s[i] = static_cast<char>(seed >> 16);
+  }
+  return s;
+}
+
+int main() {
+  const std::string base = noise(200000, 1);
+  Bin::size_type size = 0;
+
+  CHECK(round_trip(base, base, 1024, &size));
+  CHECK(size < 1000);
+  CHECK(round_trip("", "", 1024));
+  CHECK(round_trip(base, "", 1024));
+  CHECK(round_trip("", base, 1024));
+
+  // Edits: the unchanged blocks become copies
+  std::string edited = base.substr(0, 50000) + "inserted bytes" + base.substr(50000, 70000) + base.substr(130000);
+  edited[150000] ^= 1;
+  CHECK(round_trip(base, edited, 1024, &size));
+  CHECK(size < 10000);
+  CHECK(round_trip(edited, base, 1024));
+  CHECK(round_trip(base, base.substr(333), 1024));
+  CHECK(round_trip(base, noise(1000, 2) + base, 1024));
+
+  // The old file is smaller than a block and the new one larger than the
+  // read window: the tail is emitted a window at a time
+  CHECK(round_trip("", noise(10 << 20, 3), 4096));
+  CHECK(round_trip("tiny", noise((4 << 20) + 17, 4), 4096));
+  CHECK(round_trip(base.substr(0, 100), base, 4096));
+
+  // The patch refuses a different old file
+  write_file("test_patch_old.bin", base);
+  write_file("test_patch_new.bin", edited);
+  {
+    Bin old_bin("test_patch_old.bin"), new_bin("test_patch_new.bin"), patch("test_patch.patch", true);
+    make_patch(old_bin, new_bin, patch, 1024);
+  }
+  write_file("test_patch_old.bin", base.substr(1));
+  {
+    Bin old_bin("test_patch_old.bin"), patch("test_patch.patch"), out("test_patch_out.bin", true);
+    CHECK_THROWS(apply_patch(old_bin, patch, out), std::runtime_error);
+  }
+  write_file("test_patch_old.bin", "not a patch");
+  {
+    Bin old_bin("test_patch_old.bin"), patch("test_patch_old.bin"), out("test_patch_out.bin", true);
+    CHECK_THROWS(apply_patch(old_bin, patch, out), std::runtime_error);
+  }
+  for (const char *f : {"test_patch_old.bin", "test_patch_new.bin", "test_patch.patch", "test_patch_out.bin"})
+    std::remove(f);
+  return check_result();
+}
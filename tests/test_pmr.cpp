@@ -0,0 +1,150 @@
+#include "check.h"
+#include "binpmr.h"
+#include <map>
+#include <vector>
+#include <functional>
+#include <thread>
+
+using Vec = std::vector<int, BinAllocator<int>>;
+using Map = std::map<int, double, std::less<int>, BinAllocator<std::pair<const int, double>>>;
+
+int main() {
+  const std::string a = "test_pmr_a.heap", b = "test_pmr_b.heap", c = "test_pmr_c.heap";
+  std::remove(a.c_str());
+  std::remove(b.c_str());
+  std::remove(c.c_str());
+  const std::uintptr_t base_a = BinMemoryResource::default_base;
+  const std::uintptr_t base_b = base_a + (std::uintptr_t(1) << 32);
+
+  CHECK_THROWS(Vec(), std::domain_error);
+  {
+    BinMemoryResource ha(a, 1 << 24, base_a);
+    Map &m = ha.find_or_construct<Map>();
+    BinMemoryResource hb(b, 1 << 24, base_b);
+    CHECK(BinMemoryResource::current() == &hb);
+    // The root of a is bound to a even if b is current
+    Map &m2 = ha.find_or_construct<Map>();
+    CHECK(&m2 == &m && m.get_allocator().base_address() == base_a);
+    Vec &v = hb.find_or_construct<Vec>();
+    for (int i = 0; i != 1000; ++i) {
+      m[i] = i * 0.5;
+      v.push_back(i);
+    }
+    CHECK(BinMemoryResource::find(base_a) == &ha && BinMemoryResource::find(base_b) == &hb);
+    // The nodes of the map are in a, the elements of the vector in b
+    CHECK(reinterpret_cast<std::uintptr_t>(&m.begin()->second) - base_a < (1 << 24));
+    CHECK(reinterpret_cast<std::uintptr_t>(v.data()) - base_b < (1 << 24));
+
+    // Another heap with the same base, or a base taken by another mapping, is refused
+    CHECK_THROWS(BinMemoryResource(c, 1 << 24, base_a), std::runtime_error);
+    std::remove(c.c_str());
+    const std::uintptr_t base_c = base_b + (std::uintptr_t(1) << 32);
+    void *taken = mmap(reinterpret_cast<void*>(base_c), 1 << 16, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(taken == reinterpret_cast<void*>(base_c));
+    CHECK_THROWS(BinMemoryResource(c, 1 << 24, base_c), std::runtime_error);
+    munmap(taken, 1 << 16);
+    std::remove(c.c_str());
+    CHECK_THROWS(BinMemoryResource(c, 1 << 24, base_c + 1), std::runtime_error);
+    std::remove(c.c_str());
+  }
+  CHECK(BinMemoryResource::current() == nullptr);
+  {
+    // After closing b, the map of a still allocates and frees in a
+    BinMemoryResource ha(a);
+    Map &m = ha.find_or_construct<Map>();
+    {
+      BinMemoryResource hb(b);
+      Vec &v = hb.find_or_construct<Vec>();
+      CHECK(v.size() == 1000 && v[999] == 999);
+    }
+    CHECK(m.size() == 1000 && m[999] == 999 * 0.5);
+    BinMemoryResource::size_type used = ha.used();
+    for (int i = 0; i != 1000; ++i)
+      m.erase(i);
+    for (int i = 0; i != 1000; ++i)
+      m[i] = -i;
+    // The memory given back is used again
+    CHECK(ha.used() == used);
+    Map moved(std::move(m));
+    CHECK(moved.size() == 1000 && m.empty());
+    m.swap(moved);
+  }
+  {
+    BinMemoryResource hb(b);
+    {
+      BinMemoryResource ha(a);
+      CHECK(ha.find_or_construct<Map>()[500] == -500);
+    }
+    Vec &v = hb.find_or_construct<Vec>();
+    v.clear();
+    v.shrink_to_fit();
+    CHECK(v.capacity() == 0);
+  }
+  {
+    // The free blocks are merged: after freeing everything the heap is empty again
+    BinMemoryResource hc(c, 1 << 26, base_b + (std::uintptr_t(1) << 32));
+    const BinMemoryResource::size_type empty = hc.used();
+    std::vector<std::pair<void*, std::size_t>> blocks;
+    std::uint64_t x = 1;
+    for (int i = 0; i != 5000; ++i) {
+      x = x * 6364136223846793005ull + 1442695040888963407ull;
+      std::size_t n = 1 + (x >> 33) % 2000;
+      blocks.emplace_back(hc.allocate(n, 8), n);
+      std::memset(blocks.back().first, 0x5a, n);
+    }
+    for (std::size_t i = 0; i != blocks.size(); ++i)
+      std::swap(blocks[i], blocks[(i * 7919) % blocks.size()]);
+    for (auto &b : blocks)
+      hc.deallocate(b.first, b.second, 8);
+    CHECK(hc.used() == empty);
+
+    // Two neighbours freed make room for a block as large as both, below the top
+    void *a1 = hc.allocate(1000, 8), *a2 = hc.allocate(1000, 8), *a3 = hc.allocate(1000, 8), *a4 = hc.allocate(16, 8);
+    BinMemoryResource::size_type top = hc.used();
+    hc.deallocate(a2, 1000, 8);
+    hc.deallocate(a3, 1000, 8);
+    CHECK(hc.allocate(2000, 8) == a2 && hc.used() == top);
+    hc.deallocate(a2, 2000, 8);
+    hc.deallocate(a1, 1000, 8);
+    hc.deallocate(a4, 16, 8);
+    CHECK(hc.used() == empty);
+
+    // A long run of random allocations and frees doesn't make the heap grow without limit
+    blocks.clear();
+    BinMemoryResource::size_type peak = 0;
+    for (int i = 0; i != 200000; ++i) {
+      x = x * 6364136223846793005ull + 1442695040888963407ull;
+      if (blocks.size() < 1000 && (x >> 63 || blocks.empty())) {
+        std::size_t n = 16 + (x >> 20) % 4000;
+        blocks.emplace_back(hc.allocate(n, 8), n);
+      } else {
+        std::size_t k = (x >> 20) % blocks.size();
+        hc.deallocate(blocks[k].first, blocks[k].second, 8);
+        blocks[k] = blocks.back();
+        blocks.pop_back();
+      }
+      peak = std::max(peak, hc.used());
+    }
+    // At most 1000 live blocks of about 4 KB
+    CHECK(peak < 8 * 1000 * 4096);
+    for (auto &b : blocks)
+      hc.deallocate(b.first, b.second, 8);
+    CHECK(hc.used() == empty);
+
+    // The allocators of one heap are used by many threads at once
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t)
+      threads.emplace_back([&hc] {
+        for (int i = 0; i != 200; ++i) {
+          Vec v{BinAllocator<int>(hc)};
+          for (int j = 0; j != 100; ++j)
+            v.push_back(j);
+        }
+      });
+    for (auto &t : threads)
+      t.join();
+    CHECK(hc.used() == empty);
+  }
+  std::remove(c.c_str());
+  return check_result();
+}
@@ -0,0 +1,87 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <atomic>
+
+int main() {
+  const std::size_t n_files = 150;
+  std::vector<std::string> paths;
+  std::vector<std::string> contents;
+  for (std::size_t i = 0; i != n_files; ++i) {
+    paths.push_back("test_read_many_" + std::to_string(i) + ".bin");
+    // Empty files, small ones and a few larger than the usual stream buffers
+    std::string c(i % 7 == 0 ? 0 : (i * 997) % 70000, static_cast<char>('a' + i % 26));
+    if (!c.empty())
+      c[c.size() / 2] = static_cast<char>(i);
+    contents.push_back(c);
+    write_file(paths.back(), c);
+  }
+
+  // Every file is read once, with any number of threads
+  for (unsigned threads : {1u, 4u, 0u, 1000u}) {
+    std::vector<std::string> got(n_files);
+    std::vector<int> calls(n_files);
+    std::atomic<int> running(0), most(0);
+    Bin::read_many_files(paths, [&](std::size_t i, const char *data, Bin::size_type size) {
+      int now = ++running;
+      for (int m = most; now > m && !most.compare_exchange_weak(m, now);) { }
+      got[i].assign(data, size);
+      ++calls[i];
+      --running;
+    }, threads);
+    CHECK(got == contents);
+    CHECK(std::count(calls.begin(), calls.end(), 1) == static_cast<std::ptrdiff_t>(n_files));
+    CHECK(threads == 0 || most <= static_cast<int>(threads));
+  }
+  int none = 0;
+  Bin::read_many_files({}, [&none](std::size_t, const char*, Bin::size_type) { ++none; }, 4);
+  CHECK(none == 0);
+
+  // The first error stops the batch and is rethrown
+  {
+    std::vector<std::string> broken = paths;
+    broken[40] = "test_read_many_missing_a.bin";
+    broken[90] = "test_read_many_missing_b.bin";
+    std::size_t calls = 0;
+    std::string what;
+    try {
+      Bin::read_many_files(broken, [&calls](std::size_t, const char*, Bin::size_type) { ++calls; }, 1);
+    } catch (const std::domain_error &e) {
+      what = e.what();
+    }
+    CHECK(what == "Couldn't open file test_read_many_missing_a.bin!");
+    CHECK(calls == 40);
+    std::atomic<std::size_t> seen(0);
+    CHECK_THROWS(Bin::read_many_files(broken, [&seen](std::size_t, const char*, Bin::size_type) { ++seen; }, 4),
+                 std::domain_error);
+    CHECK(seen < n_files - 1);
+  }
+  {
+    // An exception of the callback is rethrown as it is
+    struct Stop { std::size_t at; };
+    std::size_t at = n_files;
+    try {
+      Bin::read_many_files(paths, [](std::size_t i, const char*, Bin::size_type) {
+        if (i == 7 || i == 8)
+          throw Stop{i};
+      }, 1);
+    } catch (const Stop &s) {
+      at = s.at;
+    }
+    CHECK(at == 7);
+    std::atomic<int> stops(0);
+    try {
+      Bin::read_many_files(paths, [&stops](std::size_t i, const char*, Bin::size_type) {
+        if (i % 10 == 3) {
+          ++stops;
+          throw Stop{i};
+        }
+      }, 4);
+    } catch (const Stop &s) {
+      at = s.at;
+    }
+    CHECK(at % 10 == 3 && stops >= 1 && stops <= 4);
+  }
+  for (const std::string &p : paths)
+    std::remove(p.c_str());
+  return check_result();
+}
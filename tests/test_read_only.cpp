@@ -0,0 +1,61 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <cstring>
+
+int main() {
+  const std::string fname = "test_read_only.bin", empty = "test_read_only_empty.bin";
+  {
+    Bin b(fname, true);
+    b.iota<std::int32_t>(0, 10000, 0);
+    b.write<double>(2.5);
+  }
+  {
+    // The reads come from the shared mapping
+    Bin r(fname, Bin::Mode::read_only);
+    CHECK(r.size() == 4 * 10000 + 8);
+    CHECK(r.get_value<std::int32_t>(4 * 1234) == 1234 && r.get_value<double>(4 * 10000) == 2.5);
+    std::vector<std::int32_t> v = r.get_values<std::int32_t>(3, 4 * 9997);
+    CHECK(v == std::vector<std::int32_t>({9997, 9998, 9999}));
+    CHECK(r.rpos() == 4 * 10000);
+    std::int32_t x = 0;
+    r.rjump_to(8);
+    CHECK(r.try_get_value(x) == Bin::Status::ok && x == 2);
+    CHECK(r.try_get_values_into(&x, 2, r.size() - 4) == Bin::Status::eof);
+    CHECK(r.data() != nullptr);
+    std::memcpy(&x, r.data() + 4 * 77, 4);
+    CHECK(x == 77);
+    CHECK(r.window(4 * 100, 8).get_value<std::int32_t>(4) == 101);
+    CHECK_THROWS(r.get_value<std::int32_t>(r.size() - 2), std::runtime_error);
+
+    // The writes are refused and nothing changes
+    CHECK(r.try_write(1) == Bin::Status::read_only);
+    CHECK(r.try_write(1, 0) == Bin::Status::read_only);
+    CHECK(r.try_write_many(v.data(), v.size(), 0) == Bin::Status::read_only);
+    CHECK_THROWS(r.write<std::int32_t>(1, 0), std::domain_error);
+    CHECK_THROWS(r.write_many(v, 0), std::domain_error);
+    CHECK_THROWS(r.write_string("abc", 0), std::domain_error);
+    CHECK(r.get_value<std::int32_t>(0) == 0 && r.size() == 4 * 10000 + 8);
+  }
+  // A file which doesn't exist isn't created
+  std::remove(empty.c_str());
+  CHECK_THROWS(Bin(empty, Bin::Mode::read_only), std::domain_error);
+  CHECK(std::fopen(empty.c_str(), "r") == nullptr);
+  {
+    // An empty file has no mapping and nothing to read
+    write_file(empty, "");
+    Bin r(empty, Bin::Mode::read_only);
+    CHECK(r.size() == 0 && r.data() == nullptr);
+    char c = 0;
+    CHECK(r.try_get_value(c) == Bin::Status::eof);
+    CHECK(r.try_get_value(c, 0) == Bin::Status::eof);
+    CHECK(r.get_values<char>(0, 0).empty());
+    CHECK_THROWS(r.get_value<char>(0), std::runtime_error);
+    CHECK(r.try_write(c) == Bin::Status::read_only);
+    r.close();
+    CHECK(r.try_get_value(c) == Bin::Status::closed);
+  }
+  CHECK(read_file(empty).empty());
+  std::remove(fname.c_str());
+  std::remove(empty.c_str());
+  return check_result();
+}
@@ -0,0 +1,66 @@
+#include "check.h"
+#include "binscheduler.h"
+
+int main() {
+  using Priority = BinScheduler::Priority;
+  const std::string fname = "test_scheduler.bin";
+  {
+    // Foreground operations run before the queued background chunks
+    Bin b(fname, true);
+    BinScheduler s(b, 1000);
+    std::promise<void> gate;
+    std::shared_future<void> open = gate.get_future().share();
+    s.submit([open](Bin &) { open.wait(); });
+    std::vector<int> order;
+    std::future<void> bg = s.write(std::vector<char>(10000, 'y'), 0);
+    s.submit([&order](Bin &) { order.push_back(1); }, Priority::background);
+    std::size_t queued = 0;
+    std::future<void> fg = s.submit([&](Bin &) {
+      order.push_back(0);
+      queued = s.pending(Priority::background);
+    });
+    gate.set_value();
+    fg.get();
+    bg.get();
+    s.flush().get();
+    CHECK(queued == 11);
+    CHECK(order == std::vector<int>({0, 1}));
+    CHECK(s.read<char>(10000, 0).get() == std::vector<char>(10000, 'y'));
+
+    // Foreground writes and submitted operations
+    s.write(std::vector<int>{1, 2}, 0, Priority::foreground).get();
+    int v = 0;
+    s.submit([&v](Bin &f) { v = f.get_value<int>(4); }).get();
+    CHECK(v == 2);
+  }
+  {
+    Bin b(fname, true);
+    b.write_many<char>(std::vector<char>(4096, 'x'));
+    b.flush();
+    // 100 B/s: the first 4 KiB chunk leaves the limiter in debt for about 40 s
+    b.set_rate_limiter(std::make_shared<RateLimiter>(100));
+    BinScheduler s(b);
+    std::future<void> bg = s.write(std::vector<char>(4 * 4096, 'y'), 4096);
+
+    // A foreground read doesn't wait for the pacing of the background write
+    std::vector<char> got = s.read<char>(4, 0).get();
+    CHECK(got == std::vector<char>(4, 'x'));
+    CHECK(s.pending(Priority::background) == 4);
+    CHECK(bg.wait_for(std::chrono::seconds(0)) != std::future_status::ready);
+
+    // Without the limiter the chunks are dispatched at once
+    s.submit([](Bin &f) { f.set_rate_limiter(nullptr); }).get();
+    bg.get();
+    CHECK(s.pending(Priority::background) == 0);
+    CHECK(s.read<char>(2, 4096 + 4 * 4096 - 2).get() == std::vector<char>(2, 'y'));
+  }
+  {
+    // The errors of the chunks come back through the future
+    Bin b(fname, Bin::Mode::read_only);
+    BinScheduler s(b, 100);
+    std::future<void> bg = s.write(std::vector<char>(1000, 'z'), 0);
+    CHECK_THROWS(bg.get(), std::domain_error);
+  }
+  std::remove(fname.c_str());
+  return check_result();
+}
@@ -0,0 +1,81 @@
+#include "check.h"
+#include "bintext.h"
+#include <cstdint>
+
+int main() {
+  const std::string csv = "test_text.csv", out = "test_text_out.csv";
+  const std::string names[3] = {"test_text_a.bin", "test_text_b.bin", "test_text_c.bin"};
+  const std::vector<NumType> types = {NumType::i32, NumType::f64, NumType::u64};
+
+  // A header, blanks around the fields and empty lines
+  std::string text = "id,value,big\n";
+  const int rows = 50000;
+  for (int i = 0; i != rows; ++i) {
+    text += std::to_string(i - rows / 2) + ", " + std::to_string(i * 0.25) + " ,"
+            + std::to_string(18446744073709551615ull - i) + "\n";
+    if (i % 1000 == 0)
+      text += "\n";
+  }
+  write_file(csv, text);
+
+  for (unsigned threads : {1u, 3u, 8u}) {
+    {
+      Bin a(names[0], true), b(names[1], true), c(names[2], true);
+      CHECK(ingest_text(csv, types, {&a, &b, &c}, ',', 1, threads) == rows);
+    }
+    Bin a(names[0]), b(names[1]), c(names[2]);
+    CHECK(a.size() == 4 * rows && b.size() == 8 * rows && c.size() == 8 * rows);
+    std::vector<std::int32_t> ia = a.get_values<std::int32_t>(rows, 0);
+    std::vector<double> fb = b.get_values<double>(rows, 0);
+    std::vector<std::uint64_t> uc = c.get_values<std::uint64_t>(rows, 0);
+    bool ok = true;
+    for (int i = 0; i != rows; ++i)
+      ok = ok && ia[i] == i - rows / 2 && fb[i] == i * 0.25 && uc[i] == 18446744073709551615ull - i;
+    CHECK(ok);
+
+    // Exporting and ingesting again gives back the same columns
+    {
+      Bin o(out, true);
+      CHECK(export_columns(types, {&a, &b, &c}, o, ',', threads) == rows);
+    }
+    const std::string again[3] = {"test_text_a2.bin", "test_text_b2.bin", "test_text_c2.bin"};
+    {
+      Bin a2(again[0], true), b2(again[1], true), c2(again[2], true);
+      CHECK(ingest_text(out, types, {&a2, &b2, &c2}, ',', 0, threads) == rows);
+    }
+    for (int k = 0; k != 3; ++k)
+      CHECK(read_file(again[k]) == read_file(names[k]));
+  }
+
+  // A column can be skipped
+  {
+    Bin a(names[0], true);
+    CHECK(ingest_text(csv, types, {&a, nullptr, nullptr}, ',', 1, 2) == rows);
+    CHECK(a.size() == 4 * rows);
+  }
+
+  // In the opposite byte order the columns agree with the reads and writes of Bin, floats included
+  {
+    const bool other = !Bin::is_default_little_endian();
+    write_file(csv, "1,0.5\n-2,-3.75\n");
+    {
+      Bin a(names[0], true, other), b(names[1], true, other);
+      CHECK(ingest_text(csv, {NumType::i16, NumType::f64}, {&a, &b}) == 2);
+      CHECK(a.get_value<std::int16_t>(2) == -2 && b.get_value<double>(8) == -3.75);
+      b.write(0.25, 0);
+    }
+    Bin a(names[0], false, other), b(names[1], false, other), o(out, true);
+    CHECK(export_columns({NumType::i16, NumType::f64}, {&a, &b}, o) == 2);
+    o.close();
+    CHECK(read_file(out) == "1,0.25\n-2,-3.75\n");
+  }
+
+  // Bad input is reported
+  write_file(csv, "1,2\n3,x\n");
+  {
+    Bin a(names[0], true), b(names[1], true);
+    CHECK_THROWS(ingest_text(csv, {NumType::i32, NumType::i32}, {&a, &b}), std::runtime_error);
+    CHECK_THROWS(ingest_text(csv, {NumType::i32}, {&a, &b}), std::domain_error);
+  }
+  return check_result();
+}
@@ -0,0 +1,87 @@
+#include "check.h"
+#include "readwritebin.h"
+
+int main() {
+  const std::string fname = "test_tiering.bin";
+  const Bin::size_type region = 1 << 16, words = region / 4;
+  {
+    Bin b(fname, true);
+    b.iota<std::int32_t>(0, 4 * words, 0);
+  }
+  // Changes the file behind the tiered Bin, so the resident copies become stale
+  auto poke = [&](std::int32_t value, Bin::size_type p) {
+    Bin o(fname);
+    o.write<std::int32_t>(value, p);
+  };
+  {
+    Bin b(fname);
+    const TierBuf &tier = b.enable_tiering(2 * region, region, false, 4);
+    CHECK(tier.resident_bytes() == 0);
+
+    // The fourth hit promotes the region
+    for (int i = 0; i != 3; ++i)
+      CHECK(b.get_value<std::int32_t>(4 * (10 + i)) == 10 + i);
+    CHECK(tier.resident_bytes() == 0);
+    CHECK(b.get_value<std::int32_t>(4 * 100) == 100);
+    CHECK(tier.resident_bytes() == region);
+
+    // The resident region is read from memory, the next one from the file
+    CHECK(b.get_value<std::int32_t>(4 * (3 * words)) == 3 * words);
+    poke(-1, region - 4);
+    poke(-2, region);
+    CHECK(b.get_value<std::int32_t>(region - 4) == words - 1);
+    CHECK(b.get_values<std::int32_t>(2, region - 4) == std::vector<std::int32_t>({words - 1, -2}));
+
+    // Writes go through to the file and update the resident copy
+    b.write<std::int32_t>(-3, 4 * 5);
+    b.flush();
+    CHECK(b.get_value<std::int32_t>(4 * 5) == -3);
+    Bin other(fname, Bin::Mode::read_only);
+    CHECK(other.get_value<std::int32_t>(4 * 5) == -3 && other.get_value<std::int32_t>(region - 4) == -1);
+  }
+  {
+    // With room for one region, a hotter region demotes the resident one
+    write_file(fname, "");
+    {
+      Bin b(fname, true);
+      b.iota<std::int32_t>(0, 3 * words, 0);
+    }
+    Bin b(fname);
+    const TierBuf &tier = b.enable_tiering(region, region, true, 4);
+    for (int i = 0; i != 4; ++i)
+      b.get_value<std::int32_t>(0);
+    CHECK(tier.resident_bytes() == region);
+    poke(-1, 0);
+    CHECK(b.get_value<std::int32_t>(0) == 0);
+    // The first retry finds the resident region as hot, the second one evicts it
+    for (int i = 0; i != 4; ++i)
+      b.get_value<std::int32_t>(region);
+    poke(-2, region);
+    CHECK(b.get_value<std::int32_t>(region) == -2);
+    for (int i = 0; i != 3; ++i)
+      b.get_value<std::int32_t>(region + 8);
+    CHECK(tier.resident_bytes() == region);
+    poke(-3, region);
+    CHECK(b.get_value<std::int32_t>(region) == -2);
+    CHECK(b.get_value<std::int32_t>(0) == -1);
+  }
+  {
+    // A short last region, evicted when a write makes it grow
+    write_file(fname, "");
+    {
+      Bin b(fname, true);
+      b.iota<std::int32_t>(0, words + 25, 0);
+    }
+    Bin b(fname);
+    const TierBuf &tier = b.enable_tiering(4 * region, region, false, 1);
+    CHECK(b.get_value<std::int32_t>(region + 4 * 24) == words + 24);
+    CHECK(tier.resident_bytes() == 100);
+    CHECK_THROWS(b.get_value<std::int32_t>(region + 100), std::runtime_error);
+    b.write<std::int32_t>(7, region + 100);
+    CHECK(tier.resident_bytes() == 0);
+    CHECK(b.get_values<std::int32_t>(2, region + 96) == std::vector<std::int32_t>({words + 24, 7}));
+    CHECK_THROWS(b.enable_tiering(region, 0), std::domain_error);
+  }
+  std::remove(fname.c_str());
+  return check_result();
+}
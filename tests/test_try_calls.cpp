@@ -0,0 +1,91 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <csignal>
+#include <sys/resource.h>
+
+int main() {
+  const std::string fname = "test_try_calls.bin";
+  {
+    Bin b(fname, true);
+    b.write_many<int>({1, 2, 3, 4});
+  }
+  Bin b(fname);
+
+  int v[2] = {0, 0};
+  CHECK(b.try_get_values_into(v, 2) == Bin::Status::ok);
+  CHECK(v[0] == 1 && v[1] == 2);
+  CHECK(b.rpos() == 8);
+
+  // Not enough values before EOF: nothing is read, the position stays
+  CHECK(b.try_get_values_into(v, 3) == Bin::Status::eof);
+  CHECK(b.rpos() == 8);
+
+  CHECK(b.try_get_values_into(v, 2, 4) == Bin::Status::ok);
+  CHECK(v[0] == 2 && v[1] == 3);
+  CHECK(b.rpos() == 12);
+
+  // A failed positional read leaves the position untouched
+  b.rjump_to(4);
+  CHECK(b.try_get_values_into(v, 1, 100) == Bin::Status::eof);
+  CHECK(b.rpos() == 4);
+  CHECK(b.try_get_values_into(v, 2, 12) == Bin::Status::eof);
+  CHECK(b.rpos() == 4);
+  int x = 0;
+  CHECK(b.try_get_value(x, -1) == Bin::Status::eof);
+  CHECK(b.rpos() == 4);
+  CHECK(b.try_get_value(x) == Bin::Status::ok && x == 2);
+
+  CHECK(b.try_write(7, 0) == Bin::Status::ok);
+  CHECK(b.try_get_value(x, 0) == Bin::Status::ok && x == 7);
+
+  // A failed positional write leaves the position untouched
+  b.wjump_to(8);
+  CHECK(b.try_write(7, -1) == Bin::Status::io_error);
+  CHECK(b.wpos() == 8);
+  CHECK(b.try_write_many(v, 2, -5) == Bin::Status::io_error);
+  CHECK(b.wpos() == 8);
+  CHECK(b.try_write(9) == Bin::Status::ok && b.get_value<int>(8) == 9);
+
+  b.close();
+  CHECK(b.try_get_value(x) == Bin::Status::closed);
+  CHECK(b.try_write(1) == Bin::Status::closed);
+
+  {
+    Bin ro(fname, Bin::Mode::read_only);
+    CHECK(ro.try_write(1) == Bin::Status::read_only);
+    CHECK(ro.try_write(1, 4) == Bin::Status::read_only);
+  }
+  {
+    // A write past the file size limit fails
+    Bin big_file(fname, true);
+    big_file.wjump_to(0);
+    big_file.write<int>(5);
+    std::signal(SIGXFSZ, SIG_IGN);
+    rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = 1 << 16;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    std::vector<char> big(1 << 20, 'f');
+    CHECK(big_file.try_write_many(big.data(), big.size(), 0) == Bin::Status::io_error);
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    CHECK(big_file.wpos() == 4);
+    CHECK(big_file.try_write(6, 4) == Bin::Status::ok && big_file.wpos() == 8);
+  }
+  {
+    // In the opposite endianness floating point values are reversed both ways
+    Bin o(fname, true, !Bin::is_default_little_endian());
+    o.write(1.5, 0);
+    o.write(-2.25f, 8);
+    double d[2] = {0.5, 4.0};
+    CHECK(o.try_write_many(d, 2, 12) == Bin::Status::ok);
+    CHECK(o.get_value<double>(0) == 1.5 && o.get_value<float>(8) == -2.25f);
+    CHECK(o.get_values<double>(2, 12) == std::vector<double>({0.5, 4.0}));
+    double back = 0;
+    CHECK(o.try_get_value(back, 20) == Bin::Status::ok && back == 4.0);
+    Bin same(fname, false, Bin::is_default_little_endian());
+    CHECK(same.get_value<double>(0) != 1.5);
+  }
+  std::remove(fname.c_str());
+  return check_result();
+}
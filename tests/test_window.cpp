@@ -0,0 +1,93 @@
+#include "check.h"
+#include "readwritebin.h"
+#include <thread>
+
+int main() {
+  const std::string fname = "test_window.bin";
+  {
+    Bin b(fname, true);
+    b.iota<std::int32_t>(0, 100, 0);
+    b.rjump_to(8);
+
+    // The positions are relative to the window and stay inside it
+    BinWindow w = b.window(40, 20);
+    CHECK(w.offset() == 40 && w.size() == 20 && w.rpos() == 0);
+    CHECK(w.get_value<std::int32_t>() == 10 && w.rpos() == 4);
+    CHECK(w.get_values<std::int32_t>(4) == std::vector<std::int32_t>({11, 12, 13, 14}));
+    CHECK(w.rpos() == 20);
+    w.write<std::int32_t>(-1, 16);
+    CHECK(b.get_value<std::int32_t>(56) == -1 && b.get_value<std::int32_t>(60) == 15);
+    CHECK(w.get_value<std::int32_t>(16) == -1);
+
+    // Nothing is read or written past the end of the window
+    CHECK_THROWS(w.get_value<std::int32_t>(17), std::runtime_error);
+    CHECK_THROWS(w.get_values<std::int32_t>(2, 16), std::runtime_error);
+    CHECK_THROWS(w.rjump_to(21), std::domain_error);
+    CHECK_THROWS(w.rjump_to(-1), std::domain_error);
+    CHECK_THROWS(w.write<std::int64_t>(0, 16), std::domain_error);
+    CHECK_THROWS(w.write_many(std::vector<std::int32_t>(6)), std::domain_error);
+    std::int32_t x = 0;
+    w.rjump_to(18);
+    CHECK(w.try_get_values_into(&x, 1) == Bin::Status::eof && w.rpos() == 18);
+    CHECK(b.get_value<std::int32_t>(60) == 15);
+    w.rjump_to(20);
+    CHECK(w.get_values<std::int32_t>(0).empty());
+
+    // Windows inside windows keep the bounds of the outer one
+    BinWindow inner = w.window(8, 8);
+    CHECK(inner.offset() == 48 && inner.get_value<std::int32_t>(4) == 13);
+    CHECK_THROWS(w.window(16, 8), std::domain_error);
+    CHECK_THROWS(w.window(21, 0), std::domain_error);
+    CHECK_THROWS(b.window(-1, 4), std::domain_error);
+    CHECK_THROWS(b.window(0, -4), std::domain_error);
+
+    // The cursor of the file is left untouched
+    b.rjump_to(8);
+    w.get_value<std::int32_t>(0);
+    inner.write<std::int32_t>(7, 0);
+    CHECK(b.rpos() == 8 && b.get_value<std::int32_t>() == 2);
+  }
+  {
+    // A window past the end of the file can be read once the file grows
+    Bin b(fname, true);
+    b.iota<std::int32_t>(0, 10, 0);
+    BinWindow w = b.window(32, 32);
+    CHECK(w.get_values<std::int32_t>(2) == std::vector<std::int32_t>({8, 9}));
+    CHECK_THROWS(w.get_value<std::int32_t>(), std::runtime_error);
+    CHECK(w.rpos() == 8);
+    b.write<std::int32_t>(10, 40);
+    CHECK(w.get_value<std::int32_t>() == 10);
+    // Writing through the window grows the file too, filling the gap with zeros
+    w.write<std::int32_t>(12, 20);
+    CHECK(b.size() == 56);
+    CHECK(w.get_values<std::int32_t>(3, 12) == std::vector<std::int32_t>({0, 0, 12}));
+    std::int32_t x = 0;
+    CHECK(w.try_get_values_into(&x, 1) == Bin::Status::eof && w.rpos() == 24);
+  }
+  {
+    // Windows partition the file between threads
+    Bin b(fname, true);
+    b.fill<std::int32_t>(0, 4 * 1000, 0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t != 4; ++t)
+      pool.emplace_back([&b, t] {
+        BinWindow w = b.window(4 * 1000 * t, 4 * 1000);
+        for (int i = 0; i != 1000; ++i)
+          w.write<std::int32_t>(t * 1000 + i);
+      });
+    for (auto &t : pool)
+      t.join();
+    std::vector<std::int32_t> v = b.get_values<std::int32_t>(4000, 0);
+    bool same = true;
+    for (int i = 0; i != 4000; ++i)
+      same = same && v[i] == i;
+    CHECK(same);
+    b.close();
+    Bin r(fname, Bin::Mode::read_only);
+    BinWindow w = r.window(4 * 3990, 40);
+    CHECK(w.get_value<std::int32_t>(36) == 3999);
+    CHECK_THROWS(r.window(4 * 3990, 44).get_value<std::int32_t>(40), std::runtime_error);
+  }
+  std::remove(fname.c_str());
+  return check_result();
+}